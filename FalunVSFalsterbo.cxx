@@ -6,57 +6,323 @@
 #include <cmath>
 #include <algorithm>
 #include <iomanip>
+#include <cstdio>
+#include <cstdint>
+#include "common/date_index.h"
+#include "common/run_metrics.h"
+#include "common/station_store.h"
+#include "common/table_writer.h"
 
 using namespace std;
 
-//Function to compute average yearly temperatures from a CSV file
-map<int, double> computeYearlyAverages(const string &filename) {
-    ifstream inputFile(filename);
+//Everything that is remembered about one station between runs, see FalunVSFalsterbo.state
+//SMHI only adds new days at the end of the files, so the sums and counts of the rows that were
+//already read stay valid and only the rows after 'consumed' have to be read on the next run
+struct StationState {
+    string source;            //the file that was read, e.g. "Falun.bin" or "Falun.csv"
+    uint64_t consumed = 0;    //rows of the binary file, or bytes of the CSV file, that are already summed
+    uint64_t check = 0;       //date of the last row read (binary) or a hash of the last bytes read (CSV)
+    map<int, double> sumT;    //The sum of all temperatures during a year
+    map<int, int> countT;     //The amount of temperatures counted (limited to a year's worth)
+
+    //Forget everything and start reading source from the beginning
+    void reset(const string &new_source) {
+        *this = StationState();
+        source = new_source;
+    }
+};
+
+//FNV-1a hash of some bytes, used to notice when the part of a CSV that was already read has changed
+uint64_t hashBytes(const string &bytes) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : bytes) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+//Reads the state file, a missing file just means that this is the first run
+//Lines are "station <csv> <file read> <consumed> <check>" followed by "year <year> <sum> <count>" lines
+//The sums are written as hex floats (%a) so they come back exactly and the results don't change
+map<string, StationState> loadState(const string &path) {
+    map<string, StationState> states;
+    ifstream in(path);
+    string line;
+    StationState *current = nullptr;
+    while (getline(in, line)) {
+        stringstream ss(line);
+        string kind;
+        ss >> kind;
+        if (kind == "station") {
+            string name;
+            StationState st;
+            ss >> name >> st.source >> st.consumed >> st.check;
+            current = &states[name];
+            *current = st;
+        } else if (kind == "year" && current) {
+            int year, count;
+            string sum;
+            ss >> year >> sum >> count;
+            current->sumT[year] = strtod(sum.c_str(), nullptr);
+            current->countT[year] = count;
+        }
+    }
+    return states;
+}
+
+bool saveState(const string &path, const map<string, StationState> &states) {
+    //written to a temporary file first, so a crash never leaves half a state file behind
+    const string tmp = path + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "w");
+    if (!out)
+        return false;
+    fprintf(out, "# running sums of FalunVSFalsterbo, delete this file to read everything again\n");
+    for (auto &entry : states) {
+        const StationState &st = entry.second;
+        fprintf(out, "station %s %s %llu %llu\n", entry.first.c_str(), st.source.c_str(),
+                (unsigned long long)st.consumed, (unsigned long long)st.check);
+        for (auto &y : st.sumT)
+            fprintf(out, "year %d %a %d\n", y.first, y.second, st.countT.at(y.first));
+    }
+    const bool failed = ferror(out) != 0;
+    if (fclose(out) != 0 || failed)
+        return false;
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+//The years from fromYear on, from the month index the cleaner writes next to the CSV (Falun.csv -> Falun.idx)
+//Returns false if there is no index
+bool indexedYears(const string &filename, int fromYear, smhi::DateIndex &index, smhi::DateRange &range) {
+    if (!index.load(smhi::index_path_for(filename)))
+        return false;
+    range = index.years(fromYear, index.last_year());
+    return true;
+}
+
+//Adds the temperatures of one hour (18:00, or kNoTime for the daily means of Falun_daily.csv) of the new rows
+//of the binary copy the cleaner writes next to the CSV (Falun.csv -> Falun.bin)
+//The file is memory mapped so nothing has to be parsed, returns false if there is no binary copy
+//On a fresh start the rows before fromYear are skipped with the help of the index, 0 reads everything
+bool sumFromBinary(const string &filename, uint8_t readingHour, int fromYear, StationState &st, smhi::RunMetrics &metrics) {
+    smhi::StationStore store;
+    const string path = smhi::store_path_for(filename);
+    if (!store.open(path))
+        return false;
+
+    const int32_t *date = store.date();
+    const uint8_t *hour = store.time_code();
+
+    //Start over if the state belongs to another file, or the rows that were read are no longer there
+    if (st.source != path || st.consumed > store.rows() ||
+        (st.consumed > 0 && uint64_t(uint32_t(date[st.consumed - 1])) != st.check))
+        st.reset(path);
+
+    smhi::DateIndex index;
+    smhi::DateRange range;
+    if (st.consumed == 0 && fromYear > 0 && indexedYears(filename, fromYear, index, range) &&
+        index.matches_store(store.rows()))
+        st.consumed = range.row_begin;
+
+    uint64_t other_times = 0, missing = 0;
+    for (size_t i = st.consumed; i < store.rows(); ++i) {
+        //Only the correct time will be read
+        if (hour[i] != readingHour) {
+            other_times++;
+            continue;
+        }
+
+        double temp = store.value(0, i);
+        if (std::isnan(temp)) {
+            missing++;
+            continue;
+        }
+
+        int year, month, day;
+        smhi::civil_from_days(date[i], year, month, day);
+        st.sumT[year] += temp;
+        st.countT[year]++;
+    }
+
+    //Only the new rows count, the others were read on an earlier run
+    const uint64_t rows = store.rows() - st.consumed;
+    metrics.count("rows_read", rows);
+    metrics.count("bytes_in", rows * (sizeof(int32_t) + sizeof(uint8_t) + sizeof(float)));
+    metrics.count("rows_filtered", other_times);
+    metrics.failure("missing_temperature", missing);
+
+    st.consumed = store.rows();
+    if (st.consumed > 0)
+        st.check = uint32_t(date[st.consumed - 1]);
+    return true;
+}
+
+//Reads the last (up to 64) bytes before offset, to compare with the hash in the state
+string bytesBefore(ifstream &file, uint64_t offset) {
+    const uint64_t n = min<uint64_t>(offset, 64);
+    string bytes(n, '\0');
+    file.clear();
+    file.seekg(offset - n);
+    file.read(&bytes[0], n);
+    return file ? bytes : string();
+}
+
+//Adds the temperatures of one hour of the new lines of the CSV file, starting where the last run stopped
+//or, on a fresh start, at the first line of fromYear if the index knows where that is
+bool sumFromCsv(const string &filename, uint8_t readingHour, int fromYear, StationState &st, smhi::RunMetrics &metrics) {
+    ifstream inputFile(filename, ios::binary);
     if (!inputFile.is_open()) {
         cerr << "Can't open file: " << filename << endl;
-        return {};
+        return false;
     }
 
-//Maps with the year as the key
-    map<int, double> sumT; //The sum of all temperatures during a year
-    map<int, int> countT; //The amount of temperatures counted (limited to a year's worth)
+    inputFile.seekg(0, ios::end);
+    const uint64_t size = inputFile.tellg();
+    if (st.source != filename || st.consumed > size ||
+        (st.consumed > 0 && hashBytes(bytesBefore(inputFile, st.consumed)) != st.check))
+        st.reset(filename);
+
+    smhi::DateIndex index;
+    smhi::DateRange range;
+    if (st.consumed == 0 && fromYear > 0 && indexedYears(filename, fromYear, index, range) && index.matches_csv(size))
+        st.consumed = range.byte_begin;
+
+    inputFile.clear();
+    inputFile.seekg(st.consumed);
+
     string line;
+    const uint64_t start = st.consumed;
+    uint64_t rows = 0, other_times = 0, unreadable = 0;
 
 //Turning the csv data file into variables like date, time, and temperature
     while (getline(inputFile, line)) {
+        //A last line without a newline may still be being written, it is read on the next run
+        if (inputFile.eof())
+            break;
+        st.consumed += line.size() + 1;
+        rows++;
+
         string date, time, temperature;
         stringstream ss(line);
         getline(ss, date, ';');
         getline(ss, time, ';');
         getline(ss, temperature, ';');
 
-        //Only the correct time will be read
-        if (time != "18:00:00")
+        //Only the correct time will be read (the daily files have no time)
+        if (smhi::time_code_from_text(time) != readingHour) {
+            other_times++;
             continue;
+        }
 
-        int year = stoi(date.substr(0, 4));
-        double temp = stod(temperature);
+        //Rows without a readable date or temperature are skipped (a blank line has no time either,
+        //so in the daily files it gets past the time check)
+        int year, month, day;
+        double temp;
+        if (date.size() < 10 || !smhi::parse_ymd(date.data(), year, month, day) ||
+            !smhi::parse_decimal(temperature, temp)) {
+            unreadable++;
+            continue;
+        }
 
-        sumT[year] += temp;
-        countT[year]++;
+        st.sumT[year] += temp;
+        st.countT[year]++;
     }
 
+    metrics.count("rows_read", rows);
+    metrics.count("bytes_in", st.consumed - start);
+    metrics.count("rows_filtered", other_times);
+    metrics.failure("missing_temperature", unreadable);
+
+    st.check = hashBytes(bytesBefore(inputFile, st.consumed));
     inputFile.close();
+    return true;
+}
+
+//Function to compute average yearly temperatures, from the binary copy if there is one and otherwise from the CSV file
+//Only the rows that are not in the state yet are read, the state is updated with them
+map<int, double> computeYearlyAverages(const string &filename, uint8_t readingHour, int fromYear, StationState &st,
+                                       smhi::RunMetrics &metrics) {
+    if (!sumFromBinary(filename, readingHour, fromYear, st, metrics) &&
+        !sumFromCsv(filename, readingHour, fromYear, st, metrics))
+        return {};
 
     //Calculating the average temperature for each year and saving it witha  map
     map<int, double> averages;
-    for (auto &entry : sumT) {
+    for (auto &entry : st.sumT) {
         int year = entry.first;
-        averages[year] = sumT[year] / countT[year];
+        averages[year] = st.sumT[year] / st.countT[year];
     }
 
     return averages;
 }
 
-int main() {
+//Share of the days of a year that have a temperature in the sums (0..1)
+double yearCoverage(const StationState &st, int year) {
+    auto it = st.countT.find(year);
+    return it == st.countT.end() ? 0.0 : double(it->second) / (smhi::is_leap(year) ? 366 : 365);
+}
+
+int main(int argc, char **argv) {
+    //The sums of earlier runs are kept in FalunVSFalsterbo.state, so only new rows are read
+    //./FalunVSFalsterbo --rebuild ignores the state and reads both files from the start
+    //./FalunVSFalsterbo --daily uses the daily means of all hours in Falun_daily.csv and Falsterbo_daily.csv
+    //(cleaning_data --daily) instead of the 18:00 temperatures
+    //./FalunVSFalsterbo --min-coverage 0.9 leaves out the years where a station has an 18:00 temperature
+    //on less than 90 % of the days (the default 0 keeps every year, also the first and last partial ones)
+    //With SMHI_METRICS=report.json the rows, bytes and times of the run are written there, see common/run_metrics.h
+    smhi::RunMetrics metrics("FalunVSFalsterbo");
+    const string statePath = "FalunVSFalsterbo.state";
+    bool rebuild = false, daily = false;
+    double minCoverage = 0;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--rebuild")
+            rebuild = true;
+        else if (arg == "--daily")
+            daily = true;
+        else if (arg == "--min-coverage" && i + 1 < argc && smhi::parse_decimal(string(argv[i + 1]), minCoverage))
+            ++i;
+        else {
+            cerr << "Usage: " << argv[0] << " [--rebuild] [--daily] [--min-coverage F]" << endl;
+            return 1;
+        }
+    }
+    const string falun = daily ? "Falun_daily.csv" : "Falun.csv";
+    const string falsterbo = daily ? "Falsterbo_daily.csv" : "Falsterbo.csv";
+    const uint8_t readingHour = daily ? smhi::kNoTime : 18;
+    //The state is stored per station, under the name of its CSV file
+    map<string, StationState> state = rebuild ? map<string, StationState>() : loadState(statePath);
+
+    //When both files are read from the start only the latest 30 years are needed. The month indexes
+    //of the cleaner say which year is the last one and where the rows of the first needed year begin,
+    //so the older rows are not read at all
+    int fromYear = 0;
+    smhi::DateIndex falunIndex, falsterboIndex;
+    if (state[falun].consumed == 0 && state[falsterbo].consumed == 0 &&
+        falunIndex.load(smhi::index_path_for(falun)) && falsterboIndex.load(smhi::index_path_for(falsterbo)))
+        fromYear = max(falunIndex.last_year(), falsterboIndex.last_year()) - 29;
+
     //Putting both files through the code that takes the average
-    map<int, double> falun_avg = computeYearlyAverages("Falun.csv");
-    map<int, double> falsterbo_avg = computeYearlyAverages("Falsterbo.csv");
+    auto phase = metrics.phase("read");
+    map<int, double> falun_avg = computeYearlyAverages(falun, readingHour, fromYear, state[falun], metrics);
+    map<int, double> falsterbo_avg = computeYearlyAverages(falsterbo, readingHour, fromYear, state[falsterbo], metrics);
+
+    //The last year of the index may have no 18:00 temperature at all; then an older year is
+    //needed after all and both files are read again from the start
+    int lastRead = 0;
+    if (!falun_avg.empty()) lastRead = falun_avg.rbegin()->first;
+    if (!falsterbo_avg.empty()) lastRead = max(lastRead, falsterbo_avg.rbegin()->first);
+    if (fromYear > 0 && lastRead - 29 < fromYear) {
+        state.erase(falun);
+        state.erase(falsterbo);
+        metrics.count("read_again");
+        falun_avg = computeYearlyAverages(falun, readingHour, 0, state[falun], metrics);
+        falsterbo_avg = computeYearlyAverages(falsterbo, readingHour, 0, state[falsterbo], metrics);
+    }
+    phase = metrics.phase("write");
+
+    if (!saveState(statePath, state))
+        cerr << "Can't write " << statePath << ", the next run will read everything again" << endl;
 
     //Combining all years found in either dataset
     map<int, bool> all_years;
@@ -71,17 +337,16 @@ int main() {
 
     int cutoffYear = maxYear - 29; //Choosing how many years that are kept
 
-    //Checking if the file can be created, error if it can't
-    ofstream outfile("FalunVSFalsterbo.csv");
-    if (!outfile.is_open()) {
+    //Checking if the file can be created, error if it can't (2 decimals in every column)
+    auto outfile = smhi::open_table_writer("FalunVSFalsterbo.csv", {{"year", smhi::ColumnType::kInt},
+                                                                    smhi::number_column("Falun_avg", 2),
+                                                                    smhi::number_column("Falsterbo_avg", 2),
+                                                                    smhi::number_column("Difference", 2)});
+    if (!outfile) {
         cerr << "Can't create file FalunVSFalsterbo.csv" << endl;
         return 1;
     }
 
-    //Formatting for the output file
-    outfile << "year,Falun_avg,Falsterbo_avg,Difference\n";
-    outfile << fixed << setprecision(2);
-
     for (auto &y : all_years) {
         int year = y.first;
         if (year < cutoffYear)
@@ -90,13 +355,29 @@ int main() {
         bool falunHas = falun_avg.count(year);
         bool falsterboHas = falsterbo_avg.count(year);
 
+        //The count of a year is the number of days with a temperature, so it also says how complete the year is
+        if (falunHas && falsterboHas && (yearCoverage(state[falun], year) < minCoverage ||
+                                         yearCoverage(state[falsterbo], year) < minCoverage)) {
+            metrics.failure("year_incomplete");
+            continue;
+        }
+
         if (falunHas && falsterboHas) {
             double diff = abs(falun_avg[year] - falsterbo_avg[year]);
-            outfile << year << "," << falun_avg[year] << "," << falsterbo_avg[year] << "," << diff << "\n";
+            outfile->add_int(year);
+            outfile->add_number(falun_avg[year]);
+            outfile->add_number(falsterbo_avg[year]);
+            outfile->add_number(diff);
+            outfile->end_row();
+            metrics.count("years_written");
         }
     }
 
-    outfile.close();
+    if (!outfile->close()) {
+        cerr << "Can't write file FalunVSFalsterbo.csv" << endl;
+        return 1;
+    }
+    metrics.count_file("bytes_out", "FalunVSFalsterbo.csv");
     cout << "File 'FalunVSFalsterbo.csv' saved (latest 30 years)\n";
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+// Daily anomalies of every station against its own day-of-year baseline, for all stations at once.
+//
+// Build: g++ -std=c++17 -O3 -pthread anomalies.cxx -o anomalies  (-O3 so that gcc vectorizes the anomaly loop)
+// Usage: ./anomalies [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--window DAYS] [--threads N]
+//                    [--format csv|arrow] [--outdir DIR] [--metrics report.json] station.csv [station.csv ...]
+//        (default: temperature, reference period 1991-01-01 to 2020-12-31, 31 day window)
+//
+// For every observation hour of a station (06:00 and 18:00 are separate series), the baseline
+// is the mean of every day of the year over the reference period, smoothed over --window days
+// (see common/anomaly.h). Every reading of the station, also outside the reference period,
+// then gets its anomaly: the reading minus the baseline of its day and hour.
+//
+// Falun.csv gives DIR/Falun_anomaly.csv ("date;time;anomaly", rows in the order of the station
+// file) and the binary copy DIR/Falun_anomaly.bin with the column "anomaly", which the other
+// tools and station_query read like any cleaned station, e.g.
+//     ./station_query --column anomaly --by year --agg mean Falun_anomaly.csv
+// With --format arrow the table goes to DIR/Falun_anomaly.arrow (an Arrow IPC file, see
+// common/table_writer.h) instead of the CSV. The baselines are saved in DIR/anomaly_baseline.csv.
+// The stations run on parallel threads. --metrics (or $SMHI_METRICS) writes the rows, bytes and
+// times of the run as JSON, see common/run_metrics.h.
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "common/anomaly.h"
+#include "common/group_query.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_series.h"
+#include "common/station_store.h"
+#include "common/table_writer.h"
+
+struct Options {
+    std::string column = "temperature";
+    int32_t from = smhi::days_from_civil(1991, 1, 1);
+    int32_t to = smhi::days_from_civil(2020, 12, 31);
+    int window = 31;
+    std::string outdir = ".";
+    std::string format = "csv"; // of the table next to the .bin file: csv or arrow
+};
+
+struct StationJob {
+    std::string path;
+    std::string name;                         // "datasets/Falun.csv" -> "Falun"
+    std::vector<uint8_t> hours;               // the observation hours of the station
+    std::vector<smhi::DoyBaseline> baselines; // one per hour
+    size_t rows = 0;
+    std::string error;
+};
+
+void run_station(StationJob& job, const Options& opt) {
+    smhi::StationStore store;
+    if (!store.open(smhi::store_path_for(job.path))) {
+        job.error = "no binary file " + smhi::store_path_for(job.path) + ", run the cleaner first";
+        return;
+    }
+    if (store.column_index(opt.column) < 0) {
+        job.error = "no column " + opt.column;
+        return;
+    }
+
+    // which hours the station has, so each gets a series of its own
+    bool seen[256] = {};
+    const uint8_t* hour = store.time_code();
+    for (size_t i = 0; i < store.rows(); ++i)
+        seen[hour[i]] = true;
+    for (int h = 0; h < 256; ++h)
+        if (seen[h])
+            job.hours.push_back(uint8_t(h));
+
+    smhi::StationSeries series(job.hours);
+    series.load(store, opt.column);
+    if (series.empty()) {
+        job.error = "no values in column " + opt.column;
+        return;
+    }
+
+    // the anomalies of every hour as contiguous arrays, one value per day
+    std::vector<std::vector<float>> anomaly(job.hours.size(), std::vector<float>(series.days()));
+    for (size_t s = 0; s < job.hours.size(); ++s) {
+        job.baselines.push_back(smhi::doy_baseline(series, int(s), opt.from, opt.to, opt.window));
+        smhi::doy_anomalies(series, int(s), job.baselines.back(), anomaly[s].data());
+    }
+
+    // written back in the order of the rows of the station file, as text (2 decimals) and as
+    // the binary copy (every digit the float has)
+    const std::string table_path = opt.outdir + "/" + job.name + "_anomaly." + opt.format;
+    const std::string bin_path = opt.outdir + "/" + job.name + "_anomaly.bin";
+    auto table = smhi::open_table_writer(table_path, {{"date", smhi::ColumnType::kDate}, {"time", smhi::ColumnType::kHour},
+                                                      smhi::number_column("anomaly", 2)}, ';', false);
+    auto binary = smhi::open_table_writer(bin_path, {{"date", smhi::ColumnType::kDate}, {"time", smhi::ColumnType::kHour},
+                                                     {"anomaly", smhi::ColumnType::kNumber}});
+    if (!table) {
+        job.error = "can't create " + table_path;
+        return;
+    }
+    const int32_t* date = store.date();
+    for (size_t i = 0; i < store.rows(); ++i) {
+        const int s = series.slot_of(hour[i]);
+        const double v = anomaly[size_t(s)][size_t(date[i] - series.first_day())];
+        for (smhi::TableWriter* out : {table.get(), binary.get()}) {
+            out->add_int(date[i]);
+            out->add_int(hour[i]);
+            out->add_number(v);
+            out->end_row();
+        }
+    }
+    if (!table->close()) {
+        job.error = "can't write " + table_path;
+        return;
+    }
+    if (!binary->close()) {
+        job.error = "can't write " + bin_path;
+        return;
+    }
+    job.rows = store.rows();
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    unsigned threads = 0;
+    std::vector<StationJob> jobs;
+    smhi::RunMetrics metrics("anomalies");
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--column" && has_value) opt.column = argv[++i];
+        else if (arg == "--from" && has_value) ok = smhi::parse_date_text(argv[++i], opt.from);
+        else if (arg == "--to" && has_value) ok = smhi::parse_date_text(argv[++i], opt.to);
+        else if (arg == "--window" && has_value) ok = (opt.window = std::stoi(argv[++i])) >= 1;
+        else if (arg == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else if (arg == "--outdir" && has_value) opt.outdir = argv[++i];
+        else if (arg == "--format" && has_value) ok = (opt.format = argv[++i]) == "csv" || opt.format == "arrow";
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (arg[0] != '-') {
+            StationJob job;
+            job.path = arg;
+            job.name = smhi::station_name(arg);
+            jobs.push_back(job);
+        }
+        else ok = false;
+    }
+    if (!ok || jobs.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--window DAYS] [--threads N]"
+                     " [--format csv|arrow] [--outdir DIR] [--metrics report.json] station.csv [station.csv ...]\n";
+        return 1;
+    }
+
+    auto phase = metrics.phase("anomalies");
+    smhi::parallel_for(jobs.size(), threads, [&](size_t i, unsigned) { run_station(jobs[i], opt); });
+    phase = metrics.phase("write_baselines");
+
+    const std::string baseline_path = opt.outdir + "/anomaly_baseline.csv";
+    FILE* out = std::fopen(baseline_path.c_str(), "w");
+    if (!out) {
+        std::cerr << "Can't create " << baseline_path << "\n";
+        return 1;
+    }
+    std::fprintf(out, "Station;Day;Time;Baseline;Count\n");
+    int failed = 0, no_baseline = 0;
+    for (const auto& job : jobs) {
+        metrics.count("stations");
+        if (!job.error.empty()) {
+            std::cerr << job.path << ": " << job.error << "\n";
+            metrics.failure("station_failed");
+            failed++;
+            continue;
+        }
+        metrics.count("rows", job.rows);
+        metrics.count_file("bytes_in", smhi::store_path_for(job.path));
+        metrics.count_file("bytes_out", opt.outdir + "/" + job.name + "_anomaly." + opt.format);
+        metrics.count_file("bytes_out", opt.outdir + "/" + job.name + "_anomaly.bin");
+        for (size_t s = 0; s < job.hours.size(); ++s) {
+            const smhi::DoyBaseline& b = job.baselines[s];
+            const std::string time = smhi::time_text_from_code(job.hours[s]);
+            for (int slot = 0; slot < smhi::kCubeDays; ++slot) {
+                if (std::isnan(b.value[slot])) {
+                    no_baseline++;
+                    continue;
+                }
+                std::fprintf(out, "%s;%s;%s;%.4f;%u\n", job.name.c_str(), smhi::cube_slot_name(slot).c_str(),
+                             time.c_str(), b.value[slot], b.count[slot]);
+            }
+        }
+        std::cout << job.name << ": " << job.rows << " anomalies saved to " << opt.outdir << "/" << job.name
+                  << "_anomaly." << opt.format << " and .bin\n";
+    }
+    const bool write_failed = std::ferror(out) != 0;
+    if (std::fclose(out) != 0 || write_failed) {
+        std::cerr << "Can't write " << baseline_path << "\n";
+        return 1;
+    }
+    phase.stop();
+    metrics.count_file("bytes_out", baseline_path);
+    metrics.failure("no_baseline", uint64_t(no_baseline));
+    if (no_baseline > 0)
+        std::cerr << no_baseline << " station days have no values in the reference period, their anomalies are empty\n";
+    return failed == 0 ? 0 : 1;
+}
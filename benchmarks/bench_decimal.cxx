@@ -0,0 +1,147 @@
+// Compares smhi::parse_decimal (common/decimal_parse.h) with std::stod and std::from_chars.
+//
+// Build: g++ -std=c++17 -O2 bench_decimal.cxx -o bench_decimal
+// Usage: ./bench_decimal <file> [<file> ...]
+//   e.g. ./bench_decimal ../datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv ../Falun.csv
+//
+// Every ';' or ',' separated field of the files that std::stod reads completely is collected.
+// First the parsers are checked to give bit for bit the same double as std::stod for every
+// field, then each one converts all the fields a number of times and the best time is printed.
+// Note: std::from_chars for double needs GCC 11 or newer; with older compilers it is skipped.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../common/decimal_parse.h"
+
+// true if std::stod reads the whole field, which is what the tools' fields look like
+bool stod_reads_all(const std::string& field) {
+    if (field.empty() || field[0] == ' ')
+        return false;
+    try {
+        size_t used = 0;
+        std::stod(field, &used);
+        return used == field.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+bool same_bits(double a, double b) { return std::memcmp(&a, &b, sizeof a) == 0; }
+
+// runs f() several times and returns the fastest run in nanoseconds per field
+template <class F>
+double best_ns_per_field(size_t n_fields, F f) {
+    double best = 1e300;
+    for (int run = 0; run < 7; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count() / double(n_fields));
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <file> [<file> ...]\n";
+        return 1;
+    }
+
+    // the files are kept in memory and the fields point into them
+    std::vector<std::string> texts;
+    std::vector<std::string> field_copies;
+    std::vector<std::string_view> fields;
+    for (int a = 1; a < argc; ++a) {
+        std::ifstream in(argv[a], std::ios::binary);
+        if (!in.is_open()) {
+            std::cerr << "Can't open " << argv[a] << "\n";
+            return 1;
+        }
+        std::stringstream ss;
+        ss << in.rdbuf();
+        texts.push_back(ss.str());
+    }
+    for (const auto& text : texts) {
+        size_t start = 0;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i < text.size() && text[i] != ';' && text[i] != ',' && text[i] != '\n' && text[i] != '\r')
+                continue;
+            std::string field = text.substr(start, i - start);
+            if (stod_reads_all(field)) {
+                fields.emplace_back(text.data() + start, i - start);
+                field_copies.push_back(field);
+            }
+            start = i + 1;
+        }
+    }
+    const size_t n = fields.size();
+    if (n == 0) {
+        std::cerr << "No numeric fields found\n";
+        return 1;
+    }
+
+    // 1. the results must be identical to std::stod
+    std::vector<double> expected(n), got(n);
+    std::vector<uint64_t> bad((n + 63) / 64);
+    for (size_t i = 0; i < n; ++i)
+        expected[i] = std::stod(field_copies[i]);
+    const size_t errors = smhi::parse_decimal_column(fields.data(), n, got.data(), bad.data());
+    size_t mismatches = errors;
+    for (size_t i = 0; i < n; ++i) {
+        double one = 0;
+        smhi::parse_decimal(fields[i], one);
+        if (!same_bits(got[i], expected[i]) || !same_bits(one, expected[i])) {
+            if (mismatches < 10)
+                std::cerr << "mismatch for '" << field_copies[i] << "'\n";
+            mismatches++;
+        }
+    }
+    std::cout << n << " numeric fields, " << mismatches << " differ from std::stod\n";
+
+    // 2. timings
+    volatile double sink = 0;
+    const double t_stod = best_ns_per_field(n, [&] {
+        double s = 0;
+        for (const auto& f : field_copies) s += std::stod(f);
+        sink = s;
+    });
+    const double t_scalar = best_ns_per_field(n, [&] {
+        double s = 0;
+        for (const auto& f : fields) {
+            double v = 0;
+            smhi::parse_decimal(f, v);
+            s += v;
+        }
+        sink = s;
+    });
+    const double t_column = best_ns_per_field(n, [&] {
+        smhi::parse_decimal_column(fields.data(), n, got.data(), bad.data());
+        sink = got[n - 1];
+    });
+
+    std::cout << "std::stod                  " << t_stod << " ns/field\n";
+#if defined(__cpp_lib_to_chars) || (defined(__GNUC__) && __GNUC__ >= 11)
+    const double t_from_chars = best_ns_per_field(n, [&] {
+        double s = 0;
+        for (const auto& f : fields) {
+            double v = 0;
+            std::from_chars(f.data(), f.data() + f.size(), v);
+            s += v;
+        }
+        sink = s;
+    });
+    std::cout << "std::from_chars            " << t_from_chars << " ns/field\n";
+#endif
+    std::cout << "smhi::parse_decimal        " << t_scalar << " ns/field\n";
+    std::cout << "smhi::parse_decimal_column " << t_column << " ns/field\n";
+    return mismatches == 0 ? 0 : 1;
+}
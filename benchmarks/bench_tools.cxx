@@ -0,0 +1,241 @@
+// Times every tool of the project on the files made by generate_smhi.
+//
+// Build: g++ -std=c++17 -O2 bench_tools.cxx -o bench_tools
+// Usage: ./bench_tools <workspace> [--repeat N] [--only name]
+//
+// The workspace is prepared by run_benchmarks.sh: the compiled tools, the generated files in
+// datasets/ and the manifest bench_stations.txt, laid out like the repository. Every tool
+// is started as its own process (fork + exec) and waited for with wait4(), which also gives
+// the peak memory (RSS) of the process. With --repeat the fastest run is reported.
+//
+// Tools that read the binary copies (Falun.bin, ...) are run twice: once as they are, and
+// once with the .bin files moved away so that the CSV is parsed ("csv" in the name).
+// rows/s counts the lines of the CSV the tool works on, bytes/s the size of the files it reads.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../common/mapped_file.h"
+#include "../common/station_store.h"
+
+struct Step {
+    std::string name;
+    std::string dir;                 // working directory, relative to the workspace
+    std::vector<std::string> args;   // args[0] is the program
+    std::string stdin_text;          // written to the standard input of the tool
+    std::vector<std::string> inputs; // files read, relative to dir (for bytes/s)
+    std::vector<std::string> rows_of;// CSV files whose lines are the rows processed (for rows/s)
+    bool csv_only = false;           // hide the .bin files of rows_of while running
+};
+
+struct Measurement {
+    bool ok = false;
+    double seconds = 0;
+    long peak_rss_kb = 0;
+};
+
+size_t file_size(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? size_t(st.st_size) : 0;
+}
+
+size_t count_lines(const std::string& path) {
+    smhi::MappedFile f;
+    if (!f.open(path))
+        return 0;
+    size_t n = 0;
+    for (const char* p = f.data(); (p = static_cast<const char*>(std::memchr(p, '\n', f.data() + f.size() - p))); ++p)
+        ++n;
+    return n;
+}
+
+// runs the step once in its own process
+Measurement run_once(const std::string& workspace, const Step& step) {
+    Measurement m;
+    const std::string stdin_path = workspace + "/.bench_stdin";
+    {
+        std::ofstream in(stdin_path);
+        in << step.stdin_text;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const pid_t pid = fork();
+    if (pid == 0) {
+        // in the child: go to the directory, connect stdin/stdout/stderr and start the tool
+        const std::string dir = workspace + "/" + step.dir;
+        if (chdir(dir.c_str()) != 0)
+            _exit(126);
+        const int in = open(stdin_path.c_str(), O_RDONLY);
+        const int out = open("/dev/null", O_WRONLY);
+        dup2(in, 0);
+        dup2(out, 1);
+        dup2(out, 2);
+        std::vector<char*> argv;
+        for (const auto& a : step.args)
+            argv.push_back(const_cast<char*>(a.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    if (pid < 0)
+        return m;
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid)
+        return m;
+    const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    m.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    m.seconds = took.count();
+    m.peak_rss_kb = usage.ru_maxrss; // in kilobytes on Linux
+    return m;
+}
+
+// the outputs listed in the manifest (second field of every line)
+std::vector<std::string> cleaned_files(const std::string& manifest) {
+    std::vector<std::string> out;
+    std::ifstream in(manifest);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        const size_t a = line.find(';');
+        const size_t b = line.find(';', a + 1);
+        if (a != std::string::npos)
+            out.push_back(line.substr(a + 1, b == std::string::npos ? std::string::npos : b - a - 1));
+    }
+    return out;
+}
+
+std::vector<std::string> bins_of(const std::vector<std::string>& csvs) {
+    std::vector<std::string> out;
+    for (const auto& c : csvs)
+        out.push_back(smhi::store_path_for(c));
+    return out;
+}
+
+std::vector<Step> make_steps(const std::string& workspace) {
+    std::vector<Step> steps;
+    const std::vector<std::string> stations = cleaned_files(workspace + "/bench_stations.txt");
+    std::vector<std::string> raw;
+    {
+        std::ifstream in(workspace + "/bench_stations.txt");
+        std::string line;
+        while (std::getline(in, line))
+            if (!line.empty() && line[0] != '#')
+                raw.push_back(line.substr(0, line.find(';')));
+    }
+    const std::vector<std::string> falun_falsterbo = {"Falun.csv", "Falsterbo.csv"};
+    const std::vector<std::string> uppsala = {"Uppsala.csv"};
+    // relative to the directory the tool runs in
+    const std::string grid = "../../datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv";
+    const std::string rain = "../data_clean/Rain_temperature_cleaned.csv";
+    std::vector<std::string> tgd_args = {"./temperature_given_day", "--days", "all"};
+    tgd_args.insert(tgd_args.end(), stations.begin(), stations.end());
+
+    steps.push_back({"cleaning_data", ".", {"./cleaning_data", "bench_stations.txt"}, "", raw, raw});
+    steps.push_back({"cleaning_data --daily", ".", {"./cleaning_data", "--daily", "bench_stations.txt"}, "", raw, raw});
+    steps.push_back({"Rain_data_clean", "rain_analysis/data_clean", {"./Rain_data_clean"}, "", {grid}, {grid}});
+
+    // tools that use the binary copy when it is there
+    struct Reader {
+        std::string name, dir;
+        std::vector<std::string> args;
+        std::string stdin_text;
+        std::vector<std::string> csvs;
+    };
+    const std::vector<Reader> readers = {
+        {"FalunVSFalsterbo", ".", {"./FalunVSFalsterbo", "--rebuild"}, "", falun_falsterbo},
+        {"warmest_coldest", ".", {"./warmest_coldest"}, "", uppsala},
+        {"temperature_given_day", ".", {"./temperature_given_day"}, "07-04\n", {"Falsterbo.csv"}},
+        {"temperature_given_day --days all", ".", tgd_args, "", stations},
+        {"analysis all years", "rain_analysis/analysis",
+         {"./analysis", "../data_clean/Rain_temperature_cleaned.csv", "all", "A=Lund,B=Uppsala", "../results"}, "", {rain}},
+        {"analysis region", "rain_analysis/analysis",
+         {"./analysis", "../data_clean/Rain_temperature_cleaned.csv", "all", "box:55:60:11:18=Region", "../results"}, "", {rain}},
+    };
+    for (const auto& r : readers) {
+        steps.push_back({r.name, r.dir, r.args, r.stdin_text, bins_of(r.csvs), r.csvs});
+        // the incremental run right after a full one has no new rows to read
+        if (r.name == "FalunVSFalsterbo")
+            steps.push_back({r.name + " (no new rows)", r.dir, {"./FalunVSFalsterbo"}, "", bins_of(r.csvs), r.csvs});
+        steps.push_back({r.name + " (csv)", r.dir, r.args, r.stdin_text, r.csvs, r.csvs, true});
+    }
+    return steps;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <workspace> [--repeat N] [--only name]\n";
+        return 1;
+    }
+    const std::string workspace = argv[1];
+    int repeat = 1;
+    std::string only;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--repeat") repeat = std::max(1, std::stoi(argv[i + 1]));
+        else if (std::string(argv[i]) == "--only") only = argv[i + 1];
+    }
+
+    std::ofstream results(workspace + "/bench_results.csv");
+    results << "step,seconds,rows,bytes,rows_per_s,MB_per_s,peak_rss_MB\n";
+    std::printf("%-40s %9s %12s %14s %10s %10s\n", "step", "seconds", "rows", "rows/s", "MB/s", "RSS MB");
+
+    int failed = 0;
+    for (const Step& step : make_steps(workspace)) {
+        if (!only.empty() && step.name.find(only) == std::string::npos)
+            continue;
+
+        // hide the binary copies so the tool has to read the CSV
+        std::vector<std::string> hidden;
+        if (step.csv_only)
+            for (const auto& bin : bins_of(step.rows_of)) {
+                const std::string path = workspace + "/" + step.dir + "/" + bin;
+                if (std::rename(path.c_str(), (path + ".hidden").c_str()) == 0)
+                    hidden.push_back(path);
+            }
+
+        size_t rows = 0, bytes = 0;
+        for (const auto& f : step.rows_of) rows += count_lines(workspace + "/" + step.dir + "/" + f);
+        for (const auto& f : step.inputs) bytes += file_size(workspace + "/" + step.dir + "/" + f);
+
+        Measurement best;
+        for (int r = 0; r < repeat; ++r) {
+            const Measurement m = run_once(workspace, step);
+            if (!m.ok) {
+                best = m;
+                break;
+            }
+            if (!best.ok || m.seconds < best.seconds)
+                best = m;
+            best.peak_rss_kb = std::max(best.peak_rss_kb, m.peak_rss_kb);
+        }
+        for (const auto& path : hidden)
+            std::rename((path + ".hidden").c_str(), path.c_str());
+
+        if (!best.ok) {
+            std::printf("%-40s FAILED\n", step.name.c_str());
+            failed++;
+            continue;
+        }
+        const double rows_per_s = rows / best.seconds;
+        const double mb_per_s = bytes / best.seconds / 1e6;
+        const double rss_mb = best.peak_rss_kb / 1024.0;
+        std::printf("%-40s %9.3f %12zu %14.0f %10.1f %10.1f\n", step.name.c_str(), best.seconds, rows, rows_per_s,
+                    mb_per_s, rss_mb);
+        results << '"' << step.name << "\"," << best.seconds << "," << rows << "," << bytes << "," << rows_per_s << ","
+                << mb_per_s << "," << rss_mb << "\n";
+    }
+    std::cout << "Results saved to " << workspace << "/bench_results.csv\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+// Writes synthetic SMHI files for the benchmarks, in the same formats as the real downloads.
+//
+// Build: g++ -std=c++17 -O2 generate_smhi.cxx -o generate_smhi
+// Usage:
+//   ./generate_smhi station <output_dir> [--scale S] [--stations N] [--missing P] [--readings R] [--seed X]
+//   ./generate_smhi pthbv <output_csv> [--scale S] [--stations N] [--missing P] [--seed X]
+//
+// station: N files (Falun.csv, Falsterbo.csv, Uppsala.csv, Station4.csv, ...) in the
+//          "Datum;Tid (UTC);Lufttemperatur;Kvalitet" format of the SMHI station downloads.
+//          Scale 1 is the size of the real files: 1961-01-01 to 2023-09-30 with readings
+//          at 00, 06, 12 and 18 o'clock, about 92 000 rows (2.8 MB) per station.
+//          --readings 24 gives hourly readings, so large files need fewer years.
+// pthbv:   one file in the multi-column format of SMHI_pthbv_p_t_1961_2025_daily_4326.csv,
+//          with a rain and a temperature column for each of N grid points (default 2, like the
+//          real file). Scale 1 is the real number of days, 1961-01-01 to 2025-10-28.
+//
+// --scale multiplies the number of rows (1 to 1000 or more). Dates run forward from 1961
+// and, only for the very largest files, start again at year 0001 after 9999-12-31.
+// --missing is the fraction of values written as an empty field (default 0.01).
+// The same seed always gives the same files.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../common/smhi_date.h"
+
+// small and fast random numbers (xorshift64*), good enough for test data
+struct Random {
+    uint64_t state;
+    explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    double uniform() { return double(next() >> 11) * (1.0 / 9007199254740992.0); } // [0, 1)
+    // roughly normal noise: the sum of four uniforms, scaled to a standard deviation of 1
+    double noise() { return (uniform() + uniform() + uniform() + uniform() - 2.0) * 1.7320508; }
+};
+
+// Output buffered in big blocks, the files can be several GB
+class Output {
+public:
+    bool open(const std::string& path) {
+        f_ = std::fopen(path.c_str(), "wb");
+        buf_.reserve(kBlock + 256);
+        return f_ != nullptr;
+    }
+    Output& text(const char* s) { buf_.append(s); return flush_if_full(); }
+    Output& text(const std::string& s) { buf_.append(s); return flush_if_full(); }
+    Output& ch(char c) { buf_.push_back(c); return *this; }
+    // "YYYY-MM-DD"
+    Output& date(int32_t day) {
+        int y, m, d;
+        smhi::civil_from_days(day, y, m, d);
+        char s[11] = {char('0' + y / 1000), char('0' + y / 100 % 10), char('0' + y / 10 % 10), char('0' + y % 10), '-',
+                      char('0' + m / 10),   char('0' + m % 10),       '-',                      char('0' + d / 10),
+                      char('0' + d % 10),   0};
+        buf_.append(s, 10);
+        return *this;
+    }
+    // a value with one decimal, like SMHI writes them ("-7.2", "0.0")
+    Output& value1(double v) {
+        long tenths = std::lround(v * 10.0);
+        if (tenths < 0) {
+            buf_.push_back('-');
+            tenths = -tenths;
+        }
+        buf_.append(std::to_string(tenths / 10)).push_back('.');
+        buf_.push_back(char('0' + tenths % 10));
+        return *this;
+    }
+    Output& end_line() {
+        buf_.push_back('\n');
+        return flush_if_full();
+    }
+    bool close() {
+        std::fwrite(buf_.data(), 1, buf_.size(), f_);
+        const bool ok = !std::ferror(f_);
+        return std::fclose(f_) == 0 && ok;
+    }
+
+private:
+    static constexpr size_t kBlock = 1 << 22;
+    Output& flush_if_full() {
+        if (buf_.size() >= kBlock) {
+            std::fwrite(buf_.data(), 1, buf_.size(), f_);
+            buf_.clear();
+        }
+        return *this;
+    }
+    FILE* f_ = nullptr;
+    std::string buf_;
+};
+
+struct Options {
+    double scale = 1.0;
+    int stations = -1; // -1 = default of the format
+    double missing = 0.01;
+    int readings = 4;
+    uint64_t seed = 1;
+};
+
+// day ordinal of the i-th generated day: forward from start, wrapping from 9999-12-31 to 0001-01-01
+int32_t generated_day(int32_t start, int64_t i) {
+    static const int32_t first = smhi::days_from_civil(1, 1, 1);
+    static const int32_t last = smhi::days_from_civil(9999, 12, 31);
+    const int64_t span = int64_t(last) - first + 1;
+    return int32_t(first + (int64_t(start) - first + i) % span);
+}
+
+// mean temperature for a day of the year: cold in January, warm in July
+double seasonal(int day_of_year, double base) {
+    return base + 10.0 * std::sin((day_of_year - 110) / 365.25 * 2.0 * M_PI);
+}
+
+bool write_stations(const std::string& dir, const Options& opt) {
+    const char* known[] = {"Falun", "Falsterbo", "Uppsala"};
+    const int32_t start = smhi::days_from_civil(1961, 1, 1);
+    const int64_t real_days = smhi::days_from_civil(2023, 9, 30) - start + 1;
+    const int64_t rows = int64_t(std::llround(opt.scale * double(real_days) * 4));
+    const int n_stations = opt.stations < 0 ? 3 : opt.stations;
+
+    for (int s = 0; s < n_stations; ++s) {
+        const std::string name = s < 3 ? known[s] : "Station" + std::to_string(s + 1);
+        const std::string path = dir + "/" + name + ".csv";
+        Output out;
+        if (!out.open(path)) {
+            std::cerr << "Can't create " << path << "\n";
+            return false;
+        }
+        Random rng(opt.seed * 1000 + s);
+        const double base = 8.0 - 2.0 * s / std::max(1, n_stations - 1); // a bit colder for every station
+
+        out.text("Stationsnamn;Klimatnummer;Mätstationens höjd (meter över havet)").end_line();
+        out.text(name).text(";").text(std::to_string(100000 + s)).text(";100.0").end_line();
+        out.end_line();
+        out.text("Datum;Tid (UTC);Lufttemperatur;Kvalitet;;Tidsutsnitt:").end_line();
+
+        for (int64_t r = 0; r < rows; ++r) {
+            const int32_t day = generated_day(start, r / opt.readings);
+            const int hour = int(r % opt.readings) * (24 / opt.readings);
+            out.date(day).ch(';');
+            out.ch(char('0' + hour / 10)).ch(char('0' + hour % 10)).text(":00:00;");
+            if (rng.uniform() >= opt.missing)
+                out.value1(seasonal(smhi::day_of_year(day), base) + 4.0 * rng.noise());
+            out.text(";G;;").end_line();
+        }
+        if (!out.close()) {
+            std::cerr << "Can't write " << path << "\n";
+            return false;
+        }
+        std::cout << path << ": " << rows << " rows\n";
+    }
+    return true;
+}
+
+bool write_pthbv(const std::string& path, const Options& opt) {
+    const int32_t start = smhi::days_from_civil(1961, 1, 1);
+    const int64_t real_days = smhi::days_from_civil(2025, 10, 28) - start + 1;
+    const int64_t rows = int64_t(std::llround(opt.scale * double(real_days)));
+    const int points = opt.stations < 0 ? 2 : opt.stations;
+
+    Output out;
+    if (!out.open(path)) {
+        std::cerr << "Can't create " << path << "\n";
+        return false;
+    }
+    Random rng(opt.seed);
+
+    // the first two grid points are Lund and Uppsala like in the real file, the rest a grid over Sweden
+    std::vector<std::string> coords;
+    for (int p = 0; p < points; ++p) {
+        char c[32];
+        if (p == 0) std::snprintf(c, sizeof c, "55.705, 13.191");
+        else if (p == 1) std::snprintf(c, sizeof c, "59.859, 17.639");
+        else std::snprintf(c, sizeof c, "%.3f, %.3f", 55.3 + 0.05 * ((p - 2) / 200 % 280), 11.1 + 0.06 * ((p - 2) % 200));
+        coords.push_back(c);
+    }
+    out.text("\xEF\xBB\xBFN, E (WGS 84)");
+    for (const auto& c : coords)
+        out.ch(';').text(c).ch(';').text(c);
+    out.end_line();
+    for (int p = 0; p < points; ++p)
+        out.text(";nederbörd [mm];temperatur [°C]");
+    out.end_line();
+
+    for (int64_t r = 0; r < rows; ++r) {
+        const int32_t day = generated_day(start, r);
+        const int doy = smhi::day_of_year(day);
+        out.date(day);
+        for (int p = 0; p < points; ++p) {
+            out.ch(';');
+            if (rng.uniform() >= opt.missing) // rain on about half of the days
+                out.value1(rng.uniform() < 0.5 ? 0.0 : -3.0 * std::log(1.0 - rng.uniform()));
+            out.ch(';');
+            if (rng.uniform() >= opt.missing)
+                out.value1(seasonal(doy, 7.0 - 0.02 * p) + 3.0 * rng.noise());
+        }
+        out.end_line();
+    }
+    if (!out.close()) {
+        std::cerr << "Can't write " << path << "\n";
+        return false;
+    }
+    std::cout << path << ": " << rows << " rows, " << points << " grid points\n";
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " station <output_dir> [--scale S] [--stations N] [--missing P] [--readings R] [--seed X]\n"
+                  << "       " << argv[0] << " pthbv <output_csv> [--scale S] [--stations N] [--missing P] [--seed X]\n";
+        return 1;
+    }
+    const std::string format = argv[1];
+    const std::string target = argv[2];
+    Options opt;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (arg == "--scale") opt.scale = std::stod(argv[i + 1]);
+        else if (arg == "--stations") opt.stations = std::stoi(argv[i + 1]);
+        else if (arg == "--missing") opt.missing = std::stod(argv[i + 1]);
+        else if (arg == "--readings") opt.readings = std::stoi(argv[i + 1]);
+        else if (arg == "--seed") opt.seed = std::stoull(argv[i + 1]);
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+    if (opt.scale <= 0 || opt.missing < 0 || opt.missing > 1 || opt.readings < 1 || 24 % opt.readings != 0) {
+        std::cerr << "--scale must be positive, --missing between 0 and 1 and --readings divide 24\n";
+        return 1;
+    }
+
+    if (format == "station")
+        return write_stations(target, opt) ? 0 : 1;
+    if (format == "pthbv")
+        return write_pthbv(target, opt) ? 0 : 1;
+    std::cerr << "Unknown format " << format << ", use station or pthbv\n";
+    return 1;
+}
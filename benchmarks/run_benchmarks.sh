@@ -0,0 +1,59 @@
+#!/bin/bash
+set -e
+: '
+  Generates synthetic SMHI files and times every tool on them.
+
+  Usage: benchmarks/run_benchmarks.sh [scale] [grid points] [missing rate] [repeat]
+    scale        1 = the size of the real files, 1000 = a thousand times more rows (default 1)
+    grid points  columns pairs of the pthbv file, the real one has 2 (default 2)
+    missing rate fraction of empty values (default 0.01)
+    repeat       runs per tool, the fastest is reported (default 3)
+
+  Everything happens in benchmarks/work_<scale>/, which is laid out like the repository
+  so that the tools find their files at the usual relative paths. The table is printed
+  and saved to benchmarks/work_<scale>/bench_results.csv.
+  Set STATIONS to generate more station files than Falun, Falsterbo and Uppsala, and READINGS=24
+  for hourly station files (4 readings a day by default).
+'
+SCALE=${1:-1}
+POINTS=${2:-2}
+MISSING=${3:-0.01}
+REPEAT=${4:-3}
+STATIONS=${STATIONS:-3}
+READINGS=${READINGS:-4}
+
+BENCH_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+REPO="$BENCH_DIR/.."
+WORK="$BENCH_DIR/work_$SCALE"
+mkdir -p "$WORK/datasets" "$WORK/rain_analysis/data_clean" "$WORK/rain_analysis/analysis" "$WORK/rain_analysis/results"
+
+echo "==> Compiling the tools and the benchmark programs..."
+CXX="g++ -std=c++17 -O2 -pthread"
+$CXX "$REPO/cleaning_data.cxx" -o "$WORK/cleaning_data"
+$CXX "$REPO/FalunVSFalsterbo.cxx" -o "$WORK/FalunVSFalsterbo"
+$CXX "$REPO/warmest_coldest.cxx" -o "$WORK/warmest_coldest"
+$CXX "$REPO/temperature_given_day.cxx" -o "$WORK/temperature_given_day"
+$CXX "$REPO/rain_analysis/data_clean/Rain_data_clean.cxx" -o "$WORK/rain_analysis/data_clean/Rain_data_clean"
+$CXX "$REPO/rain_analysis/analysis/analysis.cxx" -o "$WORK/rain_analysis/analysis/analysis"
+$CXX "$BENCH_DIR/generate_smhi.cxx" -o "$WORK/generate_smhi"
+$CXX "$BENCH_DIR/bench_tools.cxx" -o "$WORK/bench_tools"
+
+echo "==> Generating data (scale $SCALE)..."
+"$WORK/generate_smhi" station "$WORK/datasets" --scale "$SCALE" --stations "$STATIONS" --missing "$MISSING" \
+    --readings "$READINGS"
+"$WORK/generate_smhi" pthbv "$WORK/datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv" \
+    --scale "$SCALE" --stations "$POINTS" --missing "$MISSING"
+
+: '
+  The benchmark manifest keeps every row of every station (no date filter, all times),
+  so the cleaned files grow with the scale as well.
+'
+: > "$WORK/bench_stations.txt"
+for f in "$WORK"/datasets/*.csv; do
+    name=$(basename "$f")
+    case "$name" in SMHI_pthbv*) continue ;; esac
+    echo "datasets/$name;$name;;;all" >> "$WORK/bench_stations.txt"
+done
+
+echo "==> Running the benchmarks..."
+"$WORK/bench_tools" "$WORK" --repeat "$REPEAT"
@@ -0,0 +1,194 @@
+// Fits a von Mises distribution (see common/von_mises.h) to the warmest and coldest days of
+// the year written by warmest_coldest.cxx, with bootstrap confidence intervals.
+//
+// Build: g++ -O2 -pthread circular_fit.cxx -o circular_fit
+// Usage: ./circular_fit [--bootstrap N] [--threads N] [--seed S] [results.csv ...]
+//        (default: Uppsala_warmest_results.csv, 2000 resamples, one thread per core)
+//
+// The days are treated as angles on a circle, so the coldest day is fitted directly even
+// though it falls on both sides of New Year; no shifting by 366 and refitting is needed.
+// For each column of the file (warmest_day, coldest_day) it prints and saves to
+// <station>_circular_fit.csv the mean day, the concentration kappa, the circular standard
+// deviation in days and 95% bootstrap intervals for the mean day and kappa.
+//
+// Bootstrap: the years are drawn with replacement N times and the fit is repeated each time.
+// The resamples are split into blocks of 64 and every block has its own random generator,
+// seeded from --seed and the block number, so the result is the same for any number of threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "common/parallel.h"
+#include "common/von_mises.h"
+
+// one column of the results file, e.g. all warmest days
+struct Series {
+    std::string name;
+    std::vector<double> cos_theta, sin_theta; // the days as angles, ready for the sums
+};
+
+struct FitResult {
+    smhi::VonMisesFit fit;
+    double mean_lo = 0, mean_hi = 0;   // 95% interval of the mean direction (radians)
+    double kappa_lo = 0, kappa_hi = 0; // 95% interval of kappa
+    double milliseconds = 0;
+};
+
+// one turn of the circle, both for turning days into angles and angles back into days: the
+// same day of a leap and a common year are a quarter of a day apart at most
+const double kYearLength = 365.25;
+
+// reads "year,day,day,..." with a header line; every day column becomes one series
+bool read_results(const std::string& path, std::vector<Series>& series) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "Can't open " << path << "\n";
+        return false;
+    }
+    std::string line, item;
+    if (!std::getline(in, line))
+        return false;
+    std::stringstream header(line);
+    std::getline(header, item, ','); // "year"
+    while (std::getline(header, item, ','))
+        series.push_back({item, {}, {}});
+
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        if (!std::getline(ss, item, ',')) // the year
+            continue;
+        for (auto& s : series) {
+            if (!std::getline(ss, item, ',') || item.empty())
+                continue;
+            const double angle = smhi::day_to_angle(std::atof(item.c_str()), kYearLength);
+            s.cos_theta.push_back(std::cos(angle));
+            s.sin_theta.push_back(std::sin(angle));
+        }
+    }
+    return true;
+}
+
+// value at fraction q of sorted data (linear interpolation between neighbours)
+double quantile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty())
+        return NAN;
+    const double pos = q * double(sorted.size() - 1);
+    const size_t i = size_t(pos);
+    const double frac = pos - double(i);
+    return i + 1 < sorted.size() ? sorted[i] * (1 - frac) + sorted[i + 1] * frac : sorted[i];
+}
+
+FitResult fit_series(const Series& s, size_t n_boot, unsigned threads, uint64_t seed) {
+    const auto start = std::chrono::steady_clock::now();
+    FitResult result;
+    const size_t n = s.cos_theta.size();
+    double c, sn;
+    smhi::circular_sums(s.cos_theta.data(), s.sin_theta.data(), n, c, sn);
+    result.fit = smhi::fit_von_mises_sums(c, sn, n);
+
+    if (n > 1 && n_boot > 0) {
+        std::vector<double> mean_shift(n_boot), kappa(n_boot);
+        const size_t block = 64;
+        const size_t n_blocks = (n_boot + block - 1) / block;
+        smhi::parallel_for(n_blocks, threads, [&](size_t b, unsigned) {
+            std::mt19937_64 rng(seed * 0x9E3779B97F4A7C15ULL + b);
+            std::vector<double> pick_cos(n), pick_sin(n);
+            for (size_t r = b * block; r < std::min(n_boot, (b + 1) * block); ++r) {
+                for (size_t i = 0; i < n; ++i) {
+                    // a random index in [0, n) without the bias of rng() % n
+                    const size_t k = size_t((uint64_t(uint32_t(rng())) * n) >> 32);
+                    pick_cos[i] = s.cos_theta[k];
+                    pick_sin[i] = s.sin_theta[k];
+                }
+                double bc, bs;
+                smhi::circular_sums(pick_cos.data(), pick_sin.data(), n, bc, bs);
+                const smhi::VonMisesFit f = smhi::fit_von_mises_sums(bc, bs, n);
+                mean_shift[r] = smhi::wrap_angle(f.mu - result.fit.mu);
+                kappa[r] = f.kappa;
+            }
+        });
+        // the interval of the mean direction is taken on the differences to the fitted mean,
+        // so it works across New Year as well
+        std::sort(mean_shift.begin(), mean_shift.end());
+        std::sort(kappa.begin(), kappa.end());
+        result.mean_lo = result.fit.mu + quantile(mean_shift, 0.025);
+        result.mean_hi = result.fit.mu + quantile(mean_shift, 0.975);
+        result.kappa_lo = quantile(kappa, 0.025);
+        result.kappa_hi = quantile(kappa, 0.975);
+    }
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// "data/Uppsala_warmest_results.csv" -> "data/Uppsala_circular_fit.csv"
+std::string output_name(const std::string& input) {
+    std::string stem = input.substr(0, input.rfind('.'));
+    const std::string suffix = "_warmest_results";
+    if (stem.size() > suffix.size() && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0)
+        stem.erase(stem.size() - suffix.size());
+    return stem + "_circular_fit.csv";
+}
+
+int main(int argc, char** argv) {
+    size_t n_boot = 2000;
+    unsigned threads = 0;
+    uint64_t seed = 1;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--bootstrap" && has_value) n_boot = std::stoul(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else if (arg == "--seed" && has_value) seed = std::stoull(argv[++i]);
+        else if (arg[0] != '-') files.push_back(arg);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--bootstrap N] [--threads N] [--seed S] [results.csv ...]\n";
+            return 1;
+        }
+    }
+    if (files.empty())
+        files.push_back("Uppsala_warmest_results.csv");
+
+    for (const auto& file : files) {
+        std::vector<Series> series;
+        if (!read_results(file, series))
+            return 1;
+
+        const std::string out_name = output_name(file);
+        std::ofstream out(out_name);
+        if (!out.is_open()) {
+            std::cerr << "Can't create " << out_name << "\n";
+            return 1;
+        }
+        out << "series,n,mean_day,mean_day_lo,mean_day_hi,kappa,kappa_lo,kappa_hi,circular_sd_days,log_likelihood\n";
+
+        std::cout << file << " (" << n_boot << " bootstrap resamples)\n";
+        for (const auto& s : series) {
+            const FitResult r = fit_series(s, n_boot, threads, seed);
+            const smhi::VonMisesFit& f = r.fit;
+            // circular standard deviation sqrt(-2 ln R), turned into days
+            const double sd_days = f.resultant > 0 ? std::sqrt(-2 * std::log(f.resultant)) * kYearLength / smhi::kTwoPi : NAN;
+            const double mean_day = smhi::angle_to_day(f.mu, kYearLength);
+            const double lo_day = smhi::angle_to_day(r.mean_lo, kYearLength);
+            const double hi_day = smhi::angle_to_day(r.mean_hi, kYearLength);
+
+            char line[256];
+            std::snprintf(line, sizeof line, "%s,%zu,%.2f,%.2f,%.2f,%.4f,%.4f,%.4f,%.2f,%.3f", s.name.c_str(), f.n,
+                          mean_day, lo_day, hi_day, f.kappa, r.kappa_lo, r.kappa_hi, sd_days, f.log_likelihood);
+            out << line << "\n";
+            std::printf("  %-12s n=%zu  mean day %.1f [%.1f, %.1f]  kappa %.2f [%.2f, %.2f]  sd %.1f days  (%.2f ms)\n",
+                        s.name.c_str(), f.n, mean_day, lo_day, hi_day, f.kappa, r.kappa_lo, r.kappa_hi, sd_days,
+                        r.milliseconds);
+        }
+        std::cout << "Saved " << out_name << "\n";
+    }
+    return 0;
+}
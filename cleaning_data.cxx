@@ -0,0 +1,404 @@
+// Cleans any number of SMHI station files in one run, one worker thread per file.
+//
+// Build: g++ -O2 -pthread cleaning_data.cxx -o cleaning_data
+// Usage: ./cleaning_data [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH:MM:SS,...|all] [--threads N]
+//                        [--daily] [--min-readings N] [--metrics report.json] <manifest>
+//
+// The manifest lists one station per line, separated by ';' like the SMHI files:
+//     input_csv;output_csv[;from;to;times]
+// from, to and times are optional and override the command line values for that station.
+// Empty lines and lines starting with '#' are ignored. See stations.txt for an example.
+//
+// Every kept row is written as "date;time;temperature" to output_csv, and the same rows
+// are written to the binary copy next to it (Falun.csv -> Falun.bin). Falun.idx gets the
+// position of every month in both files, see common/date_index.h.
+//
+// --daily also reduces every reading of the station in the date range, whatever its time, to
+// the daily mean, min and max (common/daily_aggregate.h), in the same pass and with the memory
+// of one day. They go to Falun_daily.csv as "date;;mean;min;max;readings" (the time is empty, so
+// the mean is where the temperature is in the other files), to Falun_daily.bin with the columns
+// mean, min, max and readings, and to Falun_daily.idx. A day needs --min-readings readings
+// (default 1) for a mean, min and max.
+// --metrics (or $SMHI_METRICS) writes the rows, bytes and times of the run as JSON, see common/run_metrics.h.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "common/daily_aggregate.h"
+#include "common/date_index.h"
+#include "common/mapped_file.h"
+#include "common/output_file.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_store.h"
+
+// which rows of a station file are kept
+struct Filter {
+    std::string from = "0000-00-00";            // first date kept
+    std::string to = "9999-12-31";              // last date kept
+    std::vector<std::string> times = {"06:00:00", "18:00:00"};
+    bool all_times = false;                     // keep every time of day
+};
+
+struct Station {
+    std::string input;
+    std::string output;
+    Filter filter;
+};
+
+struct Result {
+    size_t rows_read = 0;
+    size_t rows_kept = 0;
+    size_t bad_temperatures = 0;   // kept rows whose temperature is not a number (stored as missing)
+    size_t bad_dates = 0;          // rows in the date range whose date is not a real date, left out
+    size_t daily_days = 0;         // days written to the daily files (--daily)
+    size_t daily_out_of_order = 0; // readings of a day that was already written, left out of the daily files
+    std::string error; // empty if the station was cleaned
+};
+
+// splits "a;b;c" into its fields
+std::vector<std::string> split_fields(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (true) {
+        size_t end = s.find(sep, start);
+        out.push_back(s.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos)
+            return out;
+        start = end + 1;
+    }
+}
+
+// "06:00:00,18:00:00" or "all"
+void set_times(Filter& filter, const std::string& list) {
+    filter.all_times = (list == "all");
+    filter.times = filter.all_times ? std::vector<std::string>{} : split_fields(list, ',');
+}
+
+bool read_manifest(const std::string& path, const Filter& defaults, std::vector<Station>& stations) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Can't open manifest " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(file, line)) {
+        line_no++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::vector<std::string> fields = split_fields(line, ';');
+        if (fields.size() < 2 || fields[0].empty() || fields[1].empty()) {
+            std::cerr << path << ":" << line_no << ": expected input_csv;output_csv[;from;to;times]\n";
+            return false;
+        }
+
+        Station st;
+        st.input = fields[0];
+        st.output = fields[1];
+        st.filter = defaults;
+        if (fields.size() > 2 && !fields[2].empty()) st.filter.from = fields[2];
+        if (fields.size() > 3 && !fields[3].empty()) st.filter.to = fields[3];
+        if (fields.size() > 4 && !fields[4].empty()) set_times(st.filter, fields[4]);
+        stations.push_back(st);
+    }
+    return true;
+}
+
+// returns the text up to the next ';' (or the end of the line) and moves p past it
+std::string_view next_field(const char*& p, const char* end) {
+    const char* start = p;
+    while (p < end && *p != ';')
+        ++p;
+    std::string_view field(start, p - start);
+    if (p < end)
+        ++p; // skip the ';'
+    return field;
+}
+
+bool keep_time(const Filter& filter, std::string_view time) {
+    if (filter.all_times)
+        return true;
+    for (const auto& t : filter.times)
+        if (time == t)
+            return true;
+    return false;
+}
+
+// The daily values of one station: Falun_daily.csv, Falun_daily.bin and Falun_daily.idx, in the
+// layout described in common/daily_aggregate.h
+class DailyOutput {
+public:
+    DailyOutput() : store_(smhi::kDailyColumns) {
+        store_.note_decimals(0, 2); // the means are written with two decimals
+        store_.note_decimals(3, 0);
+    }
+
+    bool open(const std::string& path) { return csv_.open(path); }
+
+    void add(const smhi::DailyValue& v) {
+        int y, m, d;
+        smhi::civil_from_days(v.day, y, m, d);
+        index_.add(y, m, csv_.written(), store_.rows());
+        const char date[11] = {char('0' + y / 1000 % 10), char('0' + y / 100 % 10), char('0' + y / 10 % 10),
+                               char('0' + y % 10), '-', char('0' + m / 10), char('0' + m % 10), '-',
+                               char('0' + d / 10), char('0' + d % 10), ';'};
+        csv_.append(std::string_view(date, sizeof date));
+        csv_.put(';'); // no time: the row is the whole day, and the field after it the day's mean
+        csv_.number(v.mean, smhi::NumberFormat::kFixed, 2);
+        csv_.put(';');
+        csv_.number(v.min, smhi::NumberFormat::kFixed, decimals_);
+        csv_.put(';');
+        csv_.number(v.max, smhi::NumberFormat::kFixed, decimals_);
+        csv_.put(';');
+        csv_.integer(v.readings);
+        csv_.put('\n');
+        const double values[4] = {v.mean, v.min, v.max, double(v.readings)};
+        store_.add_row(v.day, smhi::kNoTime, values);
+    }
+
+    // decimals of the readings, so min and max look like them ("4.0", not "4")
+    void note_decimals(int decimals) {
+        decimals_ = decimals > decimals_ ? decimals : decimals_;
+        store_.note_decimals(1, decimals);
+        store_.note_decimals(2, decimals);
+    }
+
+    // Writes the three files, returns an error message or "".
+    std::string save(const std::string& path) {
+        const uint64_t size = csv_.written();
+        if (!csv_.close())
+            return "can't write " + path;
+        if (!store_.save(smhi::store_path_for(path)))
+            return "can't write " + smhi::store_path_for(path);
+        if (!index_.save(smhi::index_path_for(path), path, store_.rows(), size))
+            return "can't write " + smhi::index_path_for(path);
+        return "";
+    }
+
+    size_t rows() const { return store_.rows(); }
+
+private:
+    smhi::OutputFile csv_;
+    smhi::StationStoreWriter store_;
+    smhi::DateIndexWriter index_;
+    int decimals_ = 0;
+};
+
+// Cleans one station file. The input is memory mapped and the output goes through an OutputFile
+// (common/output_file.h), which writes it in big blocks instead of flushing after every row.
+void clean_station(const Station& st, bool daily, uint32_t min_readings, Result& result) {
+    smhi::MappedFile in;
+    if (!in.open(st.input)) {
+        result.error = "can't open input file " + st.input;
+        return;
+    }
+    smhi::OutputFile out;
+    if (!out.open(st.output)) {
+        result.error = "can't create " + st.output;
+        return;
+    }
+
+    // the kept rows for the binary copy; the temperatures stay text (pointing into the mapped
+    // file) until the end, where the whole column is converted in one call
+    std::vector<int32_t> days;
+    std::vector<uint8_t> times;
+    std::vector<std::string_view> temperatures;
+    smhi::DateIndexWriter index;
+
+    // --daily: every reading in the date range, as it streams past
+    const std::string daily_path = smhi::daily_path_for(st.output);
+    DailyOutput daily_out;
+    smhi::DailyAggregator aggregator(min_readings);
+    auto write_day = [&](const smhi::DailyValue& v) { daily_out.add(v); };
+    if (daily && !daily_out.open(daily_path)) {
+        result.error = "can't create " + daily_path;
+        return;
+    }
+
+    const Filter& filter = st.filter;
+    const char* p = in.data();
+    const char* file_end = p + in.size();
+    while (p < file_end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', file_end - p));
+        const char* line_end = newline ? newline : file_end;
+        const char* next_line = newline ? newline + 1 : file_end;
+        if (line_end > p && line_end[-1] == '\r')
+            --line_end;
+        result.rows_read++;
+
+        std::string_view date = next_field(p, line_end);
+        std::string_view time = next_field(p, line_end);
+        std::string_view temperature = next_field(p, line_end);
+        p = next_line;
+
+        if (date < filter.from || date > filter.to)
+            continue;
+        // a row without a real date goes to none of the files, so the CSV and the binary copy
+        // have the same rows and the index can check one against the other
+        int y, m, d;
+        if (date.size() < 10 || !smhi::parse_ymd(date.data(), y, m, d)) {
+            result.bad_dates++;
+            continue;
+        }
+        const int32_t day = smhi::days_from_civil(y, m, d);
+        if (daily) {
+            double value;
+            int decimals = 0;
+            if (!smhi::parse_decimal(temperature, value, &decimals))
+                value = NAN;
+            else
+                daily_out.note_decimals(decimals);
+            aggregator.add(day, value, write_day);
+        }
+        if (!keep_time(filter, time))
+            continue;
+
+        const uint64_t line_offset = out.written();
+        out.append(date);
+        out.put(';');
+        out.append(time);
+        out.put(';');
+        out.append(temperature);
+        out.put('\n');
+
+        index.add(y, m, line_offset, days.size());
+        days.push_back(day);
+        times.push_back(smhi::time_code_from_text(std::string(time)));
+        temperatures.push_back(temperature);
+        result.rows_kept++;
+    }
+
+    const uint64_t output_size = out.written();
+    if (!out.close()) {
+        result.error = "can't write " + st.output;
+        return;
+    }
+    if (daily) {
+        aggregator.finish(write_day);
+        result.daily_days = daily_out.rows();
+        result.daily_out_of_order = aggregator.out_of_order();
+        const std::string error = daily_out.save(daily_path);
+        if (!error.empty()) {
+            result.error = error;
+            return;
+        }
+    }
+
+    std::vector<double> values(temperatures.size());
+    std::vector<uint64_t> bad((temperatures.size() + 63) / 64);
+    int decimals = 0;
+    result.bad_temperatures =
+        smhi::parse_decimal_column(temperatures.data(), temperatures.size(), values.data(), bad.data(), &decimals);
+
+    smhi::StationStoreWriter binary({"temperature"});
+    binary.note_decimals(0, decimals);
+    for (size_t i = 0; i < values.size(); ++i)
+        binary.add_row(days[i], times[i], &values[i]);
+
+    const std::string bin_path = smhi::store_path_for(st.output);
+    if (!binary.save(bin_path)) {
+        result.error = "can't write " + bin_path;
+        return;
+    }
+
+    const std::string index_path = smhi::index_path_for(st.output);
+    if (!index.save(index_path, st.output, binary.rows(), output_size))
+        result.error = "can't write " + index_path;
+}
+
+int main(int argc, char** argv) {
+    Filter defaults;
+    unsigned threads = 0;
+    bool daily = false;
+    uint32_t min_readings = 1;
+    std::string manifest;
+    smhi::RunMetrics metrics("cleaning_data");
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--from" && has_value) defaults.from = argv[++i];
+        else if (arg == "--to" && has_value) defaults.to = argv[++i];
+        else if (arg == "--times" && has_value) set_times(defaults, argv[++i]);
+        else if (arg == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else if (arg == "--daily") daily = true;
+        else if (arg == "--min-readings" && has_value) min_readings = uint32_t(std::stoul(argv[++i]));
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (manifest.empty() && arg[0] != '-') manifest = arg;
+        else {
+            manifest.clear();
+            break;
+        }
+    }
+    if (manifest.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH:MM:SS,...|all] [--threads N]"
+                     " [--daily] [--min-readings N] [--metrics report.json] <manifest>\n";
+        return 1;
+    }
+
+    std::vector<Station> stations;
+    if (!read_manifest(manifest, defaults, stations))
+        return 1;
+
+    // one worker per file; with more files than cores the workers take the next file when done
+    std::vector<Result> results(stations.size());
+    auto phase = metrics.phase("clean");
+    smhi::parallel_for(stations.size(), threads, [&](size_t i, unsigned) {
+        clean_station(stations[i], daily, min_readings, results[i]);
+    });
+    phase.stop();
+
+    int failed = 0;
+    for (size_t i = 0; i < stations.size(); ++i) {
+        metrics.count("stations");
+        metrics.count_file("bytes_in", stations[i].input);
+        if (!results[i].error.empty()) {
+            std::cerr << stations[i].input << ": " << results[i].error << "\n";
+            metrics.failure("station_failed");
+            failed++;
+            continue;
+        }
+        metrics.count("rows_read", results[i].rows_read);
+        metrics.count("rows_kept", results[i].rows_kept);
+        metrics.count("rows_filtered", results[i].rows_read - results[i].rows_kept);
+        metrics.failure("bad_temperature", results[i].bad_temperatures);
+        metrics.failure("bad_date", results[i].bad_dates);
+        for (const std::string& path : {stations[i].output, smhi::store_path_for(stations[i].output),
+                                        smhi::index_path_for(stations[i].output)})
+            metrics.count_file("bytes_out", path);
+        if (daily) {
+            const std::string daily_path = smhi::daily_path_for(stations[i].output);
+            for (const std::string& path : {daily_path, smhi::store_path_for(daily_path), smhi::index_path_for(daily_path)})
+                metrics.count_file("bytes_out", path);
+            metrics.count("days_written", results[i].daily_days);
+            metrics.failure("daily_out_of_order", results[i].daily_out_of_order);
+        }
+        std::cout << "Filtered data has been saved to '" << stations[i].output << "' and '"
+                  << smhi::store_path_for(stations[i].output) << "' (" << results[i].rows_kept << " of "
+                  << results[i].rows_read << " rows kept";
+        if (results[i].bad_temperatures)
+            std::cout << ", " << results[i].bad_temperatures << " without a readable temperature";
+        if (results[i].bad_dates)
+            std::cout << ", " << results[i].bad_dates << " without a real date left out";
+        std::cout << ")\n";
+        if (daily) {
+            std::cout << "Daily mean, min and max of " << results[i].daily_days << " days saved to '"
+                      << smhi::daily_path_for(stations[i].output) << "'";
+            if (results[i].daily_out_of_order)
+                std::cout << " (" << results[i].daily_out_of_order << " readings out of date order left out)";
+            std::cout << "\n";
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
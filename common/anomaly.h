@@ -0,0 +1,117 @@
+#pragma once
+// Day-of-year baseline and daily anomalies of a station series (see station_series.h).
+//
+// The baseline of one observation hour is the mean of every day of the year over a reference
+// period (e.g. 1991-2020), smoothed with a circular running mean so that one warm or cold
+// year does not show up as a bump in the baseline. Days are numbered like the climatology
+// cube (02-29 is a day of its own, see doy_cube.h); the running mean adds up sums and counts
+// of the neighbouring days, so 02-29 with a quarter of the values is weighted fairly.
+//
+// The anomaly of a day is its value minus the baseline of its day of the year. A year is two
+// runs of days whose slots are consecutive in the baseline (Jan 1 - Feb 28 and Mar 1 - Dec 31,
+// or the whole year in a leap year), so the anomalies are computed in plain loops over
+// contiguous arrays that the compiler turns into packed instructions. Days without a value
+// come out as NaN.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "doy_cube.h"
+#include "station_series.h"
+
+namespace smhi {
+
+struct DoyBaseline {
+    double value[kCubeDays]; // NaN where no day of the reference period is near
+    uint32_t count[kCubeDays]; // values of the reference period on that day (before smoothing)
+};
+
+// Baseline of one hour (slot) of the series over the days from..to, smoothed over
+// window days (odd, e.g. 31; 1 = no smoothing).
+inline DoyBaseline doy_baseline(const StationSeries& series, int slot, int32_t from, int32_t to, int window) {
+    double sum[kCubeDays] = {};
+    DoyBaseline b;
+    for (int s = 0; s < kCubeDays; ++s)
+        b.count[s] = 0;
+    if (!series.empty()) {
+        from = from < series.first_day() ? series.first_day() : from;
+        to = to > series.last_day() ? series.last_day() : to;
+        const int16_t* v = series.raw(slot);
+        for (int32_t day = from; day <= to; ++day) {
+            if (!series.has(slot, day))
+                continue;
+            int y, m, d;
+            civil_from_days(day, y, m, d);
+            const int s = cube_slot(m, d);
+            sum[s] += v[day - series.first_day()];
+            b.count[s]++;
+        }
+    }
+
+    const int half = window / 2;
+    for (int s = 0; s < kCubeDays; ++s) {
+        double total = 0;
+        uint64_t n = 0;
+        for (int k = -half; k <= half; ++k) {
+            const int t = (s + k + kCubeDays) % kCubeDays;
+            total += sum[t];
+            n += b.count[t];
+        }
+        b.value[s] = n ? total / double(n) / series.scale() : NAN;
+    }
+    return b;
+}
+
+// out[i] = value of day first_day() + i minus its baseline, NaN where there is no value.
+// out must have room for series.days() values.
+inline void doy_anomalies(const StationSeries& series, int slot, const DoyBaseline& baseline, float* out) {
+    if (series.empty())
+        return;
+    const int16_t* v = series.raw(slot);
+    const uint64_t* bits = series.valid_bits(slot);
+    const float inv_scale = float(1 / series.scale());
+    float base[kCubeDays];
+    for (int s = 0; s < kCubeDays; ++s)
+        base[s] = float(baseline.value[s]);
+
+    // one run of days with consecutive baseline slots: packed multiply and subtract
+    auto run = [&](size_t i, int s, size_t n) {
+        const int16_t* __restrict src = v + i;
+        const float* __restrict b = base + s;
+        float* __restrict dst = out + i;
+        for (size_t k = 0; k < n; ++k)
+            dst[k] = float(src[k]) * inv_scale - b[k];
+    };
+
+    int y, m, d;
+    civil_from_days(series.first_day(), y, m, d);
+    const size_t days = series.days();
+    size_t i = 0;
+    int s = cube_slot(m, d);
+    while (i < days) {
+        // to the end of February (slot 58, or 59 in a leap year), then to the end of the year
+        const int end = s <= 59 ? (is_leap(y) ? 60 : 59) : kCubeDays;
+        const size_t n = std::min(days - i, size_t(end - s));
+        run(i, s, n);
+        i += n;
+        s += int(n);
+        if (s == 59) // March 1st of a year that is not a leap year
+            s = 60;
+        else if (s == kCubeDays) {
+            s = 0;
+            y++;
+        }
+    }
+
+    // days without a value; whole words of present days are skipped at once
+    for (size_t w = 0; w * 64 < days; ++w) {
+        uint64_t missing = ~bits[w];
+        if (w * 64 + 64 > days)
+            missing &= (uint64_t(1) << (days - w * 64)) - 1;
+        for (; missing != 0; missing &= missing - 1)
+            out[w * 64 + size_t(__builtin_ctzll(missing))] = NAN;
+    }
+}
+
+} // namespace smhi
@@ -0,0 +1,388 @@
+#pragma once
+// Writer for Apache Arrow IPC files (the "Feather v2" .arrow format), without the Arrow library.
+//
+// An Arrow file keeps every column as one contiguous, 8-byte aligned array per batch of rows,
+// so pyarrow (pyarrow.ipc.open_file / pyarrow.memory_map), pandas, polars, DuckDB and R's arrow
+// package read it by mapping the file into memory, without parsing anything.
+//
+// Layout of the file (see https://arrow.apache.org/docs/format/Columnar.html):
+//     "ARROW1\0\0"
+//     schema message
+//     one record batch message per kBatchRows rows
+//     end-of-stream marker
+//     footer (the schema again and where every batch starts), its size, "ARROW1"
+// The messages describe themselves with FlatBuffers. Only the few tables Arrow needs are built
+// here (FlatBuilder), back to front as the FlatBuffers library does it.
+//
+// Columns are Int8, Int32, Date32 (days since 1970-01-01, like the station files), Float64 and
+// Utf8. A missing value (NaN, or add_null) is a null in the column's validity bitmap.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace smhi {
+
+// Builds one FlatBuffer. Objects are added back to front: children before the tables that
+// point at them. An object is known by its distance from the end of the buffer.
+class FlatBuilder {
+public:
+    uint32_t size() const { return uint32_t(buf_.size()); }
+
+    // zero bytes in front, so that after `extra` more bytes the size is a multiple of n
+    void align(size_t n, size_t extra = 0) {
+        while ((buf_.size() + extra) % n != 0)
+            buf_.insert(buf_.begin(), '\0');
+    }
+
+    template <class T>
+    void prepend(T v) {
+        align(sizeof(T));
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &v, sizeof(T)); // little endian, like Arrow
+        buf_.insert(buf_.begin(), bytes, bytes + sizeof(T));
+    }
+
+    // a uoffset to the object at `target`, pointing from where it is written
+    void prepend_offset(uint32_t target) {
+        align(4);
+        prepend<uint32_t>(size() + 4 - target);
+    }
+
+    uint32_t string(std::string_view s) {
+        align(4, s.size() + 1);
+        buf_.insert(buf_.begin(), '\0');
+        buf_.insert(buf_.begin(), s.begin(), s.end());
+        prepend<uint32_t>(uint32_t(s.size()));
+        return size();
+    }
+
+    // a vector of tables (their positions)
+    uint32_t table_vector(const std::vector<uint32_t>& tables) {
+        align(4, 4 * tables.size());
+        for (size_t i = tables.size(); i-- > 0;)
+            prepend_offset(tables[i]);
+        prepend<uint32_t>(uint32_t(tables.size()));
+        return size();
+    }
+
+    // a vector of structs of struct_size bytes each, 8 byte aligned
+    uint32_t struct_vector(const void* data, size_t count, size_t struct_size) {
+        align(8, count * struct_size);
+        const char* p = static_cast<const char*>(data);
+        buf_.insert(buf_.begin(), p, p + count * struct_size);
+        prepend<uint32_t>(uint32_t(count));
+        return size();
+    }
+
+    void start_table() {
+        table_start_ = size();
+        fields_.clear();
+    }
+    template <class T>
+    void field(int id, T v) {
+        prepend(v);
+        fields_.push_back({id, size()});
+    }
+    void offset_field(int id, uint32_t target) {
+        prepend_offset(target);
+        fields_.push_back({id, size()});
+    }
+    uint32_t end_table() {
+        prepend<int32_t>(0); // to the vtable, filled in below
+        const uint32_t table = size();
+        int n = 0;
+        for (const auto& f : fields_)
+            n = std::max(n, f.id + 1);
+        std::vector<uint16_t> vtable(size_t(n) + 2, 0);
+        vtable[0] = uint16_t(2 * vtable.size());
+        vtable[1] = uint16_t(table - table_start_);
+        for (const auto& f : fields_)
+            vtable[size_t(f.id) + 2] = uint16_t(table - f.at);
+        for (size_t i = vtable.size(); i-- > 0;)
+            prepend<uint16_t>(vtable[i]);
+        const int32_t to_vtable = int32_t(size() - table); // the vtable is in front of the table
+        std::memcpy(&buf_[buf_.size() - table], &to_vtable, 4);
+        return table;
+    }
+
+    // The finished buffer with root as its root table, a multiple of 8 bytes long.
+    std::string finish(uint32_t root) {
+        align(8, 4);
+        prepend_offset(root);
+        return buf_;
+    }
+
+private:
+    struct Field {
+        int id;
+        uint32_t at;
+    };
+    std::string buf_;
+    uint32_t table_start_ = 0;
+    std::vector<Field> fields_;
+};
+
+enum class ArrowType { kInt8, kInt32, kDate32, kFloat64, kUtf8 };
+
+struct ArrowField {
+    std::string name;
+    ArrowType type;
+};
+
+class ArrowFileWriter {
+public:
+    static constexpr size_t kBatchRows = 1 << 16;
+
+    ArrowFileWriter() = default;
+    ArrowFileWriter(const ArrowFileWriter&) = delete;
+    ArrowFileWriter& operator=(const ArrowFileWriter&) = delete;
+    ~ArrowFileWriter() { close(); }
+
+    // Returns false if the file can't be created.
+    bool open(const std::string& path, const std::vector<ArrowField>& fields) {
+        close();
+        fields_ = fields;
+        columns_.assign(fields.size(), ColumnData());
+        blocks_.clear();
+        rows_ = 0;
+        offset_ = 0;
+        failed_ = false;
+        file_ = std::fopen(path.c_str(), "wb");
+        if (!file_)
+            return false;
+        write("ARROW1\0\0", 8);
+        std::vector<char> no_body;
+        write_message(schema_message(), no_body, kSchemaHeader);
+        return true;
+    }
+
+    // The cells of one row, in the order of the fields, then end_row().
+    void add_int(size_t c, int64_t v) {
+        ColumnData& col = columns_[c];
+        if (fields_[c].type == ArrowType::kInt8)
+            col.data.push_back(char(int8_t(v)));
+        else
+            append_raw(col.data, int32_t(v));
+        col.valid.push_back(true);
+    }
+    void add_double(size_t c, double v) {
+        ColumnData& col = columns_[c];
+        append_raw(col.data, std::isnan(v) ? 0.0 : v);
+        col.valid.push_back(!std::isnan(v));
+    }
+    void add_text(size_t c, std::string_view v) {
+        ColumnData& col = columns_[c];
+        if (col.offsets.empty())
+            col.offsets.push_back(0);
+        col.data.insert(col.data.end(), v.begin(), v.end());
+        col.offsets.push_back(int32_t(col.data.size()));
+        col.valid.push_back(true);
+    }
+    void add_null(size_t c) {
+        switch (fields_[c].type) {
+        case ArrowType::kUtf8:
+            add_text(c, "");
+            break;
+        case ArrowType::kFloat64:
+            add_double(c, NAN);
+            return;
+        default:
+            add_int(c, 0);
+        }
+        columns_[c].valid.back() = false;
+    }
+    void end_row() {
+        if (++rows_ == kBatchRows)
+            write_batch();
+    }
+
+    // Writes the last batch and the footer. Returns false if anything could not be written.
+    bool close() {
+        if (!file_)
+            return !failed_;
+        if (rows_ > 0 || blocks_.empty())
+            write_batch();
+        const uint32_t end_of_stream[2] = {0xFFFFFFFFu, 0};
+        write(end_of_stream, 8);
+
+        FlatBuilder fb;
+        const uint32_t batches = fb.struct_vector(blocks_.data(), blocks_.size(), sizeof(Block));
+        const uint32_t dictionaries = fb.struct_vector(nullptr, 0, sizeof(Block));
+        const uint32_t schema = build_schema(fb);
+        fb.start_table();
+        fb.offset_field(3, batches);
+        fb.offset_field(2, dictionaries);
+        fb.offset_field(1, schema);
+        fb.field<int16_t>(0, kMetadataV5);
+        const std::string footer = fb.finish(fb.end_table());
+        write(footer.data(), footer.size());
+        const int32_t footer_size = int32_t(footer.size());
+        write(&footer_size, 4);
+        write("ARROW1", 6);
+
+        failed_ = std::ferror(file_) != 0 || failed_;
+        failed_ = std::fclose(file_) != 0 || failed_;
+        file_ = nullptr;
+        return !failed_;
+    }
+
+private:
+    static constexpr int16_t kMetadataV5 = 4;
+    static constexpr uint8_t kSchemaHeader = 1, kRecordBatchHeader = 3;
+
+    struct ColumnData {
+        std::vector<char> data;
+        std::vector<int32_t> offsets; // Utf8 only
+        std::vector<bool> valid;
+    };
+    struct Block { // as in File.fbs: where a message starts and how long it is
+        int64_t offset;
+        int32_t metadata_length;
+        int32_t padding;
+        int64_t body_length;
+    };
+    struct BufferRef { // Buffer in Message.fbs
+        int64_t offset, length;
+    };
+    struct FieldNode {
+        int64_t length, null_count;
+    };
+
+    template <class T>
+    static void append_raw(std::vector<char>& out, T v) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &v, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void write(const void* data, size_t n) {
+        if (n > 0 && std::fwrite(data, 1, n, file_) != n)
+            failed_ = true;
+        offset_ += n;
+    }
+
+    uint32_t build_schema(FlatBuilder& fb) const {
+        std::vector<uint32_t> fields;
+        for (const auto& f : fields_) {
+            const uint32_t children = fb.table_vector({});
+            uint8_t type_type;
+            fb.start_table();
+            switch (f.type) {
+            case ArrowType::kInt8:
+            case ArrowType::kInt32:
+                type_type = 2; // Int { bitWidth, is_signed }
+                fb.field<int32_t>(0, f.type == ArrowType::kInt8 ? 8 : 32);
+                fb.field<uint8_t>(1, 1);
+                break;
+            case ArrowType::kFloat64:
+                type_type = 3; // FloatingPoint { precision = DOUBLE }
+                fb.field<int16_t>(0, 2);
+                break;
+            case ArrowType::kUtf8:
+                type_type = 5; // Utf8 {}
+                break;
+            default:
+                type_type = 8; // Date { unit = DAY }
+                fb.field<int16_t>(0, 0);
+            }
+            const uint32_t type = fb.end_table();
+            const uint32_t name = fb.string(f.name);
+            fb.start_table();
+            fb.offset_field(5, children);
+            fb.offset_field(3, type);
+            fb.offset_field(0, name);
+            fb.field<uint8_t>(2, type_type);
+            fb.field<uint8_t>(1, 1); // nullable
+            fields.push_back(fb.end_table());
+        }
+        const uint32_t field_vector = fb.table_vector(fields);
+        fb.start_table();
+        fb.offset_field(1, field_vector);
+        fb.field<int16_t>(0, 0); // little endian
+        return fb.end_table();
+    }
+
+    std::string schema_message() const {
+        FlatBuilder fb;
+        const uint32_t schema = build_schema(fb);
+        return message(fb, kSchemaHeader, schema, 0);
+    }
+
+    static std::string message(FlatBuilder& fb, uint8_t header_type, uint32_t header, int64_t body_length) {
+        fb.start_table();
+        fb.field<int64_t>(3, body_length);
+        fb.offset_field(2, header);
+        fb.field<int16_t>(0, kMetadataV5);
+        fb.field<uint8_t>(1, header_type);
+        return fb.finish(fb.end_table());
+    }
+
+    // continuation marker, metadata size, metadata, body
+    void write_message(const std::string& metadata, const std::vector<char>& body, uint8_t header_type) {
+        const Block block = {int64_t(offset_), int32_t(8 + metadata.size()), 0, int64_t(body.size())};
+        const int32_t head[2] = {-1, int32_t(metadata.size())};
+        write(head, 8);
+        write(metadata.data(), metadata.size());
+        write(body.data(), body.size());
+        if (header_type == kRecordBatchHeader)
+            blocks_.push_back(block);
+    }
+
+    void write_batch() {
+        std::vector<char> body;
+        std::vector<BufferRef> buffers;
+        std::vector<FieldNode> nodes;
+        auto add_buffer = [&](const char* data, size_t n) {
+            buffers.push_back({int64_t(body.size()), int64_t(n)});
+            body.insert(body.end(), data, data + n);
+            body.resize((body.size() + 7) / 8 * 8, '\0');
+        };
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            ColumnData& col = columns_[c];
+            int64_t nulls = 0;
+            std::vector<char> bitmap((rows_ + 7) / 8, '\0');
+            for (size_t i = 0; i < rows_; ++i) {
+                if (col.valid[i])
+                    bitmap[i / 8] = char(bitmap[i / 8] | (1 << (i % 8)));
+                else
+                    nulls++;
+            }
+            nodes.push_back({int64_t(rows_), nulls});
+            add_buffer(bitmap.data(), nulls > 0 ? bitmap.size() : 0); // no bitmap when nothing is missing
+            if (fields_[c].type == ArrowType::kUtf8) {
+                if (col.offsets.empty())
+                    col.offsets.push_back(0);
+                add_buffer(reinterpret_cast<const char*>(col.offsets.data()), 4 * col.offsets.size());
+            }
+            add_buffer(col.data.data(), col.data.size());
+            col = ColumnData();
+        }
+
+        FlatBuilder fb;
+        const uint32_t buffer_vector = fb.struct_vector(buffers.data(), buffers.size(), sizeof(BufferRef));
+        const uint32_t node_vector = fb.struct_vector(nodes.data(), nodes.size(), sizeof(FieldNode));
+        fb.start_table();
+        fb.field<int64_t>(0, int64_t(rows_));
+        fb.offset_field(2, buffer_vector);
+        fb.offset_field(1, node_vector);
+        const uint32_t batch = fb.end_table();
+        write_message(message(fb, kRecordBatchHeader, batch, int64_t(body.size())), body, kRecordBatchHeader);
+        rows_ = 0;
+    }
+
+    FILE* file_ = nullptr;
+    std::vector<ArrowField> fields_;
+    std::vector<ColumnData> columns_;
+    std::vector<Block> blocks_;
+    size_t rows_ = 0;   // in the batch being filled
+    uint64_t offset_ = 0; // bytes written to the file
+    bool failed_ = false;
+};
+
+} // namespace smhi
@@ -0,0 +1,78 @@
+#pragma once
+// Helpers for reading one big text file with many threads.
+//
+// The file is memory mapped (see mapped_file.h) and cut into byte ranges that each start
+// at the beginning of a line and end just after a '\n'. Every range can then be cleaned or
+// summed on its own thread, and because the ranges are in file order, joining the results
+// range by range gives the same order as reading the file from top to bottom.
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace smhi {
+
+struct ByteRange {
+    size_t begin = 0; // offset of the first byte
+    size_t end = 0;   // offset one past the last byte
+};
+
+// Offset just after the next '\n' at or after pos, or size if there is none.
+inline size_t next_line_start(const char* data, size_t size, size_t pos) {
+    if (pos >= size)
+        return size;
+    const void* nl = std::memchr(data + pos, '\n', size - pos);
+    return nl ? size_t(static_cast<const char*>(nl) - data) + 1 : size;
+}
+
+// Offset after the first n lines (e.g. to skip a header), or size if the file is shorter.
+inline size_t skip_lines(const char* data, size_t size, size_t n) {
+    size_t pos = 0;
+    for (size_t i = 0; i < n && pos < size; ++i)
+        pos = next_line_start(data, size, pos);
+    return pos;
+}
+
+// Cuts [begin, end) into at most n_ranges ranges of about the same size, but never smaller
+// than min_bytes. Every cut is moved forward to the next line start, so no line is split
+// between two ranges. The ranges cover [begin, end) without gaps and are in file order.
+inline std::vector<ByteRange> split_at_lines(const char* data, size_t begin, size_t end, size_t n_ranges,
+                                             size_t min_bytes = 1 << 20) {
+    std::vector<ByteRange> ranges;
+    const size_t bytes = end > begin ? end - begin : 0;
+    if (n_ranges == 0)
+        n_ranges = 1;
+    if (min_bytes > 0 && bytes / min_bytes < n_ranges)
+        n_ranges = bytes / min_bytes > 0 ? bytes / min_bytes : 1;
+
+    size_t start = begin;
+    for (size_t i = 1; i <= n_ranges && start < end; ++i) {
+        size_t cut = i == n_ranges ? end : begin + bytes / n_ranges * i;
+        if (cut < start)
+            cut = start;
+        // the line that contains byte cut - 1 belongs to this range
+        if (cut < end && cut > start && data[cut - 1] != '\n')
+            cut = next_line_start(data, end, cut);
+        if (cut > start)
+            ranges.push_back({start, cut});
+        start = cut;
+    }
+    return ranges;
+}
+
+// Calls line(text) for every line in the range, without its '\n', the same lines that
+// std::getline would give: a last line without '\n' is included, but a '\n' at the very
+// end does not make an extra empty line.
+template <class LineFn>
+void for_each_line(const char* data, ByteRange range, LineFn line) {
+    size_t pos = range.begin;
+    while (pos < range.end) {
+        const void* nl = std::memchr(data + pos, '\n', range.end - pos);
+        const size_t stop = nl ? size_t(static_cast<const char*>(nl) - data) : range.end;
+        line(std::string_view(data + pos, stop - pos));
+        pos = stop + 1;
+    }
+}
+
+} // namespace smhi
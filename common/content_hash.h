@@ -0,0 +1,69 @@
+#pragma once
+// Fingerprints of file contents, to tell whether a file has changed since the last run
+// (see pipeline.cxx).
+//
+// A 64-bit multiply-xor hash over 8 bytes at a time with a final mix, so that every bit of the
+// input reaches every bit of the hash. It is not a cryptographic hash: two different files get
+// the same hash with a chance of about 1 in 2^64, which is all that is needed to notice edits.
+// Files are memory mapped (mapped_file.h) and hashed at several GB/s.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "mapped_file.h"
+
+namespace smhi {
+
+constexpr uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+
+inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Hash of n bytes, continuing from seed, so several pieces can be hashed as one.
+inline uint64_t content_hash(const char* data, size_t n, uint64_t seed = kHashSeed) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = (h ^ word) * prime;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    if (i < n)
+        std::memcpy(&tail, data + i, n - i);
+    h = (h ^ tail) * prime;
+    return hash_mix(h);
+}
+
+inline uint64_t content_hash(const std::string& text, uint64_t seed = kHashSeed) {
+    return content_hash(text.data(), text.size(), seed);
+}
+
+// Hash of the contents of a file. Returns false if it can't be read.
+inline bool hash_file(const std::string& path, uint64_t& hash) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    hash = content_hash(file.data(), file.size());
+    return true;
+}
+
+// "0123456789abcdef"
+inline std::string hash_text(uint64_t hash) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i, hash >>= 4)
+        text[size_t(i)] = digits[hash & 15];
+    return text;
+}
+
+} // namespace smhi
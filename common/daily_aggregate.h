@@ -0,0 +1,129 @@
+#pragma once
+// Daily mean, minimum and maximum of hourly (or any sub-daily) readings, computed while the
+// rows stream past.
+//
+// SMHI station files are in date order, so all readings of a day come one after the other and
+// only the day being read has to be kept: a sum, a count, the lowest and the highest reading.
+// The memory stays the same however many readings a station has, and a day is handed on as
+// soon as the first reading of the next day arrives:
+//
+//     smhi::DailyAggregator daily(18);                 // a mean needs at least 18 readings
+//     for (every row) daily.add(day, temperature, write_day);
+//     daily.finish(write_day);
+//
+// write_day gets a DailyValue. Days with fewer than min_readings readings still come out, with
+// the count but a NaN mean, min and max; days without any reading do not come out at all.
+// The readings are summed exactly in thousandths and the mean is rounded from that sum to two
+// decimals, half away from zero, so -2.775 is always -2.78 whatever the order of the readings.
+// The cleaners write the daily values of Falun.csv to Falun_daily.csv (see daily_path_for).
+//
+// The daily files keep the layout of the cleaned files, one line per day and no header line:
+//
+//     date;time;mean;min;max;readings      e.g.  1983-01-01;;-3.23;-10.9;3.1;24
+//
+//   date      YYYY-MM-DD
+//   time      always empty: the row is a whole day, not a reading at some hour
+//   mean      mean of the day's readings, two decimals; empty if the day has too few readings
+//   min, max  lowest and highest reading, with the decimals of the readings; empty like the mean
+//   readings  how many readings the day had
+//
+// The mean sits in the third field, where Falun.csv has the temperature of one reading. A
+// reader that keeps the readings of an hour (time "18:00:00") skips every daily row because of
+// the empty time; a reader of the daily values asks for the empty time (kNoTime in the binary
+// copy) and picks its field with DailyField. Falun_daily.bin has the columns of kDailyColumns.
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace smhi {
+
+// the fields of a line of a daily file
+enum DailyField { kDailyFieldDate, kDailyFieldTime, kDailyFieldMean, kDailyFieldMin, kDailyFieldMax, kDailyFieldReadings };
+
+// the columns of the binary copy of a daily file, in this order
+inline const std::vector<std::string> kDailyColumns = {"mean", "min", "max", "readings"};
+
+struct DailyValue {
+    int32_t day = 0;        // days since 1970-01-01
+    double mean = NAN;      // two decimals
+    double min = NAN;
+    double max = NAN;
+    uint32_t readings = 0;  // how many readings the day had
+};
+
+class DailyAggregator {
+public:
+    explicit DailyAggregator(uint32_t min_readings = 1) : min_readings_(min_readings ? min_readings : 1) {}
+
+    // Adds one reading (NaN = missing, only counted as a row). A reading of an earlier day than
+    // the one being collected is out of order: it is left out and counted in out_of_order().
+    template <class Emit>
+    void add(int32_t day, double value, Emit&& emit) {
+        if (open_ && day != current_.day) {
+            if (day < current_.day) {
+                out_of_order_++;
+                return;
+            }
+            close(emit);
+        }
+        if (!open_) {
+            open_ = true;
+            current_ = DailyValue();
+            current_.day = day;
+            sum_ = 0;
+        }
+        if (std::isnan(value))
+            return;
+        if (current_.readings == 0 || value < current_.min)
+            current_.min = value;
+        if (current_.readings == 0 || value > current_.max)
+            current_.max = value;
+        sum_ += std::llround(value * 1000);
+        current_.readings++;
+    }
+
+    // hands on the last day
+    template <class Emit>
+    void finish(Emit&& emit) {
+        if (open_)
+            close(emit);
+    }
+
+    size_t out_of_order() const { return out_of_order_; }
+
+private:
+    template <class Emit>
+    void close(Emit& emit) {
+        open_ = false;
+        if (current_.readings == 0)
+            return;
+        if (current_.readings < min_readings_)
+            current_.min = current_.max = NAN;
+        else {
+            // the mean in hundredths is sum_ / (10 * readings), rounded half away from zero
+            const int64_t den = 10 * int64_t(current_.readings);
+            const int64_t q = (2 * (sum_ < 0 ? -sum_ : sum_) + den) / (2 * den);
+            current_.mean = double(sum_ < 0 ? -q : q) / 100;
+        }
+        emit(static_cast<const DailyValue&>(current_));
+    }
+
+    uint32_t min_readings_;
+    bool open_ = false;
+    DailyValue current_;
+    int64_t sum_ = 0; // thousandths
+    size_t out_of_order_ = 0;
+};
+
+// "Falun.csv" -> "Falun_daily.csv"
+inline std::string daily_path_for(const std::string& csv_path) {
+    const size_t slash = csv_path.find_last_of('/');
+    const size_t dot = csv_path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return csv_path + "_daily";
+    return csv_path.substr(0, dot) + "_daily" + csv_path.substr(dot);
+}
+
+} // namespace smhi
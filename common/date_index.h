@@ -0,0 +1,197 @@
+#pragma once
+// Sparse date index of a cleaned station file (Falun.csv -> Falun.idx).
+//
+// The cleaners write one line per month that appears in the cleaned file, with the byte
+// offset of the first CSV line of that month and the number of the first row of that month
+// in the binary copy (Falun.bin). A tool that only needs some years looks them up here and
+// seeks to the first row it needs, instead of reading every row and skipping the other years.
+//
+// The file is plain text:
+//
+//   # date index of Falun.csv, written by the cleaner
+//   size <rows in the .bin> <bytes in the .csv>
+//   <year> <month> <byte offset in the .csv> <row in the .bin>
+//   ...
+//
+// The sizes tell a tool whether the index still belongs to the file next to it: when the CSV
+// or the binary copy was changed after cleaning, matches_csv()/matches_store() say no and
+// the file has to be read from the start like before.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "station_store.h"
+
+namespace smhi {
+
+// "Falun.csv" -> "Falun.idx"
+inline std::string index_path_for(const std::string& csv_path) {
+    std::string path = store_path_for(csv_path);
+    return path.replace(path.size() - 4, 4, ".idx");
+}
+
+// The rows of some months: bytes [byte_begin, byte_end) of the CSV and rows [row_begin, row_end) of the .bin
+struct DateRange {
+    uint64_t byte_begin = 0, byte_end = 0;
+    uint64_t row_begin = 0, row_end = 0;
+    bool empty() const { return row_begin == row_end && byte_begin == byte_end; }
+};
+
+struct DateIndexEntry {
+    int32_t month_key; // year * 12 + month - 1
+    uint64_t byte_offset;
+    uint64_t row;
+};
+
+// Collects the month boundaries while a cleaner writes its rows.
+class DateIndexWriter {
+public:
+    // Call once for every row, in the order the rows are written: byte_offset is where its
+    // CSV line starts and row its number in the binary copy.
+    void add(int year, int month, uint64_t byte_offset, uint64_t row) {
+        const int32_t key = year * 12 + month - 1;
+        if (!entries_.empty() && key == entries_.back().month_key)
+            return;
+        if (!entries_.empty() && key < entries_.back().month_key)
+            sorted_ = false; // the months are not in order, so an index can't be used
+        entries_.push_back({key, byte_offset, row});
+    }
+
+    // Adds the entries of a writer that saw the rows that come after the rows already here,
+    // with its offsets counted from byte_base and row_base. Used to join the pieces of a file
+    // that were cleaned on different threads.
+    void append(const DateIndexWriter& other, uint64_t byte_base, uint64_t row_base) {
+        if (!other.sorted_)
+            sorted_ = false;
+        for (const auto& e : other.entries_) {
+            const int y = e.month_key / 12;
+            add(y, e.month_key - y * 12 + 1, byte_base + e.byte_offset, row_base + e.row);
+        }
+    }
+
+    // Writes the index of a CSV with csv_bytes bytes and a binary copy with rows rows.
+    // If the rows were not in date order no index is written and an old one is removed,
+    // so the tools read the whole file.
+    bool save(const std::string& path, const std::string& csv_name, uint64_t rows, uint64_t csv_bytes) const {
+        if (!sorted_) {
+            std::remove(path.c_str());
+            return true;
+        }
+        FILE* f = std::fopen(path.c_str(), "w");
+        if (!f)
+            return false;
+        std::fprintf(f, "# date index of %s, written by the cleaner\n", csv_name.c_str());
+        std::fprintf(f, "size %llu %llu\n", (unsigned long long)rows, (unsigned long long)csv_bytes);
+        for (const auto& e : entries_) {
+            const int y = e.month_key / 12;
+            std::fprintf(f, "%d %d %llu %llu\n", y, e.month_key - y * 12 + 1, (unsigned long long)e.byte_offset,
+                         (unsigned long long)e.row);
+        }
+        const bool failed = std::ferror(f) != 0;
+        return std::fclose(f) == 0 && !failed;
+    }
+
+private:
+    std::vector<DateIndexEntry> entries_;
+    bool sorted_ = true;
+};
+
+// The index as read by the analysis tools.
+class DateIndex {
+public:
+    // Returns false if there is no index or it can't be read.
+    bool load(const std::string& path) {
+        entries_.clear();
+        std::ifstream in(path);
+        std::string line;
+        bool has_size = false;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::stringstream ss(line);
+            if (line.compare(0, 5, "size ") == 0) {
+                std::string word;
+                has_size = bool(ss >> word >> rows_ >> bytes_);
+                continue;
+            }
+            int y, m;
+            DateIndexEntry e;
+            if (!(ss >> y >> m >> e.byte_offset >> e.row) || m < 1 || m > 12)
+                return fail();
+            e.month_key = y * 12 + m - 1;
+            if (!entries_.empty() && (e.month_key <= entries_.back().month_key ||
+                                      e.byte_offset < entries_.back().byte_offset || e.row < entries_.back().row))
+                return fail();
+            entries_.push_back(e);
+        }
+        if (!has_size || entries_.empty() || entries_.back().byte_offset > bytes_ || entries_.back().row > rows_)
+            return fail();
+        return true;
+    }
+
+    bool loaded() const { return !entries_.empty(); }
+
+    // true if the index was written for a CSV of this many bytes / a binary copy with this many rows
+    bool matches_csv(uint64_t csv_bytes) const { return loaded() && csv_bytes == bytes_; }
+    bool matches_store(uint64_t rows) const { return loaded() && rows == rows_; }
+
+    int first_year() const { return entries_.front().month_key / 12; }
+    int last_year() const { return entries_.back().month_key / 12; }
+
+    // The rows of the years from..to (both included); empty if the file has none of them.
+    DateRange years(int from, int to) const {
+        if (!loaded() || from > to)
+            return DateRange();
+        return months(from * 12, (to + 1) * 12);
+    }
+
+    // The rows of the months that hold the days from..to (day ordinals); the rows outside from..to
+    // still have to be skipped by the caller.
+    DateRange days(int32_t from, int32_t to) const {
+        if (loaded()) { // no dates outside the file, so the calendar works for open ends too
+            from = std::max(from, days_from_civil(first_year(), 1, 1));
+            to = std::min(to, days_from_civil(last_year(), 12, 31));
+        }
+        if (!loaded() || from > to)
+            return DateRange();
+        int from_year, from_month, to_year, to_month, d;
+        civil_from_days(from, from_year, from_month, d);
+        civil_from_days(to, to_year, to_month, d);
+        return months(from_year * 12 + from_month - 1, to_year * 12 + to_month);
+    }
+
+private:
+    // the rows of the month keys [from_key, to_key)
+    DateRange months(int32_t from_key, int32_t to_key) const {
+        DateRange r;
+        const size_t begin = lower_bound(from_key);
+        const size_t end = lower_bound(to_key);
+        r.byte_begin = begin < entries_.size() ? entries_[begin].byte_offset : bytes_;
+        r.row_begin = begin < entries_.size() ? entries_[begin].row : rows_;
+        r.byte_end = end < entries_.size() ? entries_[end].byte_offset : bytes_;
+        r.row_end = end < entries_.size() ? entries_[end].row : rows_;
+        return r;
+    }
+
+    // first entry with a month key of at least key
+    size_t lower_bound(int32_t key) const {
+        return size_t(std::lower_bound(entries_.begin(), entries_.end(), key,
+                                       [](const DateIndexEntry& e, int32_t k) { return e.month_key < k; }) -
+                      entries_.begin());
+    }
+
+    bool fail() {
+        entries_.clear();
+        return false;
+    }
+
+    std::vector<DateIndexEntry> entries_;
+    uint64_t rows_ = 0, bytes_ = 0;
+};
+
+} // namespace smhi
@@ -0,0 +1,173 @@
+#pragma once
+// Fast conversion of the short decimal fields in the SMHI files ("-7.2", "0.0", "13.45")
+// to double, replacing std::stod in the hot loops.
+//
+// A field of up to 8 characters is loaded into one 64-bit word and handled with SWAR
+// ("SIMD within a register": all 8 bytes are checked and converted together with a few
+// integer operations). The decimal point is found and squeezed out, the digits are checked
+// in one go and turned into an integer with three multiplications. The result is then
+//
+//     value = digits / 10^decimals
+//
+// Both numbers are exact in a double, so the division is correctly rounded and gives
+// bit for bit the same double as std::stod / strtod. Anything the fast path does not
+// cover (exponents, "+" signs, long fields, ...) goes to strtod, so the result is the same
+// for every input. Unlike std::stod, a field must be a number as a whole: "7.2abc" or ""
+// are reported as malformed instead of throwing or being read partly.
+//
+// parse_decimal_column() converts a whole column of fields at once and reports the
+// malformed ones in a bitmap instead of through exceptions.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <string_view>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "decimal_parse.h assumes a little-endian machine"
+#endif
+
+namespace smhi {
+
+namespace detail {
+
+// every power of ten up to 1e22 is exact in a double
+constexpr double kPow10[23] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+constexpr uint64_t kOnes   = 0x0101010101010101ULL;
+constexpr uint64_t kHigh   = 0x8080808080808080ULL;
+constexpr uint64_t kZeros  = 0x3030303030303030ULL; // "00000000"
+
+// true if all 8 bytes of w are the characters '0'..'9'
+inline bool swar_all_digits(uint64_t w) {
+    return (((w + 0x4646464646464646ULL) | (w - kZeros)) & kHigh) == 0;
+}
+
+// 8 ASCII digits (first character in the lowest byte) -> their value
+inline uint32_t swar_parse8(uint64_t w) {
+    w -= kZeros;
+    w = (w * 10) + (w >> 8);                                        // pairs of digits
+    w = (((w & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) // groups of four, then all eight
+         + (((w >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return uint32_t(w);
+}
+
+// strtod on the whole field. decimals = digits after the point, or -1 with an exponent.
+inline bool parse_decimal_slow(const char* p, size_t n, double& out, int* decimals) {
+    if (n == 0)
+        return false;
+    char small[64];
+    std::string big;
+    const char* text = small;
+    if (n < sizeof small) {
+        std::memcpy(small, p, n);
+        small[n] = '\0';
+    } else {
+        big.assign(p, n);
+        text = big.c_str();
+    }
+    char* end = nullptr;
+    const double v = std::strtod(text, &end);
+    if (end != text + n)
+        return false;
+    out = v;
+    if (decimals) {
+        const char* dot = static_cast<const char*>(std::memchr(text, '.', n));
+        int d = 0;
+        if (dot)
+            while (dot + 1 + d < text + n && dot[1 + d] >= '0' && dot[1 + d] <= '9')
+                ++d;
+        *decimals = std::strpbrk(text, "eEnN") ? -1 : d; // exponent, nan or inf
+    }
+    return true;
+}
+
+} // namespace detail
+
+// Converts one field. Returns false if the field is not a number; out is left unchanged then.
+// If decimals is given it receives the number of digits after the decimal point.
+inline bool parse_decimal(const char* p, size_t n, double& out, int* decimals = nullptr) {
+    using namespace detail;
+    const bool negative = n > 0 && p[0] == '-';
+    const char* digits_start = p + negative;
+    const size_t len = n - negative;
+    if (len == 0 || len > 8)
+        return parse_decimal_slow(p, n, out, decimals);
+
+    // the field in the low bytes of w, zero bytes above. Only the len bytes of the field are
+    // read, the caller's buffer may end right after it. They are gathered one by one: a memcpy
+    // with a variable length would be a function call, this loop is unrolled into a few loads.
+    uint64_t w = 0;
+    for (size_t i = 0; i < len; ++i)
+        w |= uint64_t(uint8_t(digits_start[i])) << (8 * i);
+
+    // find the '.' (lowest byte of w equal to 0x2E) and squeeze it out
+    const uint64_t x = w ^ (kOnes * '.');
+    const uint64_t dots = (x - kOnes) & ~x & kHigh;
+    size_t n_digits = len;
+    int frac = 0;
+    if (dots) {
+        const unsigned dot = unsigned(__builtin_ctzll(dots)) >> 3;
+        const uint64_t below = dot ? (~0ULL >> (64 - 8 * dot)) : 0;
+        w = (w & below) | ((w >> 8) & ~below);
+        n_digits = len - 1;
+        frac = int(len - dot - 1);
+        if (n_digits == 0)
+            return parse_decimal_slow(p, n, out, decimals);
+    }
+
+    // move the digits to the top and fill the bytes below with '0', so "72" becomes "00000072"
+    const unsigned shift = unsigned(8 * (8 - n_digits));
+    if (shift)
+        w = (w << shift) | (kZeros & ((1ULL << shift) - 1));
+    if (!swar_all_digits(w))
+        return parse_decimal_slow(p, n, out, decimals);
+
+    const double v = double(swar_parse8(w)) / kPow10[frac];
+    out = negative ? -v : v;
+    if (decimals)
+        *decimals = frac;
+    return true;
+}
+
+inline bool parse_decimal(std::string_view field, double& out, int* decimals = nullptr) {
+    return parse_decimal(field.data(), field.size(), out, decimals);
+}
+
+inline bool parse_decimal(const std::string& field, double& out, int* decimals = nullptr) {
+    return parse_decimal(field.data(), field.size(), out, decimals);
+}
+
+// Converts a whole column: out[i] = value of fields[i], NaN for a malformed or empty field.
+// Bit i of error_bits (which must hold (n + 63) / 64 words) is set for every such field.
+// max_decimals, if given, receives the largest number of decimals seen (-1 = not fixed).
+// Returns the number of malformed fields.
+inline size_t parse_decimal_column(const std::string_view* fields, size_t n, double* out, uint64_t* error_bits,
+                                   int* max_decimals = nullptr) {
+    size_t errors = 0;
+    int max_dec = 0;
+    for (size_t block = 0; block < n; block += 64) {
+        const size_t block_end = block + 64 < n ? block + 64 : n;
+        uint64_t bits = 0;
+        for (size_t i = block; i < block_end; ++i) {
+            int dec = 0;
+            if (!parse_decimal(fields[i].data(), fields[i].size(), out[i], &dec)) {
+                out[i] = NAN;
+                bits |= 1ULL << (i - block);
+                continue;
+            }
+            if (max_dec >= 0 && (dec < 0 || dec > max_dec))
+                max_dec = dec;
+        }
+        error_bits[block / 64] = bits;
+        errors += size_t(__builtin_popcountll(bits));
+    }
+    if (max_decimals)
+        *max_decimals = max_dec;
+    return errors;
+}
+
+} // namespace smhi
@@ -0,0 +1,126 @@
+#pragma once
+// Day-of-year climatology cube: every 06:00 and 18:00 temperature of a set of stations
+// in one dense array, indexed by station x year x day of the year x reading.
+//
+// Days are numbered as in a leap year (01-01 = 0, 02-29 = 59, 12-31 = 365), so a given
+// MM-DD always lands in the same slot and 366 slots cover every calendar day.
+// Missing readings are NaN.
+//
+// The cube is saved as a small binary file (magic, sizes, station names, then the values as doubles)
+// so the ROOT macros can read any day of it without going through the station data again.
+// Only standard headers and smhi_date.h are used here so the file can also be included from ROOT.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "smhi_date.h"
+
+namespace smhi {
+
+const int kCubeDays = 366;
+const int kCubeReadings = 2; // 0 = 06:00, 1 = 18:00
+
+// Slot of a calendar day in the cube: (1, 1) -> 0, (2, 29) -> 59, (12, 31) -> 365.
+inline int cube_slot(int month, int day) {
+    if (month < 1 || month > 12 || day < 1 || day > kMonthDays[1][month])
+        return -1;
+    return kDaysBeforeMonth[1][month] + day - 1;
+}
+
+// "07-04" -> slot of July 4th, or -1 if the text is not a MM-DD day.
+inline int cube_slot(const std::string& mmdd) {
+    int month = 0, day = 0;
+    if (mmdd.size() != 5 || mmdd[2] != '-' || std::sscanf(mmdd.c_str(), "%2d-%2d", &month, &day) != 2)
+        return -1;
+    return cube_slot(month, day);
+}
+
+// The inverse of cube_slot, e.g. 59 -> "02-29".
+inline std::string cube_slot_name(int slot) {
+    int month = 12;
+    while (month > 1 && kDaysBeforeMonth[1][month] > slot)
+        --month;
+    char text[16];
+    std::snprintf(text, sizeof text, "%02d-%02d", month, slot - kDaysBeforeMonth[1][month] + 1);
+    return text;
+}
+
+class ClimatologyCube {
+public:
+    ClimatologyCube() = default;
+    ClimatologyCube(const std::vector<std::string>& stations, int first_year, int last_year)
+        : stations_(stations), first_year_(first_year), n_years_(last_year - first_year + 1),
+          data_(size_t(stations.size()) * n_years_ * kCubeDays * kCubeReadings, NAN) {}
+
+    const std::vector<std::string>& stations() const { return stations_; }
+    int first_year() const { return first_year_; }
+    int last_year() const { return first_year_ + n_years_ - 1; }
+    int years() const { return n_years_; }
+
+    double& at(int station, int year, int slot, int reading) { return data_[index(station, year, slot, reading)]; }
+    double at(int station, int year, int slot, int reading) const { return data_[index(station, year, slot, reading)]; }
+
+    // The mean of the 06:00 and 18:00 readings, or NaN if one of them is missing.
+    double daily_mean(int station, int year, int slot) const {
+        const double* r = &data_[index(station, year, slot, 0)];
+        if (std::isnan(r[0]) || std::isnan(r[1]))
+            return NAN;
+        return (r[0] + r[1]) / 2;
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open())
+            return false;
+        const uint32_t head[4] = {uint32_t(stations_.size()), uint32_t(first_year_), uint32_t(n_years_), 0};
+        out.write(kMagic, sizeof kMagic);
+        out.write(reinterpret_cast<const char*>(head), sizeof head);
+        for (const auto& name : stations_) {
+            char field[32] = {};
+            std::strncpy(field, name.c_str(), sizeof field - 1);
+            out.write(field, sizeof field);
+        }
+        out.write(reinterpret_cast<const char*>(data_.data()), data_.size() * sizeof(double));
+        return bool(out);
+    }
+
+    bool load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        char magic[8];
+        uint32_t head[4];
+        if (!in.read(magic, sizeof magic) || std::memcmp(magic, kMagic, sizeof magic) != 0 ||
+            !in.read(reinterpret_cast<char*>(head), sizeof head))
+            return false;
+        stations_.assign(head[0], "");
+        for (auto& name : stations_) {
+            char field[32];
+            if (!in.read(field, sizeof field))
+                return false;
+            field[31] = '\0';
+            name = field;
+        }
+        first_year_ = int(head[1]);
+        n_years_ = int(head[2]);
+        data_.assign(size_t(head[0]) * n_years_ * kCubeDays * kCubeReadings, NAN);
+        return bool(in.read(reinterpret_cast<char*>(data_.data()), data_.size() * sizeof(double)));
+    }
+
+private:
+    size_t index(int station, int year, int slot, int reading) const {
+        return ((size_t(station) * n_years_ + (year - first_year_)) * kCubeDays + slot) * kCubeReadings + reading;
+    }
+
+    static constexpr char kMagic[8] = {'S', 'M', 'H', 'I', 'C', 'U', 'B', 'E'};
+
+    std::vector<std::string> stations_;
+    int first_year_ = 0;
+    int n_years_ = 0;
+    std::vector<double> data_;
+};
+
+} // namespace smhi
@@ -0,0 +1,41 @@
+#pragma once
+// Canvases that are reused instead of created again for every figure.
+//
+// The macros used to call new TCanvas("c", ...) for every figure, so drawing a second figure
+// replaced the canvas of the first one and leaked it with everything drawn on it.
+// figure_canvas() returns the canvas of that name if there already is one, after deleting the
+// histograms, graphs and legends of the last figure drawn on it, so render_figures.cxx can draw
+// hundreds of figures in one process without the memory growing. The margins, grid and log
+// scales are put back to those of gStyle. The first call creates the canvas like new TCanvas.
+//
+// Needs ROOT, include it from a macro.
+
+#include <TCanvas.h>
+#include <TCollection.h>
+#include <TList.h>
+#include <TROOT.h>
+#include <TStyle.h>
+
+namespace smhi {
+
+inline TCanvas* figure_canvas(const char* name, const char* title, int width, int height) {
+    TCanvas* c = static_cast<TCanvas*>(gROOT->GetListOfCanvases()->FindObject(name));
+    if (!c)
+        return new TCanvas(name, title, width, height);
+
+    // what the last figure drew belongs to the canvas from now on, so Clear() deletes it
+    for (TObject* obj : *c->GetListOfPrimitives())
+        obj->SetBit(kCanDelete);
+    c->Clear();
+    c->SetTitle(title);
+    c->SetCanvasSize(width, height);
+    c->SetMargin(gStyle->GetPadLeftMargin(), gStyle->GetPadRightMargin(), gStyle->GetPadBottomMargin(),
+                 gStyle->GetPadTopMargin());
+    c->SetGrid(gStyle->GetPadGridX(), gStyle->GetPadGridY());
+    c->SetLogx(gStyle->GetOptLogx());
+    c->SetLogy(gStyle->GetOptLogy());
+    c->cd();
+    return c;
+}
+
+} // namespace smhi
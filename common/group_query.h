@@ -0,0 +1,273 @@
+#pragma once
+// Group-by/aggregate engine over one column of a station store, used by station_query.cxx,
+// and the option parsing and file opening that the tools reading the stores share.
+//
+// A query is a filter (date range, hours), a grouping key and a set of aggregates. The rows of
+// the store are scanned once and every value is added to the accumulator of its group.
+//
+// The grouping key is a year part (or none) and a part within the year: month, day of the
+// year, season or none. Groups are kept in one flat array, group = (year - first_year) * parts + part,
+// so there is no map lookup per row.
+//
+// The scan loop is a template on the key and on the set of aggregates, so every combination
+// gets its own loop with only the work it needs (no day of the year when it isn't grouped by,
+// no min/max when only the mean is asked for). The sets the existing programs use have their
+// own loop (see kCommonAggs), anything else runs the loop that computes everything.
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "date_index.h"
+#include "smhi_date.h"
+#include "station_store.h"
+
+namespace smhi {
+
+// aggregate bits; the mean needs kSum and kCount
+enum AggBits : unsigned {
+    kAggSum    = 1 << 0,
+    kAggCount  = 1 << 1,
+    kAggMin    = 1 << 2,
+    kAggMax    = 1 << 3,
+    kAggArgMin = 1 << 4,
+    kAggArgMax = 1 << 5,
+    kAggAbove  = 1 << 6,
+    kAggAll    = (1 << 7) - 1,
+};
+
+// kAggAbove counts the values above each of up to this many thresholds
+constexpr int kMaxThresholds = 4;
+
+// the part of the key within a year
+enum class YearPart { kNone, kMonth, kDayOfYear, kSeason };
+
+inline int year_part_count(YearPart part) {
+    switch (part) {
+    case YearPart::kMonth: return 12;
+    case YearPart::kDayOfYear: return 366;
+    case YearPart::kSeason: return 4;
+    default: return 1;
+    }
+}
+
+// "DJF", "MAM", "JJA", "SON"; December counts to the winter of its own year
+inline const char* season_name(int season) {
+    static const char* names[4] = {"DJF", "MAM", "JJA", "SON"};
+    return names[season];
+}
+
+struct GroupQuery {
+    size_t column = 0;
+    int32_t from = std::numeric_limits<int32_t>::min(); // first day kept (day ordinal)
+    int32_t to = std::numeric_limits<int32_t>::max();   // last day kept
+    uint32_t hours = 0;       // bit h = keep hour h; 0 = keep every row, also daily values
+    bool by_year = false;
+    YearPart part = YearPart::kNone;
+    unsigned aggs = kAggCount;
+    double thresholds[kMaxThresholds] = {}; // kAggAbove counts the values above each of these
+    int n_thresholds = 0;
+    size_t row_begin = 0, row_end = 0; // rows of the store to look at
+};
+
+// what is known about one group; count is always kept, empty groups have count 0
+struct GroupStats {
+    double sum = 0;
+    uint64_t count = 0;
+    uint64_t above[kMaxThresholds] = {}; // values above q.thresholds[t]
+    double min = INFINITY, max = -INFINITY;
+    int32_t argmin = 0, argmax = 0; // day of the first minimum/maximum
+
+    double mean() const { return count ? sum / double(count) : NAN; }
+};
+
+// The result: group g is year first_year + g / parts (if grouped by year) and part g % parts.
+struct GroupResult {
+    int first_year = 0;
+    int parts = 1;
+    std::vector<GroupStats> groups;
+};
+
+namespace detail {
+
+template <YearPart Part>
+inline int part_of(int y, int m, int d) {
+    if constexpr (Part == YearPart::kMonth)
+        return m - 1;
+    else if constexpr (Part == YearPart::kDayOfYear)
+        return day_of_year(y, m, d) - 1;
+    else if constexpr (Part == YearPart::kSeason)
+        return (m % 12) / 3;
+    else
+        return 0;
+}
+
+template <bool ByYear, YearPart Part, unsigned Aggs>
+void scan(const StationStore& store, const GroupQuery& q, GroupResult& out) {
+    constexpr int parts = Part == YearPart::kDayOfYear ? 366 : Part == YearPart::kMonth ? 12
+                        : Part == YearPart::kSeason ? 4 : 1;
+    const int32_t* date = store.date();
+    const uint8_t* hour = store.time_code();
+    GroupStats* groups = out.groups.data();
+    for (size_t i = q.row_begin; i < q.row_end; ++i) {
+        const int32_t day = date[i];
+        if (day < q.from || day > q.to)
+            continue;
+        if (q.hours != 0 && (hour[i] >= 24 || !((q.hours >> hour[i]) & 1)))
+            continue;
+        const double v = store.value(q.column, i);
+        if (std::isnan(v))
+            continue;
+
+        int y = 0, m = 1, d = 1;
+        if constexpr (ByYear || Part != YearPart::kNone)
+            civil_from_days(day, y, m, d);
+        size_t g = size_t(part_of<Part>(y, m, d));
+        if constexpr (ByYear)
+            g += size_t(y - out.first_year) * parts;
+
+        GroupStats& s = groups[g];
+        s.count++;
+        if constexpr ((Aggs & kAggSum) != 0)
+            s.sum += v;
+        if constexpr ((Aggs & kAggAbove) != 0)
+            for (int t = 0; t < q.n_thresholds; ++t)
+                s.above[t] += v > q.thresholds[t];
+        if constexpr ((Aggs & (kAggMin | kAggArgMin)) != 0)
+            if (v < s.min) {
+                s.min = v;
+                s.argmin = day;
+            }
+        if constexpr ((Aggs & (kAggMax | kAggArgMax)) != 0)
+            if (v > s.max) {
+                s.max = v;
+                s.argmax = day;
+            }
+    }
+}
+
+using ScanFn = void (*)(const StationStore&, const GroupQuery&, GroupResult&);
+
+// The aggregate sets with their own loop, smallest first:
+//   the mean (FalunVSFalsterbo, temperature_given_day)
+//   min/max with their days (warmest_coldest)
+//   sum, min, max and count above (the monthly rain analysis)
+constexpr unsigned kCommonAggs[] = {
+    kAggSum | kAggCount,
+    kAggMin | kAggMax | kAggArgMin | kAggArgMax | kAggCount,
+    kAggSum | kAggMin | kAggMax | kAggAbove | kAggCount,
+};
+
+template <bool ByYear, YearPart Part>
+ScanFn pick_aggs(unsigned aggs) {
+    aggs |= kAggCount;
+    if ((aggs & ~kCommonAggs[0]) == 0) return scan<ByYear, Part, kCommonAggs[0]>;
+    if ((aggs & ~kCommonAggs[1]) == 0) return scan<ByYear, Part, kCommonAggs[1]>;
+    if ((aggs & ~kCommonAggs[2]) == 0) return scan<ByYear, Part, kCommonAggs[2]>;
+    return scan<ByYear, Part, kAggAll>;
+}
+
+template <bool ByYear>
+ScanFn pick_part(YearPart part, unsigned aggs) {
+    switch (part) {
+    case YearPart::kMonth: return pick_aggs<ByYear, YearPart::kMonth>(aggs);
+    case YearPart::kDayOfYear: return pick_aggs<ByYear, YearPart::kDayOfYear>(aggs);
+    case YearPart::kSeason: return pick_aggs<ByYear, YearPart::kSeason>(aggs);
+    default: return pick_aggs<ByYear, YearPart::kNone>(aggs);
+    }
+}
+
+} // namespace detail
+
+// Runs the query over rows q.row_begin..q.row_end of the store.
+inline GroupResult run_group_query(const StationStore& store, const GroupQuery& q) {
+    GroupResult out;
+    out.parts = year_part_count(q.part);
+    size_t years = 1;
+    if (q.by_year && q.row_end > q.row_begin) {
+        // the range of years that can occur, so the groups fit in one array
+        const int32_t* date = store.date();
+        int32_t lo = date[q.row_begin], hi = lo;
+        for (size_t i = q.row_begin; i < q.row_end; ++i) {
+            lo = date[i] < lo ? date[i] : lo;
+            hi = date[i] > hi ? date[i] : hi;
+        }
+        lo = lo < q.from ? q.from : lo;
+        hi = hi > q.to ? q.to : hi;
+        int last_year, m, d;
+        civil_from_days(lo, out.first_year, m, d);
+        civil_from_days(hi, last_year, m, d);
+        years = lo <= hi ? size_t(last_year - out.first_year + 1) : 0;
+    }
+    out.groups.resize(years * size_t(out.parts));
+    if (out.groups.empty())
+        return out;
+
+    const detail::ScanFn scan = q.by_year ? detail::pick_part<true>(q.part, q.aggs)
+                                          : detail::pick_part<false>(q.part, q.aggs);
+    scan(store, q, out);
+    return out;
+}
+
+// "06,18" -> {6, 18}; "all" -> {} (every hour)
+inline bool parse_hours(const std::string& list, std::vector<uint8_t>& hours) {
+    hours.clear();
+    if (list == "all")
+        return true;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        const uint8_t h = time_code_from_text(item.size() == 1 ? "0" + item : item);
+        if (h == kNoTime)
+            return false;
+        hours.push_back(h);
+    }
+    return !hours.empty();
+}
+
+// "06,18" -> bits 6 and 18; "all" -> 0 (every row), as in GroupQuery::hours
+inline bool parse_hours(const std::string& list, uint32_t& hours) {
+    std::vector<uint8_t> list_hours;
+    if (!parse_hours(list, list_hours))
+        return false;
+    hours = 0;
+    for (const uint8_t h : list_hours)
+        hours |= uint32_t(1) << h;
+    return true;
+}
+
+// "datasets/Falun.csv" -> "Falun"
+inline std::string station_name(const std::string& path) {
+    const size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return name.substr(0, name.rfind('.'));
+}
+
+// Opens the binary copy of station.csv for a query on one of its columns: sets q.column, and
+// q.row_begin..q.row_end to the rows of the months in q.from..q.to if the month index
+// (station.idx) belongs to the store, else to all rows. Returns an error message, empty if fine.
+inline std::string open_station_query(const std::string& csv_path, const std::string& column, StationStore& store,
+                                      GroupQuery& q) {
+    if (!store.open(store_path_for(csv_path)))
+        return "no binary file " + store_path_for(csv_path) + ", run the cleaner first";
+    const int c = store.column_index(column);
+    if (c < 0)
+        return "no column " + column;
+    q.column = size_t(c);
+    q.row_begin = 0;
+    q.row_end = store.rows();
+
+    DateIndex index;
+    if ((q.from != std::numeric_limits<int32_t>::min() || q.to != std::numeric_limits<int32_t>::max()) &&
+        index.load(index_path_for(csv_path)) && index.matches_store(store.rows())) {
+        const DateRange r = index.days(q.from, q.to);
+        q.row_begin = r.row_begin;
+        q.row_end = r.row_end;
+    }
+    return "";
+}
+
+} // namespace smhi
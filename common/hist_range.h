@@ -0,0 +1,23 @@
+#pragma once
+// The range of the temperature histograms of the macros.
+//
+// The histograms used to be fixed at -10..10 degrees, which lost the values of warm or cold days.
+// They keep 1 degree bins from at least -10 to 10, and grow to whole degrees around the values.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace smhi {
+
+inline double hist_low(const std::vector<double>& v) {
+    return v.empty() ? -10 : std::min(-10.0, std::floor(*std::min_element(v.begin(), v.end())));
+}
+
+inline double hist_high(const std::vector<double>& v) {
+    return v.empty() ? 10 : std::max(10.0, std::floor(*std::max_element(v.begin(), v.end())) + 1);
+}
+
+inline int hist_bins(const std::vector<double>& v) { return int(hist_high(v) - hist_low(v)); }
+
+} // namespace smhi
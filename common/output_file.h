@@ -0,0 +1,112 @@
+#pragma once
+// Buffered output file and fast number formatting.
+//
+// Text is collected in one large buffer that is reused and written with a single fwrite() per
+// megabyte, instead of going through ofstream << with a flush (std::endl) after every line.
+// Numbers are formatted with std::to_chars, which needs no locale and no format string:
+//     kShortest     the shortest text that reads back as exactly the same double (0.1 -> "0.1")
+//     kFixed, N     N digits after the point, like printf("%.Nf")
+//     kGeneral, N   N significant digits, like printf("%.Ng") and like ofstream << (N = 6)
+// Missing values (NaN) are written as nothing, as in the cleaned files.
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace smhi {
+
+enum class NumberFormat { kShortest, kFixed, kGeneral };
+
+inline void append_number(std::string& out, double v, NumberFormat format = NumberFormat::kShortest, int precision = 6) {
+    if (std::isnan(v))
+        return;
+    char text[64];
+    std::to_chars_result r;
+    if (format == NumberFormat::kFixed && std::fabs(v) < 1e30)
+        r = std::to_chars(text, text + sizeof text, v, std::chars_format::fixed, precision);
+    else if (format == NumberFormat::kGeneral)
+        r = std::to_chars(text, text + sizeof text, v, std::chars_format::general, precision);
+    else
+        r = std::to_chars(text, text + sizeof text, v);
+    out.append(text, size_t(r.ptr - text));
+}
+
+inline void append_integer(std::string& out, int64_t v) {
+    char text[24];
+    const std::to_chars_result r = std::to_chars(text, text + sizeof text, v);
+    out.append(text, size_t(r.ptr - text));
+}
+
+class OutputFile {
+public:
+    OutputFile() = default;
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile() { close(); }
+
+    // Returns false if the file can't be created.
+    bool open(const std::string& path) {
+        close();
+        file_ = std::fopen(path.c_str(), "wb");
+        written_ = 0;
+        failed_ = false;
+        buffer_.clear();
+        buffer_.reserve(kFlushSize + 4096);
+        return file_ != nullptr;
+    }
+
+    void append(std::string_view text) {
+        buffer_.append(text.data(), text.size());
+        flush_if_full();
+    }
+    void put(char c) {
+        buffer_.push_back(c);
+        flush_if_full();
+    }
+    void number(double v, NumberFormat format = NumberFormat::kShortest, int precision = 6) {
+        append_number(buffer_, v, format, precision);
+        flush_if_full();
+    }
+    void integer(int64_t v) {
+        append_integer(buffer_, v);
+        flush_if_full();
+    }
+
+    // bytes written so far, including those still in the buffer (the offset of the next byte)
+    uint64_t written() const { return written_ + buffer_.size(); }
+
+    // Writes the rest and closes the file. Returns false if anything could not be written.
+    bool close() {
+        if (!file_)
+            return !failed_;
+        flush();
+        failed_ = std::ferror(file_) != 0 || failed_;
+        failed_ = std::fclose(file_) != 0 || failed_;
+        file_ = nullptr;
+        return !failed_;
+    }
+
+private:
+    static constexpr size_t kFlushSize = 1 << 20;
+
+    void flush_if_full() {
+        if (buffer_.size() >= kFlushSize)
+            flush();
+    }
+    void flush() {
+        if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size())
+            failed_ = true;
+        written_ += buffer_.size();
+        buffer_.clear();
+    }
+
+    FILE* file_ = nullptr;
+    std::string buffer_;
+    uint64_t written_ = 0;
+    bool failed_ = false;
+};
+
+} // namespace smhi
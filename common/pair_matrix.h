@@ -0,0 +1,161 @@
+#pragma once
+// Comparison of every pair of many stations at once: over the periods (years or months) where
+// both have a mean, the mean difference, the correlation and the trend of the difference.
+//
+// The means are kept in a PeriodTable with one row per station over the same periods. A pair
+// needs ten sums over its common periods (n, sum a, sum b, sum a*a, ..., sum t*b), and each
+// of them is a dot product of a row of one station with a row of the other if every station
+// keeps six rows: the mask m (1 = has a mean, 0 = missing), the mean x (0 when missing), x*x,
+// t*m, t*x and t*t*m, with t the period number. Missing periods then drop out without a branch,
+// and all pairs together are a product of the table with itself, computed like a matrix product:
+// the stations are cut into blocks whose rows fit in the cache together, every pair of blocks is
+// one task for parallel_for, and the rows start on 64-byte boundaries and are padded to a
+// multiple of 8 periods so the inner loop runs over whole vectors.
+//
+//     smhi::PeriodTable table(stations, periods);
+//     if (!table.allocated()) ...                     // out of memory
+//     table.set(s, p, mean);                          // for every station and period with a mean
+//     std::vector<smhi::PairStats> pairs = table.compare(3, threads);
+//     pairs[smhi::pair_index(a, b, stations)]         // a < b
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+namespace smhi {
+
+struct PairStats {
+    uint32_t periods = 0;     // periods where both stations have a mean
+    double mean_diff = NAN;   // mean of a - b
+    double correlation = NAN; // Pearson correlation of a and b
+    double trend = NAN;       // least squares slope of a - b, per period
+};
+
+// position of the pair a < b of n stations in the result of compare()
+inline size_t pair_index(size_t a, size_t b, size_t n) { return a * (2 * n - a - 1) / 2 + (b - a - 1); }
+
+class PeriodTable {
+public:
+    PeriodTable(size_t stations, size_t periods)
+        : stations_(stations), periods_(periods), stride_((periods + 7) / 8 * 8),
+          data_(static_cast<double*>(std::aligned_alloc(64, std::max<size_t>(8, stations * kRows * stride_) * sizeof(double)))) {
+        if (data_)
+            std::fill(data_.get(), data_.get() + stations * kRows * stride_, 0.0);
+    }
+
+    // false if the memory for the table could not be had; the table must not be used then
+    bool allocated() const { return data_ != nullptr; }
+
+    size_t stations() const { return stations_; }
+    size_t periods() const { return periods_; }
+
+    // The mean of a station in a period; NaN leaves the period missing. Different stations may
+    // be set from different threads.
+    void set(size_t station, size_t period, double value) {
+        if (std::isnan(value))
+            return;
+        // t is counted from the middle, which keeps the sums of t*t small
+        const double t = double(period) - 0.5 * double(periods_ - 1);
+        double* r = row(station, 0);
+        r[kMask * stride_ + period] = 1;
+        r[kValue * stride_ + period] = value;
+        r[kSquare * stride_ + period] = value * value;
+        r[kTime * stride_ + period] = t;
+        r[kTimeValue * stride_ + period] = t * value;
+        r[kTimeSquare * stride_ + period] = t * t;
+    }
+
+    // The statistics of every pair a < b, at pair_index(a, b, stations()). Pairs with fewer than
+    // min_periods common periods only get their number of periods.
+    std::vector<PairStats> compare(uint32_t min_periods, unsigned threads) const {
+        const size_t n = stations_;
+        std::vector<PairStats> pairs(n < 2 ? 0 : n * (n - 1) / 2);
+        // two blocks of rows should stay in a 512 kB cache
+        const size_t station_bytes = kRows * stride_ * sizeof(double);
+        const size_t block = std::max<size_t>(4, std::min<size_t>(256, (512 * 1024) / (2 * std::max<size_t>(1, station_bytes))));
+        const size_t blocks = (n + block - 1) / block;
+        std::vector<std::pair<size_t, size_t>> tasks;
+        for (size_t i = 0; i < blocks; ++i)
+            for (size_t j = i; j < blocks; ++j)
+                tasks.emplace_back(i, j);
+
+        parallel_for(tasks.size(), threads, [&](size_t k, unsigned) {
+            const size_t a0 = tasks[k].first * block, a1 = std::min(n, a0 + block);
+            const size_t b0 = tasks[k].second * block, b1 = std::min(n, b0 + block);
+            for (size_t a = a0; a < a1; ++a)
+                for (size_t b = std::max(b0, a + 1); b < b1; ++b)
+                    pairs[pair_index(a, b, n)] = compare_pair(a, b, min_periods);
+        });
+        return pairs;
+    }
+
+private:
+    enum Row { kMask, kValue, kSquare, kTime, kTimeValue, kTimeSquare, kRows };
+
+    struct Free {
+        void operator()(double* p) const { std::free(p); }
+    };
+
+    double* row(size_t station, int r) const { return data_.get() + (station * kRows + size_t(r)) * stride_; }
+
+    PairStats compare_pair(size_t a, size_t b, uint32_t min_periods) const {
+        const double* am = row(a, kMask);
+        const double* ax = row(a, kValue);
+        const double* aq = row(a, kSquare);
+        const double* at = row(a, kTime);
+        const double* atx = row(a, kTimeValue);
+        const double* att = row(a, kTimeSquare);
+        const double* bm = row(b, kMask);
+        const double* bx = row(b, kValue);
+        const double* bq = row(b, kSquare);
+
+        // four partial sums each, so the additions don't wait on each other and can be
+        // done as vectors without reordering them (the results don't depend on the compiler)
+        enum { kN, kA, kB, kAA, kBB, kAB, kT, kTT, kTA, kTB, kSums };
+        double s[kSums][4] = {};
+        for (size_t p = 0; p < stride_; p += 4)
+            for (size_t l = 0; l < 4; ++l) {
+                const size_t i = p + l;
+                s[kN][l] += am[i] * bm[i];
+                s[kA][l] += ax[i] * bm[i];
+                s[kB][l] += am[i] * bx[i];
+                s[kAA][l] += aq[i] * bm[i];
+                s[kBB][l] += am[i] * bq[i];
+                s[kAB][l] += ax[i] * bx[i];
+                s[kT][l] += at[i] * bm[i];
+                s[kTT][l] += att[i] * bm[i];
+                s[kTA][l] += atx[i] * bm[i];
+                s[kTB][l] += at[i] * bx[i];
+            }
+        double sum[kSums];
+        for (int k = 0; k < kSums; ++k)
+            sum[k] = (s[k][0] + s[k][1]) + (s[k][2] + s[k][3]);
+
+        PairStats out;
+        const double n = sum[kN];
+        out.periods = uint32_t(std::llround(n));
+        if (out.periods == 0 || out.periods < min_periods)
+            return out;
+        out.mean_diff = (sum[kA] - sum[kB]) / n;
+        const double var_a = n * sum[kAA] - sum[kA] * sum[kA];
+        const double var_b = n * sum[kBB] - sum[kB] * sum[kB];
+        if (var_a > 0 && var_b > 0)
+            out.correlation = (n * sum[kAB] - sum[kA] * sum[kB]) / std::sqrt(var_a * var_b);
+        // slope of d = a - b over t: (n sum t*d - sum t sum d) / (n sum t*t - (sum t)^2)
+        const double var_t = n * sum[kTT] - sum[kT] * sum[kT];
+        if (var_t > 0)
+            out.trend = (n * (sum[kTA] - sum[kTB]) - sum[kT] * (sum[kA] - sum[kB])) / var_t;
+        return out;
+    }
+
+    size_t stations_, periods_, stride_;
+    std::unique_ptr<double[], Free> data_; // [station][row][period], rows of stride_ doubles
+};
+
+} // namespace smhi
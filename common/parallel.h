@@ -0,0 +1,48 @@
+#pragma once
+// Small thread helper shared by the tools that work on many stations or files at once.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace smhi {
+
+// Number of threads to use when the user did not ask for a specific number.
+inline unsigned default_threads() {
+    const unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Calls task(i, worker) for every i in [0, n) using up to n_threads threads
+// (0 = one per core). Tasks are handed out one at a time from a shared counter,
+// so a thread that finishes a small task simply takes the next one and a single
+// large task never holds up the rest. worker is the index of the calling thread
+// in [0, n_threads), handy for per-thread scratch space.
+template <class Task>
+void parallel_for(size_t n, unsigned n_threads, Task task) {
+    if (n_threads == 0)
+        n_threads = default_threads();
+    n_threads = unsigned(std::min<size_t>(n_threads, n));
+    if (n_threads <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            task(i, 0u);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto work = [&](unsigned worker) {
+        for (size_t i = next++; i < n; i = next++)
+            task(i, worker);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < n_threads; ++t)
+        threads.emplace_back(work, t);
+    work(0);
+    for (auto& t : threads)
+        t.join();
+}
+
+} // namespace smhi
@@ -0,0 +1,68 @@
+#pragma once
+// Copies station stores (the .bin files of the cleaners, see station_store.h) into a ROOT TTree,
+// so RDataFrame and TTree::Draw can read the data column by column on all cores.
+//
+// Needs ROOT: include it from a macro (see rdf_analysis.C) or build a tool with
+//     g++ -DWITH_ROOT tool.cxx $(root-config --cflags --libs)
+//
+// Every row of a store becomes one entry with the branches
+//     station (string), day (days since 1970-01-01), year, month, mday, doy (1..366),
+//     hour (-1 when the file has no time of day)
+// and one Double_t branch per value column (e.g. "temperature"), NaN when missing.
+
+#include <string>
+#include <vector>
+
+#include <TTree.h>
+
+#include "station_store.h"
+
+namespace smhi {
+
+class StoreTreeWriter {
+public:
+    // Creates the branches in tree. Stores added later may have their columns in any
+    // order; columns that a store does not have are filled with NaN.
+    StoreTreeWriter(TTree* tree, const std::vector<std::string>& columns)
+        : tree_(tree), columns_(columns), values_(columns.size()) {
+        tree_->Branch("station", &station_);
+        tree_->Branch("day", &day_, "day/I");
+        tree_->Branch("year", &year_, "year/I");
+        tree_->Branch("month", &month_, "month/I");
+        tree_->Branch("mday", &mday_, "mday/I");
+        tree_->Branch("doy", &doy_, "doy/I");
+        tree_->Branch("hour", &hour_, "hour/I");
+        for (size_t c = 0; c < columns_.size(); ++c)
+            tree_->Branch(columns_[c].c_str(), &values_[c], (columns_[c] + "/D").c_str());
+    }
+
+    // Fills one entry per row of store, all with the given station name. Returns the number of entries.
+    Long64_t add(const StationStore& store, const std::string& station) {
+        std::vector<int> source(columns_.size());
+        for (size_t c = 0; c < columns_.size(); ++c)
+            source[c] = store.column_index(columns_[c]);
+
+        station_ = station;
+        const int32_t* date = store.date();
+        const uint8_t* time = store.time_code();
+        for (size_t i = 0; i < store.rows(); ++i) {
+            day_ = date[i];
+            civil_from_days(date[i], year_, month_, mday_);
+            doy_ = day_of_year(year_, month_, mday_);
+            hour_ = time[i] == kNoTime ? -1 : int(time[i]);
+            for (size_t c = 0; c < columns_.size(); ++c)
+                values_[c] = source[c] < 0 ? NAN : store.value(size_t(source[c]), i);
+            tree_->Fill();
+        }
+        return Long64_t(store.rows());
+    }
+
+private:
+    TTree* tree_;
+    std::vector<std::string> columns_;
+    std::string station_;
+    int day_ = 0, year_ = 0, month_ = 0, mday_ = 0, doy_ = 0, hour_ = -1;
+    std::vector<double> values_; // never resized, the branches point into it
+};
+
+} // namespace smhi
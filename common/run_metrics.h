@@ -0,0 +1,270 @@
+#pragma once
+// Counters and timers of one run of a tool, written as a JSON report at the end.
+//
+//     smhi::RunMetrics metrics("cleaning_data");   // report to $SMHI_METRICS, if it is set
+//     metrics.set_path(path);                      // or to the file of a --metrics option
+//     {
+//         auto phase = metrics.phase("read");      // wall and CPU time until the end of the block
+//         ...
+//         phase = metrics.phase("write");          // (or until the next phase, or phase.stop())
+//     }
+//     metrics.count("rows_read", n);
+//     metrics.failure("bad_temperature", bad);     // rows left out, by reason
+//     metrics.count_file("bytes_out", "Falun.csv");
+//
+// The report is written when the object goes out of scope, so a run that stops with an error
+// still leaves one. It looks like
+//     {"tool": "cleaning_data", "started": "2024-05-01T10:00:00Z", "wall_s": 1.234, "cpu_s": 3.456,
+//      "peak_rss_kb": 51200, "counters": {"rows_read": 120000, ...}, "failures": {...},
+//      "phases": [{"name": "read", "calls": 1, "wall_s": 0.5, "cpu_s": 1.9}, ...]}
+// The CPU time is that of the whole process (all threads), also within a phase, so cpu_s / wall_s
+// of a phase tells how many cores it kept busy. Counters and failures may be added from any
+// thread, but in a hot loop they should be added up locally and passed once per file or piece.
+// Without a path nothing is written and the calls cost next to nothing.
+//
+// The pipeline runner (pipeline.cxx) sets SMHI_METRICS for every stage and collects the
+// reports of the stages in CACHE/metrics.json.
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace smhi {
+
+// CPU time used so far by all threads of the process, in seconds
+inline double process_cpu_seconds() {
+    timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return double(ts.tv_sec) + 1e-9 * double(ts.tv_nsec);
+}
+
+// CPU time used so far by the child processes that have been waited for, in seconds
+inline double children_cpu_seconds() {
+    rusage usage;
+    if (getrusage(RUSAGE_CHILDREN, &usage) != 0)
+        return 0;
+    return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           1e-6 * double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+// the largest resident memory of the process so far, in kB (who = RUSAGE_CHILDREN: of the largest
+// child process that has been waited for)
+inline long peak_rss_kb(int who = RUSAGE_SELF) {
+    rusage usage;
+    if (getrusage(who, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss; // in kilobytes on Linux
+}
+
+// text as a JSON string, with the quotes
+inline std::string json_string(const std::string& text) {
+    std::string out = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\')
+            out.append(1, '\\').append(1, c);
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof escaped, "\\u%04x", unsigned(c));
+            out += escaped;
+        }
+        else
+            out += c;
+    }
+    return out + "\"";
+}
+
+class RunMetrics {
+public:
+    explicit RunMetrics(std::string tool) : tool_(std::move(tool)) {
+        const char* path = std::getenv("SMHI_METRICS");
+        if (path)
+            path_ = path;
+        started_ = std::time(nullptr);
+        wall_start_ = std::chrono::steady_clock::now();
+        cpu_start_ = process_cpu_seconds();
+    }
+    RunMetrics(const RunMetrics&) = delete;
+    RunMetrics& operator=(const RunMetrics&) = delete;
+    ~RunMetrics() {
+        if (!path_.empty() && !write(path_))
+            std::fprintf(stderr, "Can't write the metrics to %s\n", path_.c_str());
+    }
+
+    // where the report goes (empty: nowhere)
+    void set_path(const std::string& path) { path_ = path; }
+    bool enabled() const { return !path_.empty(); }
+
+    void count(const std::string& name, uint64_t n = 1) { add(counters_, name, n); }
+    void failure(const std::string& reason, uint64_t n = 1) { add(failures_, reason, n); }
+    // adds the size of a file, e.g. to "bytes_in" or "bytes_out"; nothing if it does not exist
+    void count_file(const std::string& name, const std::string& path) {
+        if (!enabled())
+            return;
+        FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f)
+            return;
+        if (std::fseek(f, 0, SEEK_END) == 0) {
+            const long size = std::ftell(f);
+            if (size > 0)
+                count(name, uint64_t(size));
+        }
+        std::fclose(f);
+    }
+
+    // Times the code until the Phase goes out of scope (or stop()). A phase that is timed more
+    // than once is added up.
+    class Phase {
+    public:
+        Phase(RunMetrics& metrics, std::string name)
+            : metrics_(&metrics), name_(std::move(name)), wall_start_(std::chrono::steady_clock::now()),
+              cpu_start_(process_cpu_seconds()) {}
+        Phase(Phase&& other) noexcept
+            : metrics_(other.metrics_), name_(std::move(other.name_)), wall_start_(other.wall_start_),
+              cpu_start_(other.cpu_start_) {
+            other.metrics_ = nullptr;
+        }
+        // stops this phase and goes on with the other: phase = metrics.phase("write");
+        Phase& operator=(Phase&& other) noexcept {
+            if (this != &other) {
+                stop();
+                metrics_ = other.metrics_;
+                name_ = std::move(other.name_);
+                wall_start_ = other.wall_start_;
+                cpu_start_ = other.cpu_start_;
+                other.metrics_ = nullptr;
+            }
+            return *this;
+        }
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+        ~Phase() { stop(); }
+
+        void stop() {
+            if (!metrics_)
+                return;
+            const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start_;
+            metrics_->add_phase(name_, wall.count(), process_cpu_seconds() - cpu_start_);
+            metrics_ = nullptr;
+        }
+
+    private:
+        RunMetrics* metrics_;
+        std::string name_;
+        std::chrono::steady_clock::time_point wall_start_;
+        double cpu_start_;
+    };
+    Phase phase(const std::string& name) { return Phase(*this, name); }
+
+    // Adds a member with JSON text of its own to the end of the report, e.g. the reports of
+    // other runs: add_json("stages", "[...]").
+    void add_json(const std::string& name, std::string json) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        extra_.emplace_back(name, std::move(json));
+    }
+
+    // the report as it would be written now
+    std::string json() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wall_start_;
+        char started[32];
+        tm utc;
+        gmtime_r(&started_, &utc);
+        std::strftime(started, sizeof started, "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+        std::string out = "{\n  \"tool\": " + json_string(tool_) + ",\n  \"started\": \"" + started + "\",\n";
+        out += "  \"wall_s\": " + seconds(wall.count()) + ",\n";
+        out += "  \"cpu_s\": " + seconds(process_cpu_seconds() - cpu_start_) + ",\n";
+        out += "  \"peak_rss_kb\": " + std::to_string(peak_rss_kb()) + ",\n";
+        out += "  \"counters\": " + object(counters_) + ",\n";
+        out += "  \"failures\": " + object(failures_) + ",\n";
+        out += "  \"phases\": [";
+        for (size_t i = 0; i < phases_.size(); ++i) {
+            const PhaseTotal& p = phases_[i];
+            out += i == 0 ? "\n" : ",\n";
+            out += "    {\"name\": " + json_string(p.name) + ", \"calls\": " + std::to_string(p.calls) +
+                   ", \"wall_s\": " + seconds(p.wall) + ", \"cpu_s\": " + seconds(p.cpu) + "}";
+        }
+        out += phases_.empty() ? "]" : "\n  ]";
+        for (const auto& e : extra_)
+            out += ",\n  " + json_string(e.first) + ": " + e.second;
+        return out + "\n}\n";
+    }
+
+    // Writes the report to path (through a temporary file, so a reader never sees half of it).
+    bool write(const std::string& path) const {
+        const std::string text = json();
+        const std::string tmp = path + ".tmp";
+        FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f)
+            return false;
+        const bool written = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+        if (std::fclose(f) != 0 || !written) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    using Counters = std::vector<std::pair<std::string, uint64_t>>; // in the order they first appear
+    struct PhaseTotal {
+        std::string name;
+        uint64_t calls = 0;
+        double wall = 0, cpu = 0;
+    };
+
+    void add(Counters& counters, const std::string& name, uint64_t n) {
+        if (!enabled())
+            return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& c : counters)
+            if (c.first == name) {
+                c.second += n;
+                return;
+            }
+        counters.emplace_back(name, n);
+    }
+    void add_phase(const std::string& name, double wall, double cpu) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& p : phases_)
+            if (p.name == name) {
+                p.calls++;
+                p.wall += wall;
+                p.cpu += cpu;
+                return;
+            }
+        phases_.push_back({name, 1, wall, cpu});
+    }
+
+    static std::string seconds(double s) {
+        char text[32];
+        std::snprintf(text, sizeof text, "%.6f", s);
+        return text;
+    }
+    static std::string object(const Counters& counters) {
+        std::string out = "{";
+        for (size_t i = 0; i < counters.size(); ++i)
+            out += (i == 0 ? "" : ", ") + json_string(counters[i].first) + ": " + std::to_string(counters[i].second);
+        return out + "}";
+    }
+
+    std::string tool_, path_;
+    std::time_t started_;
+    std::chrono::steady_clock::time_point wall_start_;
+    double cpu_start_;
+    mutable std::mutex mutex_;
+    Counters counters_, failures_;
+    std::vector<PhaseTotal> phases_;
+    std::vector<std::pair<std::string, std::string>> extra_;
+};
+
+} // namespace smhi
@@ -0,0 +1,92 @@
+#pragma once
+// Date helpers shared by the cleaners and analysis tools.
+//
+// Dates are stored as a "day ordinal": the number of days since 1970-01-01.
+// Consecutive days have consecutive ordinals, so a whole date fits in one int
+// and comparing or subtracting dates is plain integer arithmetic.
+//
+// Everything here is plain arithmetic and lookup tables: no mktime(), no time zone,
+// no string copies. parse_ymd() reads the digits of "YYYY-MM-DD" from fixed offsets.
+
+#include <cstdint>
+
+namespace smhi {
+
+constexpr bool is_leap(int y) { return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0; }
+
+// kMonthDays[leap][m] = number of days in month m (1..12)
+constexpr int kMonthDays[2][13] = {
+    {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
+    {0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
+};
+
+// kDaysBeforeMonth[leap][m] = days in the year before the 1st of month m (1..12)
+constexpr int kDaysBeforeMonth[2][13] = {
+    {0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334},
+    {0, 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335},
+};
+
+// Day of the year, 1 for January 1st (what mktime() gives as tm_yday + 1).
+constexpr int day_of_year(int y, int m, int d) { return kDaysBeforeMonth[is_leap(y)][m] + d; }
+
+static_assert(day_of_year(2023, 12, 31) == 365 && day_of_year(2024, 12, 31) == 366, "day_of_year");
+static_assert(day_of_year(2000, 3, 1) == 61 && day_of_year(1900, 3, 1) == 60, "leap years");
+
+// Reads "YYYY-MM-DD" from the first 10 characters at p (no terminating zero needed).
+// All digits are converted first and checked together at the end, so a valid date
+// costs no branches per character. Returns false for anything that is not a real date.
+inline bool parse_ymd(const char* p, int& y, int& m, int& d) {
+    const unsigned y0 = unsigned(p[0] - '0'), y1 = unsigned(p[1] - '0');
+    const unsigned y2 = unsigned(p[2] - '0'), y3 = unsigned(p[3] - '0');
+    const unsigned m0 = unsigned(p[5] - '0'), m1 = unsigned(p[6] - '0');
+    const unsigned d0 = unsigned(p[8] - '0'), d1 = unsigned(p[9] - '0');
+    // a non-digit gives a value above 9 (unsigned wrap-around for characters below '0')
+    const bool digits = !((y0 > 9) | (y1 > 9) | (y2 > 9) | (y3 > 9) | (m0 > 9) | (m1 > 9) | (d0 > 9) | (d1 > 9));
+    y = int(y0 * 1000 + y1 * 100 + y2 * 10 + y3);
+    m = int(m0 * 10 + m1);
+    d = int(d0 * 10 + d1);
+    return digits & (p[4] == '-') & (p[7] == '-') & (m >= 1) & (m <= 12) & (d >= 1) &&
+           d <= kMonthDays[is_leap(y)][m];
+}
+
+// Converts a calendar date (e.g. 1961, 1, 26) into a day ordinal.
+// Works for any year in the proleptic Gregorian calendar.
+inline int32_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;                                   // [0, 399]
+    const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;  // [0, 365]
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;           // [0, 146096]
+    return era * 146097 + doe - 719468;
+}
+
+// The inverse of days_from_civil: turns a day ordinal back into year, month and day.
+inline void civil_from_days(int32_t z, int& y, int& m, int& d) {
+    z += 719468;
+    const int era = (z >= 0 ? z : z - 146096) / 146097;
+    const int doe = z - era * 146097;                                      // [0, 146096]
+    const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // [0, 399]
+    const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);               // [0, 365]
+    const int mp  = (5 * doy + 2) / 153;                                   // [0, 11]
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = yoe + era * 400 + (m <= 2);
+}
+
+// Parses "YYYY-MM-DD" at p straight into a day ordinal.
+inline bool parse_date(const char* p, int32_t& day) {
+    int y, m, d;
+    if (!parse_ymd(p, y, m, d))
+        return false;
+    day = days_from_civil(y, m, d);
+    return true;
+}
+
+// Day of the year (1..366) of a day ordinal.
+inline int day_of_year(int32_t day) {
+    int y, m, d;
+    civil_from_days(day, y, m, d);
+    return day_of_year(y, m, d);
+}
+
+} // namespace smhi
@@ -0,0 +1,299 @@
+#pragma once
+// The grid points of a multi-column SMHI file (SMHI_pthbv_p_t_..._4326.csv) and a spatial index
+// over them, to pick the columns of a place or a region by its coordinates instead of by hand.
+//
+// The first line of the pthbv file gives the coordinates of every column:
+//
+//   N, E (WGS 84);55.705, 13.191;55.705, 13.191;59.859, 17.639;59.859, 17.639
+//
+// with a rain and a temperature column for each grid point. The cleaner keeps them in a small
+// text file next to the cleaned CSV (Rain_temperature_cleaned.csv -> .points), one line per grid
+// point in the order of the columns, so grid point i has the columns rain_<name>_mm and
+// temp_<name>_C, the CSV columns 2i+1 and 2i+2 and the .bin columns 2i and 2i+1:
+//
+//   # grid points of Rain_temperature_cleaned.csv, written by the cleaner
+//   Lund;55.705;13.191
+//   ...
+//
+// SpatialIndex puts the points into buckets of a regular latitude/longitude grid, about two
+// points per bucket, so a query only looks at the buckets around the place it asks for:
+//
+//     smhi::SpatialIndex index(points);
+//     index.nearest(59.33, 18.07);                 // the closest grid point (and its distance)
+//     index.within(59.33, 18.07, 30);              // every point within 30 km, closest first
+//     index.in_box(55.3, 56.5, 12.4, 14.6);        // every point in a latitude/longitude box
+//
+// Distances are great circle distances in km. Boxes and circles do not wrap around the 180th
+// meridian, which no Swedish grid comes near.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "decimal_parse.h"
+#include "station_store.h"
+
+namespace smhi {
+
+constexpr double kEarthRadiusKm = 6371.0;
+
+struct GridPoint {
+    std::string name;
+    double lat = NAN, lon = NAN; // degrees north and east
+};
+
+// "Rain_temperature_cleaned.csv" -> "Rain_temperature_cleaned.points"
+inline std::string points_path_for(const std::string& csv_path) {
+    std::string path = store_path_for(csv_path);
+    return path.replace(path.size() - 4, 4, ".points");
+}
+
+// great circle distance between two points, in km
+inline double distance_km(double lat1, double lon1, double lat2, double lon2) {
+    constexpr double rad = M_PI / 180;
+    const double s_lat = std::sin((lat2 - lat1) * rad / 2);
+    const double s_lon = std::sin((lon2 - lon1) * rad / 2);
+    const double h = s_lat * s_lat + std::cos(lat1 * rad) * std::cos(lat2 * rad) * s_lon * s_lon;
+    return 2 * kEarthRadiusKm * std::asin(std::min(1.0, std::sqrt(h)));
+}
+
+// The coordinates of every data column from the first line of a pthbv file (the first field is
+// the "N, E (WGS 84)" label). Returns false if a field is not "lat, lon".
+inline bool parse_coordinate_row(std::string_view line, std::vector<GridPoint>& columns) {
+    columns.clear();
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+        line.remove_suffix(1);
+    auto trimmed = [](std::string_view s) {
+        const size_t a = s.find_first_not_of(" \t");
+        return a == std::string_view::npos ? std::string_view() : s.substr(a, s.find_last_not_of(" \t") - a + 1);
+    };
+    size_t start = line.find(';');
+    while (start != std::string_view::npos) {
+        const size_t end = line.find(';', start + 1);
+        const std::string_view field = line.substr(start + 1, end == std::string_view::npos ? end : end - start - 1);
+        const size_t comma = field.find(',');
+        GridPoint p;
+        if (comma == std::string_view::npos || !parse_decimal(trimmed(field.substr(0, comma)), p.lat) ||
+            !parse_decimal(trimmed(field.substr(comma + 1)), p.lon) || std::fabs(p.lat) > 90 || std::fabs(p.lon) > 180)
+            return false;
+        columns.push_back(p);
+        start = end;
+    }
+    return !columns.empty();
+}
+
+inline bool save_grid_points(const std::string& path, const std::string& csv_name, const std::vector<GridPoint>& points) {
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    std::fprintf(f, "# grid points of %s, written by the cleaner\n", csv_name.c_str());
+    for (const GridPoint& p : points)
+        std::fprintf(f, "%s;%.10g;%.10g\n", p.name.c_str(), p.lat, p.lon);
+    const bool failed = std::ferror(f) != 0;
+    return std::fclose(f) == 0 && !failed;
+}
+
+// Returns false if there is no points file or a line can't be read.
+inline bool load_grid_points(const std::string& path, std::vector<GridPoint>& points) {
+    points.clear();
+    std::ifstream in(path);
+    if (!in.is_open())
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        const size_t a = line.find(';');
+        const size_t b = a == std::string::npos ? a : line.find(';', a + 1);
+        GridPoint p;
+        if (b == std::string::npos || !parse_decimal(std::string_view(line).substr(a + 1, b - a - 1), p.lat) ||
+            !parse_decimal(std::string_view(line).substr(b + 1), p.lon)) {
+            points.clear();
+            return false;
+        }
+        p.name = line.substr(0, a);
+        points.push_back(p);
+    }
+    return !points.empty();
+}
+
+struct Neighbour {
+    size_t point; // index into the points the SpatialIndex was built from
+    double km;
+};
+
+class SpatialIndex {
+public:
+    // Points without coordinates (NaN) are never found.
+    explicit SpatialIndex(const std::vector<GridPoint>& points) {
+        std::vector<size_t> valid;
+        for (size_t i = 0; i < points.size(); ++i) {
+            lat_.push_back(points[i].lat);
+            lon_.push_back(points[i].lon);
+            if (!std::isnan(points[i].lat) && !std::isnan(points[i].lon))
+                valid.push_back(i);
+        }
+        if (valid.empty())
+            return;
+        lat0_ = lat1_ = lat_[valid[0]];
+        lon0_ = lon1_ = lon_[valid[0]];
+        double max_abs_lat = 0;
+        for (const size_t i : valid) {
+            lat0_ = std::min(lat0_, lat_[i]);
+            lat1_ = std::max(lat1_, lat_[i]);
+            lon0_ = std::min(lon0_, lon_[i]);
+            lon1_ = std::max(lon1_, lon_[i]);
+            max_abs_lat = std::max(max_abs_lat, std::fabs(lat_[i]));
+        }
+        cos_max_lat_ = std::cos(max_abs_lat * M_PI / 180);
+
+        // square buckets of `cell_` degrees, about two points each
+        const double buckets = std::max(1.0, double(valid.size()) / 2);
+        const double area = (lat1_ - lat0_) * (lon1_ - lon0_);
+        cell_ = area > 0 ? std::sqrt(area / buckets) : std::max(lat1_ - lat0_, lon1_ - lon0_) / buckets;
+        if (!(cell_ > 0))
+            cell_ = 1;
+        rows_ = int(std::min(double(valid.size()), std::floor((lat1_ - lat0_) / cell_))) + 1;
+        cols_ = int(std::min(double(valid.size()), std::floor((lon1_ - lon0_) / cell_))) + 1;
+
+        // the points sorted by bucket (row by row), bucket b holds ids_[start_[b] .. start_[b + 1])
+        start_.assign(size_t(rows_) * size_t(cols_) + 1, 0);
+        for (const size_t i : valid)
+            start_[bucket(row_of(lat_[i]), col_of(lon_[i])) + 1]++;
+        for (size_t b = 1; b < start_.size(); ++b)
+            start_[b] += start_[b - 1];
+        ids_.resize(valid.size());
+        std::vector<uint32_t> next(start_.begin(), start_.end() - 1);
+        for (const size_t i : valid)
+            ids_[next[bucket(row_of(lat_[i]), col_of(lon_[i]))]++] = uint32_t(i);
+    }
+
+    size_t size() const { return ids_.size(); }
+
+    // the k points closest to lat, lon, closest first (fewer if there are not that many)
+    std::vector<Neighbour> nearest(double lat, double lon, size_t k = 1) const {
+        std::vector<Neighbour> best;
+        k = std::min(k, ids_.size());
+        if (k == 0)
+            return best;
+        const int r0 = row_of(lat), c0 = col_of(lon);
+        // rings of buckets around the one of lat, lon until no bucket outside can hold a closer point
+        for (int ring = 0;; ++ring) {
+            for (int r = r0 - ring; r <= r0 + ring; ++r) {
+                if (r < 0 || r >= rows_)
+                    continue;
+                const bool edge_row = r == r0 - ring || r == r0 + ring;
+                for (int c = c0 - ring; c <= c0 + ring; c += edge_row ? 1 : 2 * std::max(ring, 1)) {
+                    if (c < 0 || c >= cols_)
+                        continue;
+                    for (uint32_t j = start_[bucket(r, c)]; j < start_[bucket(r, c) + 1]; ++j)
+                        keep(best, k, {ids_[j], distance_km(lat, lon, lat_[ids_[j]], lon_[ids_[j]])});
+                }
+            }
+            const bool all = r0 - ring <= 0 && r0 + ring >= rows_ - 1 && c0 - ring <= 0 && c0 + ring >= cols_ - 1;
+            if (all || (best.size() == k && best.back().km <= outside_km(lat, lon, r0, c0, ring)))
+                return best;
+        }
+    }
+
+    // every point at most km from lat, lon, closest first
+    std::vector<Neighbour> within(double lat, double lon, double km) const {
+        std::vector<Neighbour> found;
+        if (ids_.empty() || !(km >= 0))
+            return found;
+        // the circle lies in lat +- d and, unless it holds a pole, in lon +- asin(sin d / cos lat)
+        const double d = km / kEarthRadiusKm;
+        const double d_lat = d * 180 / M_PI;
+        double d_lon = 360;
+        if (std::fabs(lat) + d_lat < 90 && d < M_PI / 2)
+            d_lon = std::asin(std::min(1.0, std::sin(d) / std::cos(lat * M_PI / 180))) * 180 / M_PI;
+        for_each_in(lat - d_lat, lat + d_lat, lon - d_lon, lon + d_lon, [&](size_t i) {
+            const double dist = distance_km(lat, lon, lat_[i], lon_[i]);
+            if (dist <= km)
+                found.push_back({i, dist});
+        });
+        std::sort(found.begin(), found.end(), closer);
+        return found;
+    }
+
+    // every point with lat_min <= lat <= lat_max and lon_min <= lon <= lon_max, in point order
+    std::vector<size_t> in_box(double lat_min, double lat_max, double lon_min, double lon_max) const {
+        std::vector<size_t> found;
+        for_each_in(lat_min, lat_max, lon_min, lon_max, [&](size_t i) {
+            if (lat_[i] >= lat_min && lat_[i] <= lat_max && lon_[i] >= lon_min && lon_[i] <= lon_max)
+                found.push_back(i);
+        });
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+private:
+    static bool closer(const Neighbour& a, const Neighbour& b) { return a.km < b.km || (a.km == b.km && a.point < b.point); }
+
+    // keeps the k closest in best, sorted
+    static void keep(std::vector<Neighbour>& best, size_t k, Neighbour n) {
+        if (best.size() == k && !closer(n, best.back()))
+            return;
+        best.insert(std::upper_bound(best.begin(), best.end(), n, closer), n);
+        if (best.size() > k)
+            best.pop_back();
+    }
+
+    // the points in the buckets that overlap the box (the caller checks the points themselves)
+    template <class Fn>
+    void for_each_in(double lat_min, double lat_max, double lon_min, double lon_max, Fn&& fn) const {
+        if (ids_.empty() || !(lat_min <= lat_max) || !(lon_min <= lon_max))
+            return;
+        const int r_begin = row_of(lat_min), r_end = row_of(lat_max);
+        const int c_begin = col_of(lon_min), c_end = col_of(lon_max);
+        for (int r = r_begin; r <= r_end; ++r)
+            for (int c = c_begin; c <= c_end; ++c)
+                for (uint32_t j = start_[bucket(r, c)]; j < start_[bucket(r, c) + 1]; ++j)
+                    fn(size_t(ids_[j]));
+    }
+
+    // A lower bound of the distance from lat, lon to the points outside the buckets r0 +- ring,
+    // c0 +- ring: they lie in the strips of the grid beyond the sides that do not end at its
+    // edge. For a box of latitudes and longitudes, hav(d) = hav(d lat) + cos(lat) cos(lat of the
+    // point) hav(d lon) is at least the same with the smallest d lat and d lon the box allows.
+    double outside_km(double lat, double lon, int r0, int c0, int ring) const {
+        constexpr double rad = M_PI / 180;
+        const double cos_lat = std::cos(lat * rad) * cos_max_lat_;
+        double km = std::numeric_limits<double>::infinity();
+        auto strip = [&](double lat_min, double lat_max, double lon_min, double lon_max) {
+            const double s_lat = std::sin(std::max({0.0, lat_min - lat, lat - lat_max}) * rad / 2);
+            const double s_lon = std::sin(std::max({0.0, lon_min - lon, lon - lon_max}) * rad / 2);
+            const double h = s_lat * s_lat + cos_lat * s_lon * s_lon;
+            km = std::min(km, 2 * kEarthRadiusKm * std::asin(std::min(1.0, std::sqrt(h))));
+        };
+        if (r0 - ring > 0)
+            strip(lat0_, lat0_ + (r0 - ring) * cell_, lon0_, lon1_);
+        if (r0 + ring < rows_ - 1)
+            strip(lat0_ + (r0 + ring + 1) * cell_, lat1_, lon0_, lon1_);
+        if (c0 - ring > 0)
+            strip(lat0_, lat1_, lon0_, lon0_ + (c0 - ring) * cell_);
+        if (c0 + ring < cols_ - 1)
+            strip(lat0_, lat1_, lon0_ + (c0 + ring + 1) * cell_, lon1_);
+        return km;
+    }
+
+    // the bucket row/column of a latitude/longitude, clamped to the grid
+    int row_of(double lat) const { return int(std::clamp(std::floor((lat - lat0_) / cell_), 0.0, double(rows_ - 1))); }
+    int col_of(double lon) const { return int(std::clamp(std::floor((lon - lon0_) / cell_), 0.0, double(cols_ - 1))); }
+    size_t bucket(int r, int c) const { return size_t(r) * size_t(cols_) + size_t(c); }
+
+    std::vector<double> lat_, lon_; // of every point, also those without coordinates
+    double lat0_ = 0, lat1_ = 0, lon0_ = 0, lon1_ = 0; // the corners of the grid
+    double cell_ = 1, cos_max_lat_ = 1;
+    int rows_ = 1, cols_ = 1;
+    std::vector<uint32_t> start_{0, 0};
+    std::vector<uint32_t> ids_;
+};
+
+} // namespace smhi
@@ -0,0 +1,199 @@
+#pragma once
+// Compact in-memory series of one station value (e.g. the temperature), indexed by day.
+//
+// SMHI values have one decimal (0.1 degree, 0.1 mm), so they are kept as 16-bit fixed point
+// numbers (value * 10 by default) instead of doubles in std::map nodes. Every observation hour
+// that is asked for (e.g. 06:00 and 18:00) gets its own contiguous array with one entry per day
+// from first_day() to last_day(), and a bitmap with one bit per day says which entries exist.
+// A day with two readings takes 4 bytes plus 2 bits, so 60 years of a station are about 90 kB
+// and a loop over one hour of the year runs through memory in order.
+//
+// The values come back exactly: 213 / 10.0 is the same double as std::stod("21.3").
+// A value that does not fit (more decimals than the series keeps, or beyond +-3276.7 with one
+// decimal) is not stored and counted in rejected().
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "station_store.h"
+
+namespace smhi {
+
+class StationSeries {
+public:
+    // hours: the observation hours to keep, e.g. {6, 18}, or {kNoTime} for daily values.
+    // decimals: how many decimals the fixed point numbers keep.
+    explicit StationSeries(const std::vector<uint8_t>& hours = {kNoTime}, int decimals = 1)
+        : hours_(hours), values_(hours.size()), valid_(hours.size()) {
+        for (int i = 0; i < decimals; ++i)
+            scale_ *= 10;
+    }
+
+    // Fills the series from column of a station store (all rows with one of the hours).
+    // Returns false if the store has no such column.
+    bool load(const StationStore& store, const std::string& column) {
+        const int c = store.column_index(column);
+        if (c < 0)
+            return false;
+        const int32_t* date = store.date();
+        const uint8_t* hour = store.time_code();
+        // the store is sorted by date, but find the range anyway so nothing is moved later
+        if (store.rows() > 0) {
+            int32_t lo = date[0], hi = date[0];
+            for (size_t i = 1; i < store.rows(); ++i) {
+                lo = date[i] < lo ? date[i] : lo;
+                hi = date[i] > hi ? date[i] : hi;
+            }
+            cover(lo, hi);
+        }
+        for (size_t i = 0; i < store.rows(); ++i) {
+            const double v = store.value(size_t(c), i);
+            if (!std::isnan(v))
+                set(date[i], hour[i], v);
+        }
+        return true;
+    }
+
+    // Stores one reading. The day range grows as needed. Returns false if the hour is not
+    // kept by this series or the value does not fit.
+    bool set(int32_t day, uint8_t hour, double value) {
+        const int slot = slot_of(hour);
+        if (slot < 0)
+            return false;
+        const double scaled = value * scale_;
+        const double raw = std::nearbyint(scaled);
+        if (!(std::fabs(raw) <= 32767) || std::fabs(raw - scaled) > 1e-6 * (1 + std::fabs(raw))) {
+            rejected_++;
+            return false;
+        }
+        cover(day, day);
+        const size_t i = size_t(day - first_);
+        values_[slot][i] = int16_t(raw);
+        valid_[slot][i >> 6] |= uint64_t(1) << (i & 63);
+        return true;
+    }
+
+    // index of the array of an hour, -1 if the series does not keep it
+    int slot_of(uint8_t hour) const {
+        for (size_t s = 0; s < hours_.size(); ++s)
+            if (hours_[s] == hour)
+                return int(s);
+        return -1;
+    }
+
+    bool empty() const { return days_ == 0; }
+    int32_t first_day() const { return first_; }
+    int32_t last_day() const { return first_ + int32_t(days_) - 1; }
+    size_t days() const { return days_; }
+    double scale() const { return scale_; }
+    size_t rejected() const { return rejected_; }
+
+    bool has(int slot, int32_t day) const {
+        if (day < first_ || day > last_day())
+            return false;
+        const size_t i = size_t(day - first_);
+        return (valid_[slot][i >> 6] >> (i & 63)) & 1;
+    }
+
+    // the value, NaN if there is none
+    double at(int slot, int32_t day) const {
+        return has(slot, day) ? values_[slot][size_t(day - first_)] / scale_ : NAN;
+    }
+
+    // raw arrays for loops of your own: value i belongs to day first_day() + i
+    const int16_t* raw(int slot) const { return values_[slot].data(); }
+    const uint64_t* valid_bits(int slot) const { return valid_[slot].data(); }
+
+    // Sum (in fixed point units) and number of the values of one hour from day `from` to
+    // day `to` (both included). Whole 64-day words with every value present are summed
+    // without looking at the bits, which the compiler turns into packed adds.
+    void sum_range(int slot, int32_t from, int32_t to, int64_t& sum, size_t& count) const {
+        sum = 0;
+        count = 0;
+        if (empty() || to < first_ || from > last_day())
+            return;
+        size_t i = from < first_ ? 0 : size_t(from - first_);
+        const size_t end = to > last_day() ? days_ : size_t(to - first_) + 1;
+        const int16_t* v = values_[slot].data();
+        const uint64_t* bits = valid_[slot].data();
+        while (i < end) {
+            const uint64_t word = bits[i >> 6];
+            if ((i & 63) == 0 && i + 64 <= end && word == ~uint64_t(0)) {
+                int32_t s = 0; // 64 values of at most 32767 can't overflow
+                for (size_t k = 0; k < 64; ++k)
+                    s += v[i + k];
+                sum += s;
+                count += 64;
+                i += 64;
+                continue;
+            }
+            if ((word >> (i & 63)) & 1) {
+                sum += v[i];
+                count++;
+            }
+            ++i;
+        }
+    }
+
+    // Calls fn(day, value) for every value of one hour, in date order.
+    template <class Fn>
+    void for_each(int slot, Fn&& fn) const {
+        const int16_t* v = values_[slot].data();
+        const uint64_t* bits = valid_[slot].data();
+        for (size_t w = 0; w < valid_[slot].size(); ++w)
+            for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+                const size_t i = w * 64 + size_t(__builtin_ctzll(word));
+                fn(first_ + int32_t(i), v[i] / scale_);
+            }
+    }
+
+    // bytes used by the values and bitmaps
+    size_t memory_bytes() const {
+        size_t bytes = 0;
+        for (size_t s = 0; s < hours_.size(); ++s)
+            bytes += values_[s].capacity() * sizeof(int16_t) + valid_[s].capacity() * sizeof(uint64_t);
+        return bytes;
+    }
+
+private:
+    // makes room for the days lo..hi
+    void cover(int32_t lo, int32_t hi) {
+        if (days_ == 0) {
+            first_ = lo;
+            resize(size_t(hi - lo) + 1);
+            return;
+        }
+        if (lo < first_) {
+            // rare (data not sorted by date): move everything up by whole words
+            const size_t words = (size_t(first_ - lo) + 63) / 64;
+            for (size_t s = 0; s < hours_.size(); ++s) {
+                values_[s].insert(values_[s].begin(), words * 64, 0);
+                valid_[s].insert(valid_[s].begin(), words, 0);
+            }
+            first_ -= int32_t(words * 64);
+            days_ += words * 64;
+        }
+        if (hi > last_day())
+            resize(size_t(hi - first_) + 1);
+    }
+
+    void resize(size_t days) {
+        days_ = days;
+        for (size_t s = 0; s < hours_.size(); ++s) {
+            values_[s].resize(days, 0);
+            valid_[s].resize((days + 63) / 64, 0);
+        }
+    }
+
+    std::vector<uint8_t> hours_;
+    double scale_ = 1;
+    int32_t first_ = 0;
+    size_t days_ = 0;
+    std::vector<std::vector<int16_t>> values_; // [slot][day - first_]
+    std::vector<std::vector<uint64_t>> valid_;  // [slot][(day - first_) / 64], bit (day - first_) % 64
+    size_t rejected_ = 0;
+};
+
+} // namespace smhi
@@ -0,0 +1,252 @@
+#pragma once
+// Compact columnar binary format for cleaned station data ("station store").
+//
+// The cleaners write one of these next to every cleaned CSV (Falun.csv -> Falun.bin)
+// so the analysis tools can mmap the file and read the columns directly instead of
+// splitting and converting every text line again.
+//
+// File layout (native byte order, every section 4-byte aligned):
+//
+//   StoreHeader                       magic, version, number of rows/columns
+//   StoreColumn[n_columns]            column name + number of decimals in the source text
+//   int32_t  date[n_rows]             day ordinal (days since 1970-01-01, see smhi_date.h)
+//   uint8_t  time_code[n_rows]        hour of the observation (kNoTime for daily values),
+//                                     padded with zeros to a multiple of 4 bytes
+//   float    values[n_columns][n_rows] one contiguous array per column, NaN = missing
+//
+// Floats are enough to hold the 0.1 degree / 0.1 mm SMHI values, and because the number
+// of decimals is stored per column, value() gives back exactly the double std::stod
+// would have produced from the original text.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "decimal_parse.h"
+#include "mapped_file.h"
+#include "smhi_date.h"
+
+namespace smhi {
+
+const char     kStoreMagic[8]   = {'S', 'M', 'H', 'I', 'S', 'T', 'O', 'R'};
+const uint32_t kStoreVersion    = 1;
+const uint8_t  kNoTime          = 0xFF; // time code for rows without a time of day
+const uint32_t kUnknownDecimals = 0xFF; // column text had no fixed number of decimals
+
+struct StoreHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t n_rows;
+    uint32_t n_columns;
+    uint32_t data_offset; // byte offset of the date column
+};
+
+struct StoreColumn {
+    char     name[28];
+    uint32_t decimals;
+};
+
+// Rounds n up to the next multiple of 4 so every column starts 4-byte aligned.
+inline size_t store_pad4(size_t n) { return (n + 3) & ~size_t(3); }
+
+// "Falun.csv" -> "Falun.bin", the name the cleaners use for the binary copy.
+inline std::string store_path_for(const std::string& csv_path) {
+    const size_t dot = csv_path.rfind('.');
+    const size_t slash = csv_path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return csv_path + ".bin";
+    return csv_path.substr(0, dot) + ".bin";
+}
+
+// Parses "YYYY-MM-DD" into a day ordinal. Returns false if the text is not a date.
+inline bool parse_date_text(const std::string& s, int32_t& day) {
+    return s.size() >= 10 && parse_date(s.data(), day);
+}
+
+// "06:00:00" -> 6. Anything that does not start with an hour gives kNoTime.
+inline uint8_t time_code_from_text(const std::string& s) {
+    if (s.size() < 2 || s[0] < '0' || s[0] > '2' || s[1] < '0' || s[1] > '9')
+        return kNoTime;
+    const int hour = (s[0] - '0') * 10 + (s[1] - '0');
+    return hour < 24 ? uint8_t(hour) : kNoTime;
+}
+
+// 6 -> "06:00:00", the other way round. kNoTime gives "".
+inline std::string time_text_from_code(uint8_t hour) {
+    if (hour == kNoTime)
+        return "";
+    const char text[9] = {char('0' + hour / 10), char('0' + hour % 10), ':', '0', '0', ':', '0', '0', '\0'};
+    return text;
+}
+
+// Collects rows in memory and writes them as a station store.
+class StationStoreWriter {
+public:
+    explicit StationStoreWriter(const std::vector<std::string>& column_names)
+        : names_(column_names), values_(column_names.size()), decimals_(column_names.size(), 0) {}
+
+    // Adds one row. value_texts points to one text field per column, exactly as it
+    // appears in the CSV; empty or non-numeric text is stored as NaN (missing).
+    void add_row(int32_t day, uint8_t time_code, const std::string* value_texts) {
+        dates_.push_back(day);
+        times_.push_back(time_code);
+        for (size_t c = 0; c < names_.size(); ++c)
+            values_[c].push_back(parse_value(c, value_texts[c]));
+    }
+
+    // Adds one row of values that are already converted (NaN = missing). Use note_decimals()
+    // to tell the writer how many decimals the source text of each column had.
+    void add_row(int32_t day, uint8_t time_code, const double* values) {
+        dates_.push_back(day);
+        times_.push_back(time_code);
+        for (size_t c = 0; c < names_.size(); ++c)
+            values_[c].push_back(float(values[c]));
+    }
+
+    // Records that column c had text with this many decimals (-1 = no fixed number).
+    void note_decimals(size_t c, int decimals) {
+        if (decimals_[c] == kUnknownDecimals)
+            return;
+        if (decimals < 0 || decimals > 6)
+            decimals_[c] = kUnknownDecimals;
+        else if (uint32_t(decimals) > decimals_[c])
+            decimals_[c] = uint32_t(decimals);
+    }
+
+    // Adds all rows of another writer with the same columns after the rows already here.
+    // Used to join the pieces of a file that were cleaned on different threads.
+    void append(const StationStoreWriter& other) {
+        dates_.insert(dates_.end(), other.dates_.begin(), other.dates_.end());
+        times_.insert(times_.end(), other.times_.begin(), other.times_.end());
+        for (size_t c = 0; c < names_.size(); ++c) {
+            values_[c].insert(values_[c].end(), other.values_[c].begin(), other.values_[c].end());
+            note_decimals(c, other.decimals_[c] == kUnknownDecimals ? -1 : int(other.decimals_[c]));
+        }
+    }
+
+    size_t rows() const { return dates_.size(); }
+
+    bool save(const std::string& path) const {
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f)
+            return false;
+
+        const uint32_t n = uint32_t(dates_.size());
+        StoreHeader h{};
+        std::memcpy(h.magic, kStoreMagic, sizeof h.magic);
+        h.version = kStoreVersion;
+        h.n_rows = n;
+        h.n_columns = uint32_t(names_.size());
+        h.data_offset = uint32_t(sizeof(StoreHeader) + names_.size() * sizeof(StoreColumn));
+        std::fwrite(&h, sizeof h, 1, f);
+
+        for (size_t c = 0; c < names_.size(); ++c) {
+            StoreColumn col{};
+            std::strncpy(col.name, names_[c].c_str(), sizeof col.name - 1);
+            col.decimals = decimals_[c];
+            std::fwrite(&col, sizeof col, 1, f);
+        }
+
+        std::fwrite(dates_.data(), sizeof(int32_t), n, f);
+        std::vector<uint8_t> times(store_pad4(n), 0);
+        std::copy(times_.begin(), times_.end(), times.begin());
+        std::fwrite(times.data(), 1, times.size(), f);
+        for (const auto& col : values_)
+            std::fwrite(col.data(), sizeof(float), n, f);
+
+        const bool ok = !std::ferror(f);
+        return std::fclose(f) == 0 && ok;
+    }
+
+private:
+    float parse_value(size_t c, const std::string& text) {
+        double v;
+        int decimals;
+        if (!parse_decimal(text, v, &decimals))
+            return NAN;
+        note_decimals(c, decimals);
+        return float(v);
+    }
+
+    std::vector<std::string> names_;
+    std::vector<int32_t> dates_;
+    std::vector<uint8_t> times_;
+    std::vector<std::vector<float>> values_;
+    std::vector<uint32_t> decimals_;
+};
+
+// Read-only view of a station store, mapped into memory with mmap.
+// Nothing is parsed: date(), time_code() and column() point straight into the file.
+class StationStore {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path) || file_.size() < sizeof(StoreHeader)) {
+            file_.close();
+            return false;
+        }
+        base_ = file_.data();
+
+        const StoreHeader* h = header();
+        const size_t n = h->n_rows;
+        const size_t needed = size_t(h->data_offset) + n * sizeof(int32_t) + store_pad4(n) +
+                              size_t(h->n_columns) * n * sizeof(float);
+        if (std::memcmp(h->magic, kStoreMagic, sizeof h->magic) != 0 || h->version != kStoreVersion ||
+            h->data_offset != sizeof(StoreHeader) + h->n_columns * sizeof(StoreColumn) || needed > file_.size()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        file_.close();
+        base_ = nullptr;
+    }
+
+    bool is_open() const { return base_ != nullptr; }
+    // 0 for a store that is not open, so a failed open() reads as an empty store
+    size_t rows() const { return is_open() ? header()->n_rows : 0; }
+    size_t columns() const { return is_open() ? header()->n_columns : 0; }
+
+    std::string column_name(size_t c) const { return columns_meta()[c].name; }
+
+    // Index of the column with the given name, or -1 if there is none.
+    int column_index(const std::string& name) const {
+        for (size_t c = 0; c < columns(); ++c)
+            if (name == columns_meta()[c].name)
+                return int(c);
+        return -1;
+    }
+
+    const int32_t* date() const { return reinterpret_cast<const int32_t*>(base_ + header()->data_offset); }
+    const uint8_t* time_code() const { return reinterpret_cast<const uint8_t*>(date() + rows()); }
+    const float* column(size_t c) const {
+        const float* first = reinterpret_cast<const float*>(time_code() + store_pad4(rows()));
+        return first + c * rows();
+    }
+
+    // The value as a double, rounded back to the decimals of the source text so the
+    // result is identical to calling std::stod on the original field. NaN = missing.
+    double value(size_t c, size_t row) const {
+        const float f = column(c)[row];
+        const uint32_t dec = columns_meta()[c].decimals;
+        if (std::isnan(f) || dec == kUnknownDecimals)
+            return f;
+        static const double pow10[7] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+        return std::nearbyint(double(f) * pow10[dec]) / pow10[dec];
+    }
+
+private:
+    const StoreHeader* header() const { return reinterpret_cast<const StoreHeader*>(base_); }
+    const StoreColumn* columns_meta() const {
+        return reinterpret_cast<const StoreColumn*>(base_ + sizeof(StoreHeader));
+    }
+
+    MappedFile file_;
+    const char* base_ = nullptr;
+};
+
+} // namespace smhi
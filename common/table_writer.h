@@ -0,0 +1,232 @@
+#pragma once
+// One way for the tools to write a table of results, to a sink chosen by the file name:
+//     .csv (or anything else)   text, with a header line by default, through a buffered OutputFile
+//     .bin                      a station store (station_store.h) that the tools map into memory
+//     .arrow / .feather         an Arrow IPC file (arrow_ipc.h) for pyarrow, pandas, polars, R, ...
+// The tool describes its columns once and then adds the cells of every row in order:
+//
+//     auto out = smhi::open_table_writer("Falun_anomaly.csv", {{"date", smhi::ColumnType::kDate},
+//                                        {"time", smhi::ColumnType::kHour}, smhi::number_column("anomaly", 2)}, ';');
+//     out->add_int(day); out->add_int(hour); out->add_number(v); out->end_row();
+//     ...
+//     if (!out->close()) ...
+//
+// How numbers look in a CSV is part of the column (see output_file.h): the shortest text that
+// reads back as the same double by default, or a fixed number of decimals or significant digits.
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arrow_ipc.h"
+#include "output_file.h"
+#include "smhi_date.h"
+#include "station_store.h"
+
+namespace smhi {
+
+enum class ColumnType {
+    kInt,    // whole number
+    kDate,   // days since 1970-01-01, "YYYY-MM-DD" in a CSV
+    kHour,   // time code of a station file (kNoTime = none), "HH:00:00" or empty in a CSV
+    kNumber, // double, NaN = missing
+    kText
+};
+
+struct Column {
+    std::string name;
+    ColumnType type = ColumnType::kNumber;
+    NumberFormat format = NumberFormat::kShortest;
+    int precision = 6;
+};
+
+// a number column with a fixed number of decimals, or (significant = true) significant digits
+inline Column number_column(const std::string& name, int digits, bool significant = false) {
+    return {name, ColumnType::kNumber, significant ? NumberFormat::kGeneral : NumberFormat::kFixed, digits};
+}
+
+class TableWriter {
+public:
+    virtual ~TableWriter() = default;
+
+    // the cells of a row, in the order of the columns, then end_row()
+    virtual void add_int(int64_t v) = 0; // kInt, kDate, kHour
+    virtual void add_number(double v) = 0;
+    virtual void add_text(std::string_view v) = 0;
+    virtual void end_row() = 0;
+
+    // Finishes the file. Returns false if it could not be written.
+    virtual bool close() = 0;
+};
+
+class CsvTableWriter : public TableWriter {
+public:
+    // header: whether the first line has the names of the columns (the cleaned station
+    // files have none)
+    bool open(const std::string& path, const std::vector<Column>& columns, char separator, bool header = true) {
+        columns_ = columns;
+        separator_ = separator;
+        if (!file_.open(path))
+            return false;
+        if (!header)
+            return true;
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            if (c > 0)
+                file_.put(separator_);
+            file_.append(columns_[c].name);
+        }
+        file_.put('\n');
+        return true;
+    }
+
+    void add_int(int64_t v) override {
+        const Column& col = next();
+        if (col.type == ColumnType::kDate) {
+            int y, m, d;
+            civil_from_days(int32_t(v), y, m, d);
+            char text[16] = {char('0' + y / 1000 % 10), char('0' + y / 100 % 10), char('0' + y / 10 % 10), char('0' + y % 10), '-',
+                             char('0' + m / 10), char('0' + m % 10), '-', char('0' + d / 10), char('0' + d % 10)};
+            file_.append(std::string_view(text, 10));
+        }
+        else if (col.type == ColumnType::kHour) {
+            if (v != kNoTime) {
+                const char text[8] = {char('0' + v / 10), char('0' + v % 10), ':', '0', '0', ':', '0', '0'};
+                file_.append(std::string_view(text, 8));
+            }
+        }
+        else
+            file_.integer(v);
+    }
+    void add_number(double v) override {
+        const Column& col = next();
+        file_.number(v, col.format, col.precision);
+    }
+    void add_text(std::string_view v) override {
+        next();
+        file_.append(v);
+    }
+    void end_row() override {
+        file_.put('\n');
+        column_ = 0;
+    }
+    bool close() override { return file_.close(); }
+
+private:
+    const Column& next() {
+        if (column_ > 0)
+            file_.put(separator_);
+        return columns_[column_++];
+    }
+
+    OutputFile file_;
+    std::vector<Column> columns_;
+    char separator_ = ',';
+    size_t column_ = 0;
+};
+
+// A station store: a kDate column, optionally a kHour column, then kNumber columns.
+class StoreTableWriter : public TableWriter {
+public:
+    // Returns false if the columns don't fit a station store.
+    bool open(const std::string& path, const std::vector<Column>& columns) {
+        path_ = path;
+        has_hour_ = columns.size() > 1 && columns[1].type == ColumnType::kHour;
+        if (columns.empty() || columns[0].type != ColumnType::kDate)
+            return false;
+        std::vector<std::string> names;
+        for (size_t c = has_hour_ ? 2 : 1; c < columns.size(); ++c) {
+            if (columns[c].type != ColumnType::kNumber)
+                return false;
+            names.push_back(columns[c].name);
+        }
+        store_ = std::make_unique<StationStoreWriter>(names);
+        for (size_t c = 0; c < names.size(); ++c) {
+            const Column& col = columns[c + (has_hour_ ? 2 : 1)];
+            store_->note_decimals(c, col.format == NumberFormat::kFixed ? col.precision : -1);
+        }
+        values_.assign(names.size(), NAN);
+        return true;
+    }
+
+    void add_int(int64_t v) override {
+        if (column_++ == 0)
+            day_ = int32_t(v);
+        else
+            hour_ = uint8_t(v);
+    }
+    void add_number(double v) override { values_[column_++ - (has_hour_ ? 2 : 1)] = v; }
+    void add_text(std::string_view) override { column_++; }
+    void end_row() override {
+        store_->add_row(day_, has_hour_ ? hour_ : kNoTime, values_.data());
+        column_ = 0;
+    }
+    bool close() override { return store_->save(path_); }
+
+private:
+    std::string path_;
+    std::unique_ptr<StationStoreWriter> store_;
+    bool has_hour_ = false;
+    size_t column_ = 0;
+    int32_t day_ = 0;
+    uint8_t hour_ = kNoTime;
+    std::vector<double> values_;
+};
+
+class ArrowTableWriter : public TableWriter {
+public:
+    bool open(const std::string& path, const std::vector<Column>& columns) {
+        columns_ = columns;
+        std::vector<ArrowField> fields;
+        for (const auto& col : columns) {
+            const ArrowType type = col.type == ColumnType::kInt    ? ArrowType::kInt32
+                                   : col.type == ColumnType::kDate ? ArrowType::kDate32
+                                   : col.type == ColumnType::kHour ? ArrowType::kInt8
+                                   : col.type == ColumnType::kText ? ArrowType::kUtf8
+                                                                   : ArrowType::kFloat64;
+            fields.push_back({col.name, type});
+        }
+        return file_.open(path, fields);
+    }
+
+    void add_int(int64_t v) override {
+        if (columns_[column_].type == ColumnType::kHour && v == kNoTime)
+            file_.add_null(column_);
+        else
+            file_.add_int(column_, v);
+        column_++;
+    }
+    void add_number(double v) override { file_.add_double(column_++, v); }
+    void add_text(std::string_view v) override { file_.add_text(column_++, v); }
+    void end_row() override {
+        file_.end_row();
+        column_ = 0;
+    }
+    bool close() override { return file_.close(); }
+
+private:
+    ArrowFileWriter file_;
+    std::vector<Column> columns_;
+    size_t column_ = 0;
+};
+
+// The sink for path by its extension. nullptr if the file can't be created (or the columns
+// don't fit a .bin file). separator and header are used for CSV only.
+inline std::unique_ptr<TableWriter> open_table_writer(const std::string& path, const std::vector<Column>& columns,
+                                                      char separator = ',', bool header = true) {
+    auto ends_with = [&](const std::string& end) {
+        return path.size() >= end.size() && path.compare(path.size() - end.size(), end.size(), end) == 0;
+    };
+    if (ends_with(".bin")) {
+        auto w = std::make_unique<StoreTableWriter>();
+        return w->open(path, columns) ? std::move(w) : nullptr;
+    }
+    if (ends_with(".arrow") || ends_with(".feather")) {
+        auto w = std::make_unique<ArrowTableWriter>();
+        return w->open(path, columns) ? std::move(w) : nullptr;
+    }
+    auto w = std::make_unique<CsvTableWriter>();
+    return w->open(path, columns, separator, header) ? std::move(w) : nullptr;
+}
+
+} // namespace smhi
@@ -0,0 +1,148 @@
+#pragma once
+// Streaming quantile sketch (a merging t-digest, after Dunning & Ertl).
+//
+// The values are summarised by a few hundred centroids (a mean and a weight each), small near
+// the tails and large in the middle, so p5 and p95 stay accurate while the memory does not
+// grow with the number of values. Two digests of different parts of the data can be merged
+// into the digest of all of it, which is how the pieces of a file read on different threads
+// are combined. Nothing has to be known about the range of the values beforehand.
+//
+// New values are collected in a buffer and folded into the centroids when it is full, so
+// add() is cheap. Only standard headers are used here so the file can also be included from ROOT.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace smhi {
+
+class TDigest {
+public:
+    // compression: about the number of centroids kept; 100 gives quantiles within a fraction
+    // of a percent in rank
+    explicit TDigest(double compression = 100) : compression_(compression) {}
+
+    void add(double x, double weight = 1) {
+        if (std::isnan(x))
+            return;
+        buffer_.push_back({x, weight});
+        min_ = std::min(min_, x);
+        max_ = std::max(max_, x);
+        if (buffer_.size() >= buffer_limit())
+            compress();
+    }
+
+    // adds everything other has seen
+    void merge(const TDigest& other) {
+        if (other.empty())
+            return;
+        buffer_.insert(buffer_.end(), other.centroids_.begin(), other.centroids_.end());
+        buffer_.insert(buffer_.end(), other.buffer_.begin(), other.buffer_.end());
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        compress();
+    }
+
+    // Folds the buffered values into the centroids and gives the memory of the buffer back. For a
+    // digest that is kept after its last value, e.g. one of many that are merged later: with only
+    // a few hundred values the buffer is never full, so they would all be kept as they are.
+    void flush() {
+        compress();
+        std::vector<Centroid>().swap(buffer_);
+    }
+
+    bool empty() const { return centroids_.empty() && buffer_.empty(); }
+    double count() const {
+        double n = 0;
+        for (const auto& c : centroids_) n += c.weight;
+        for (const auto& c : buffer_) n += c.weight;
+        return n;
+    }
+    double min() const { return min_; }
+    double max() const { return max_; }
+    size_t centroids() const { return centroids_.size(); }
+
+    // The value below which a fraction q of the values lie, interpolated between the centroids.
+    // NaN if nothing was added.
+    double quantile(double q) {
+        compress();
+        if (centroids_.empty())
+            return NAN;
+        if (centroids_.size() == 1)
+            return centroids_[0].mean;
+        q = std::min(1.0, std::max(0.0, q));
+        const double index = q * total_;
+
+        // before the middle of the first centroid: between the minimum and its mean
+        const Centroid& first = centroids_.front();
+        if (index < first.weight / 2)
+            return min_ + (first.mean - min_) * index / (first.weight / 2);
+
+        double seen = first.weight / 2; // weight up to the middle of centroid i
+        for (size_t i = 0; i + 1 < centroids_.size(); ++i) {
+            const double gap = (centroids_[i].weight + centroids_[i + 1].weight) / 2;
+            if (seen + gap > index) {
+                const double t = (index - seen) / gap;
+                return centroids_[i].mean + t * (centroids_[i + 1].mean - centroids_[i].mean);
+            }
+            seen += gap;
+        }
+        // after the middle of the last centroid: between its mean and the maximum
+        const Centroid& last = centroids_.back();
+        const double t = std::min(1.0, (index - seen) / (last.weight / 2));
+        return last.mean + t * (max_ - last.mean);
+    }
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+    size_t buffer_limit() const { return size_t(5 * compression_) + 16; }
+
+    // the scale function k1: centroids may span at most 1 in k, which keeps them small at the tails
+    double k(double q) const { return compression_ / (2 * M_PI) * std::asin(2 * q - 1); }
+    double k_inverse(double k) const {
+        return k >= compression_ / 4 ? 1 : (std::sin(k * 2 * M_PI / compression_) + 1) / 2;
+    }
+
+    // folds the buffer into the centroids
+    void compress() {
+        if (buffer_.empty())
+            return;
+        buffer_.insert(buffer_.end(), centroids_.begin(), centroids_.end());
+        std::sort(buffer_.begin(), buffer_.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+        total_ = 0;
+        for (const auto& c : buffer_)
+            total_ += c.weight;
+
+        centroids_.clear();
+        Centroid current = buffer_[0];
+        double before = 0; // weight of the centroids already finished
+        double limit = total_ * k_inverse(k(0) + 1);
+        for (size_t i = 1; i < buffer_.size(); ++i) {
+            const Centroid& next = buffer_[i];
+            if (before + current.weight + next.weight <= limit) {
+                current.weight += next.weight;
+                current.mean += (next.mean - current.mean) * next.weight / current.weight;
+            } else {
+                centroids_.push_back(current);
+                before += current.weight;
+                limit = total_ * k_inverse(k(before / total_) + 1);
+                current = next;
+            }
+        }
+        centroids_.push_back(current);
+        buffer_.clear();
+    }
+
+    double compression_;
+    double total_ = 0;
+    double min_ = INFINITY, max_ = -INFINITY;
+    std::vector<Centroid> centroids_; // sorted by mean
+    std::vector<Centroid> buffer_;    // values not folded in yet
+};
+
+} // namespace smhi
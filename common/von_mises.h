@@ -0,0 +1,128 @@
+#pragma once
+// Maximum likelihood fit of a von Mises distribution, the "normal distribution on a circle".
+//
+// Days of the year are angles: day 365 and day 1 are neighbours, so a plain Gaussian fit of
+// the coldest day (which is sometimes in late December and sometimes in January) needs tricks.
+// The von Mises density is
+//
+//     f(theta) = exp(kappa * cos(theta - mu)) / (2 pi I0(kappa))
+//
+// with mean direction mu and concentration kappa (large kappa = narrow peak).
+// The fit only needs the sums C = sum cos(theta) and S = sum sin(theta):
+//     mu    = atan2(S, C)
+//     kappa solves I1(kappa) / I0(kappa) = R, where R = sqrt(C^2 + S^2) / n
+// so a fit is one pass over the data plus a few Newton steps.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace smhi {
+
+constexpr double kTwoPi = 6.283185307179586;
+
+struct VonMisesFit {
+    size_t n = 0;
+    double mu = 0;          // mean direction in radians, in (-pi, pi]
+    double kappa = 0;       // concentration, 0 = uniform around the circle
+    double resultant = 0;   // mean resultant length R in [0, 1]
+    double log_likelihood = 0;
+};
+
+// A1(kappa) = I1(kappa) / I0(kappa). For large kappa the Bessel functions overflow,
+// so the asymptotic series is used there.
+inline double bessel_ratio_a1(double kappa) {
+    if (kappa < 1e-8)
+        return kappa / 2;
+    if (kappa > 50) {
+        const double k = 1 / kappa;
+        return 1 - k / 2 - k * k / 8 - k * k * k / 8;
+    }
+    return std::cyl_bessel_i(1.0, kappa) / std::cyl_bessel_i(0.0, kappa);
+}
+
+// log(I0(kappa)), also for large kappa
+inline double log_bessel_i0(double kappa) {
+    if (kappa > 50) {
+        const double k = 1 / kappa;
+        return kappa - 0.5 * std::log(kTwoPi * kappa) + std::log1p(k / 8 + 9 * k * k / 128);
+    }
+    return std::log(std::cyl_bessel_i(0.0, kappa));
+}
+
+// Solves A1(kappa) = r: the approximation of Best and Fisher (1981) as a start, then Newton
+// steps with A1'(kappa) = 1 - A1/kappa - A1^2.
+inline double kappa_from_resultant(double r) {
+    if (r <= 0)
+        return 0;
+    if (r >= 0.999999)
+        r = 0.999999;
+    double kappa = r < 0.53 ? 2 * r + r * r * r + 5 * r * r * r * r * r / 6
+                 : r < 0.85 ? -0.4 + 1.39 * r + 0.43 / (1 - r)
+                            : 1 / (r * r * r - 4 * r * r + 3 * r);
+    for (int it = 0; it < 20; ++it) {
+        const double a = bessel_ratio_a1(kappa);
+        const double slope = 1 - a / kappa - a * a;
+        if (slope <= 0)
+            break;
+        const double step = (a - r) / slope;
+        kappa = std::max(kappa - step, kappa / 2);
+        if (std::fabs(step) < 1e-10 * kappa)
+            break;
+    }
+    return kappa;
+}
+
+// Fit from the sums of cos and sin over n angles.
+inline VonMisesFit fit_von_mises_sums(double c, double s, size_t n) {
+    VonMisesFit fit;
+    fit.n = n;
+    if (n == 0)
+        return fit;
+    fit.mu = std::atan2(s, c);
+    const double length = std::sqrt(c * c + s * s);
+    fit.resultant = length / double(n);
+    fit.kappa = kappa_from_resultant(fit.resultant);
+    // sum of kappa * cos(theta_i - mu) is kappa * length when mu is the mean direction
+    fit.log_likelihood = fit.kappa * length - double(n) * (std::log(kTwoPi) + log_bessel_i0(fit.kappa));
+    return fit;
+}
+
+// Sums of cos and sin of the angles. Four independent partial sums (like four SIMD lanes)
+// let the compiler use packed adds without changing the result between builds.
+inline void circular_sums(const double* cos_theta, const double* sin_theta, size_t n, double& c, double& s) {
+    double sc[4] = {0, 0, 0, 0}, ss[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        for (int lane = 0; lane < 4; ++lane) {
+            sc[lane] += cos_theta[i + lane];
+            ss[lane] += sin_theta[i + lane];
+        }
+    for (; i < n; ++i) {
+        sc[0] += cos_theta[i];
+        ss[0] += sin_theta[i];
+    }
+    c = (sc[0] + sc[1]) + (sc[2] + sc[3]);
+    s = (ss[0] + ss[1]) + (ss[2] + ss[3]);
+}
+
+// Angles on the circle for days of the year: day 1 is angle 0, and a year of
+// year_length days is one turn.
+inline double day_to_angle(double day, double year_length) { return kTwoPi * (day - 1) / year_length; }
+
+// The day (in [1, year_length + 1)) for an angle.
+inline double angle_to_day(double angle, double year_length) {
+    double turn = angle / kTwoPi;
+    turn -= std::floor(turn);
+    return 1 + turn * year_length;
+}
+
+// Wraps an angle difference into (-pi, pi].
+inline double wrap_angle(double a) {
+    a = std::fmod(a + kTwoPi / 2, kTwoPi);
+    if (a <= 0)
+        a += kTwoPi;
+    return a - kTwoPi / 2;
+}
+
+} // namespace smhi
@@ -0,0 +1,203 @@
+// How complete the stations are: the share of days with a reading in every year (or month) and
+// observation hour, and the gaps in the series.
+//
+// Build: g++ -std=c++17 -O2 -pthread coverage.cxx -o coverage
+// Usage: ./coverage [--column NAME] [--times HH,...|all] [--by year|month] [--below F] [--gaps FILE]
+//                   [--min-gap DAYS] [--threads N] [--out FILE] [--metrics report.json] [station.csv ...]
+//        (default: Falun.csv Falsterbo.csv Uppsala.csv, every hour found, by year)
+//
+// Reads the binary copies of the cleaner (Falun.csv -> Falun.bin) and keeps one bit per day and
+// hour (common/coverage.h), so a station takes one pass over its dates and a few kB; the
+// stations are read on all cores. With more than one hour there is also a row "all" for the days
+// with a reading at every hour.
+//
+// coverage.csv has "Station;Year;Time;Days;Present;Completeness" (with --by month a Month column
+// after Year); .arrow writes an Arrow file instead. --below 0.9 keeps only the years or months
+// with less than 90 % of the days. --gaps writes every run of at least --min-gap missing days
+// (default 1) as "Station;Time;First;Last;Days". The longest gap of every station is printed.
+// --metrics (or $SMHI_METRICS) writes the counts and times of the run as JSON, see common/run_metrics.h.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "common/coverage.h"
+#include "common/decimal_parse.h"
+#include "common/group_query.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_store.h"
+#include "common/table_writer.h"
+
+struct Options {
+    std::string column = "temperature";
+    std::vector<uint8_t> hours; // empty = every hour found
+    bool by_month = false;
+    double below = 2; // only periods with a lower completeness (2 = all)
+    uint32_t min_gap = 1;
+    unsigned threads = 0;
+};
+
+// everything that is written about one station
+struct StationCoverage {
+    std::string name;
+    std::string error;
+    uint64_t rows = 0;
+    std::vector<std::string> times;                  // per slot, the last one "all" with more than one hour
+    std::vector<std::vector<smhi::CoveragePeriod>> periods; // per slot
+    std::vector<std::vector<smhi::CoverageGap>> gaps;       // per slot
+};
+
+void cover_station(const std::string& path, const Options& opt, StationCoverage& out) {
+    out.name = smhi::station_name(path);
+    smhi::StationStore store;
+    if (!store.open(smhi::store_path_for(path))) {
+        out.error = "no binary file " + smhi::store_path_for(path) + ", run the cleaner first";
+        return;
+    }
+    smhi::CoverageMap map(opt.hours);
+    if (!map.load(store, opt.column)) {
+        out.error = "no column " + opt.column;
+        return;
+    }
+    out.rows = store.rows();
+
+    std::vector<int> slots;
+    for (size_t s = 0; s < map.hours().size(); ++s) {
+        slots.push_back(int(s));
+        out.times.push_back(smhi::time_text_from_code(map.hours()[s]));
+    }
+    if (slots.size() > 1) {
+        slots.push_back(smhi::kAllHours);
+        out.times.push_back("all");
+    }
+    for (const int slot : slots) {
+        out.periods.push_back(opt.by_month ? map.by_month(slot) : map.by_year(slot));
+        out.gaps.push_back(map.gaps(slot, opt.min_gap));
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    std::string out_path = "coverage.csv", gaps_path;
+    std::vector<std::string> files;
+    smhi::RunMetrics metrics("coverage");
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--column" && has_value) opt.column = argv[++i];
+        else if (arg == "--times" && has_value) ok = smhi::parse_hours(argv[++i], opt.hours);
+        else if (arg == "--by" && has_value) {
+            const std::string by = argv[++i];
+            opt.by_month = by == "month";
+            ok = by == "month" || by == "year";
+        }
+        else if (arg == "--below" && has_value) ok = smhi::parse_decimal(std::string(argv[++i]), opt.below);
+        else if (arg == "--gaps" && has_value) gaps_path = argv[++i];
+        else if (arg == "--min-gap" && has_value) opt.min_gap = uint32_t(std::stoul(argv[++i]));
+        else if (arg == "--threads" && has_value) opt.threads = std::stoi(argv[++i]);
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (arg[0] != '-') files.push_back(arg);
+        else ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--column NAME] [--times HH,...|all] [--by year|month] [--below F] [--gaps FILE]"
+                     " [--min-gap DAYS] [--threads N] [--out FILE] [--metrics report.json] [station.csv ...]\n";
+        return 1;
+    }
+    if (files.empty())
+        files = {"Falun.csv", "Falsterbo.csv", "Uppsala.csv"};
+
+    auto phase = metrics.phase("scan");
+    std::vector<StationCoverage> stations(files.size());
+    smhi::parallel_for(files.size(), opt.threads,
+                       [&](size_t i, unsigned) { cover_station(files[i], opt, stations[i]); });
+
+    phase = metrics.phase("write");
+    std::vector<smhi::Column> columns = {{"Station", smhi::ColumnType::kText}, {"Year", smhi::ColumnType::kInt}};
+    if (opt.by_month)
+        columns.push_back({"Month", smhi::ColumnType::kInt});
+    columns.push_back({"Time", smhi::ColumnType::kText});
+    columns.push_back({"Days", smhi::ColumnType::kInt});
+    columns.push_back({"Present", smhi::ColumnType::kInt});
+    columns.push_back(smhi::number_column("Completeness", 4));
+    auto out = smhi::open_table_writer(out_path, columns, ';');
+    std::unique_ptr<smhi::TableWriter> gaps_out;
+    if (out && !gaps_path.empty())
+        gaps_out = smhi::open_table_writer(gaps_path, {{"Station", smhi::ColumnType::kText},
+                                                       {"Time", smhi::ColumnType::kText},
+                                                       {"First", smhi::ColumnType::kDate},
+                                                       {"Last", smhi::ColumnType::kDate},
+                                                       {"Days", smhi::ColumnType::kInt}}, ';');
+    if (!out || (!gaps_path.empty() && !gaps_out)) {
+        std::cerr << "Can't create " << (out ? gaps_path : out_path) << "\n";
+        return 1;
+    }
+
+    int failed = 0;
+    for (const StationCoverage& st : stations) {
+        metrics.count("stations");
+        if (!st.error.empty()) {
+            std::cerr << files[size_t(&st - stations.data())] << ": " << st.error << "\n";
+            metrics.failure("station_failed");
+            failed++;
+            continue;
+        }
+        metrics.count("rows_read", st.rows);
+        smhi::CoverageGap longest;
+        std::string longest_time;
+        for (size_t s = 0; s < st.times.size(); ++s) {
+            for (const smhi::CoveragePeriod& p : st.periods[s]) {
+                if (!(p.fraction() < opt.below))
+                    continue;
+                out->add_text(st.name);
+                out->add_int(p.year);
+                if (opt.by_month)
+                    out->add_int(p.month);
+                out->add_text(st.times[s]);
+                out->add_int(p.days);
+                out->add_int(p.present);
+                out->add_number(p.fraction());
+                out->end_row();
+                metrics.count("periods_written");
+            }
+            for (const smhi::CoverageGap& g : st.gaps[s]) {
+                if (g.days > longest.days) {
+                    longest = g;
+                    longest_time = st.times[s];
+                }
+                if (!gaps_out)
+                    continue;
+                gaps_out->add_text(st.name);
+                gaps_out->add_text(st.times[s]);
+                gaps_out->add_int(g.first_day);
+                gaps_out->add_int(g.first_day + int32_t(g.days) - 1);
+                gaps_out->add_int(g.days);
+                gaps_out->end_row();
+                metrics.count("gaps_written");
+            }
+        }
+        std::cout << st.name << ": ";
+        if (longest.days == 0)
+            std::cout << "no gaps\n";
+        else {
+            int y, m, d;
+            smhi::civil_from_days(longest.first_day, y, m, d);
+            char from[16];
+            std::snprintf(from, sizeof from, "%04d-%02d-%02d", y, m, d);
+            std::cout << "longest gap " << longest.days << " days from " << from
+                      << (longest_time.empty() ? "" : " at " + longest_time) << "\n";
+        }
+    }
+    if (!out->close() || (gaps_out && !gaps_out->close())) {
+        std::cerr << "Can't write " << out_path << (gaps_out ? " or " + gaps_path : "") << "\n";
+        return 1;
+    }
+    metrics.count_file("bytes_out", out_path);
+    if (gaps_out)
+        metrics.count_file("bytes_out", gaps_path);
+    std::cout << "Saved the coverage of " << files.size() - failed << " station(s) in " << out_path << "\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,387 @@
+// Tests whether the temperature difference between two stations has a trend, with
+// permutation and block bootstrap resampling.
+//
+// Build: g++ -O2 -pthread difference_significance.cxx -o difference_significance
+// Usage: ./difference_significance [--daily] [--years N] [--resamples N] [--block L] [--threads N] [--seed S]
+//                                  [--metrics report.json] [A.csv:B.csv ...]
+//        (default: Falun.csv:Falsterbo.csv, yearly means of the latest 30 years like FalunVSFalsterbo,
+//         100000 resamples, one thread per core)
+//
+// The series is the signed difference d = A - B of the 18:00 temperatures, either per year
+// (yearly means, as in FalunVSFalsterbo.csv) or per day (--daily, days both stations have).
+// The trend is the least squares slope of d against time, in degrees per year.
+//
+//  - p_permutation: the differences are shuffled in time. If there is no trend every order
+//    is equally likely, so the p-value is the fraction of shuffles with a slope at least as
+//    steep. This assumes the years (or days) are independent.
+//  - p_block: the series minus its mean is resampled in blocks of L consecutive values
+//    (circular block bootstrap). Blocks keep the correlation between neighbouring days or
+//    years, which the permutation test ignores, so this p-value is the safer one for --daily.
+//  - slope_lo/hi and the band: blocks of the residuals around the fitted line are resampled
+//    and added back to the line; the 2.5% and 97.5% quantiles of the refitted slopes and
+//    lines give the 95% confidence interval and band. The slopes and the line at every time go
+//    into streaming quantile sketches (common/tdigest.h) instead of being kept, so the memory
+//    does not grow with the number of resamples.
+//
+// Results: difference_significance.csv (one line per pair) and difference_band_<A>_<B>.csv
+// (time, difference, fitted line, band). --metrics (or $SMHI_METRICS) writes the counts and
+// times of the run as JSON, see common/run_metrics.h.
+//
+// All resamples of all pairs are cut into chunks of 1024 that the threads take one by one
+// (smhi::parallel_for), so a thread that finishes early keeps taking work until none is left.
+// Every chunk has its own random generator seeded from --seed and the chunk number, and the
+// chunks of a pair are folded into its sketches in chunk order, so the results do not depend on
+// the number of threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "common/group_query.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_series.h"
+#include "common/station_store.h"
+#include "common/tdigest.h"
+
+// 18:00 temperature of every day of a station: from the binary copy if there is one, else the CSV
+bool read_evenings(const std::string& csv, smhi::StationSeries& evenings) {
+    smhi::StationStore store;
+    if (store.open(smhi::store_path_for(csv)) && evenings.load(store, "temperature"))
+        return true;
+
+    std::ifstream in(csv);
+    if (!in.is_open()) {
+        std::cerr << "Can't open " << csv << "\n";
+        return false;
+    }
+    std::string line, date, time, temperature;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line);
+        std::getline(ss, date, ';');
+        std::getline(ss, time, ';');
+        std::getline(ss, temperature, ';');
+        int32_t day;
+        double t;
+        if (time == "18:00:00" && smhi::parse_date_text(date, day) && smhi::parse_decimal(temperature, t))
+            evenings.set(day, 18, t);
+    }
+    return true;
+}
+
+// the series of one station pair, kept as plain arrays
+struct Pair {
+    std::string a, b;
+    std::vector<double> time; // year, or day as a fractional year
+    std::vector<double> diff; // A - B
+
+    // filled in by the analysis
+    double slope = 0, intercept = 0;
+    std::vector<double> centered_time; // time - mean(time), for the slope as one dot product
+    double time_ss = 0;                // sum of centered_time^2
+    std::vector<double> residual;      // diff - fitted line
+    std::vector<double> centered_diff; // diff - mean(diff)
+};
+
+// mean of every year of a station, NaN for years without readings
+std::map<int, double> yearly_means(const smhi::StationSeries& evenings) {
+    std::map<int, double> means;
+    if (evenings.empty())
+        return means;
+    int first, last, m, d;
+    smhi::civil_from_days(evenings.first_day(), first, m, d);
+    smhi::civil_from_days(evenings.last_day(), last, m, d);
+    for (int year = first; year <= last; ++year) {
+        int64_t sum;
+        size_t count;
+        evenings.sum_range(0, smhi::days_from_civil(year, 1, 1), smhi::days_from_civil(year, 12, 31), sum, count);
+        if (count > 0)
+            means[year] = double(sum) / evenings.scale() / double(count);
+    }
+    return means;
+}
+
+void yearly_series(const smhi::StationSeries& a, const smhi::StationSeries& b, int n_years, Pair& p) {
+    // yearly means of each station on its own, like FalunVSFalsterbo.cxx
+    const std::map<int, double> ya = yearly_means(a), yb = yearly_means(b);
+    // the latest year of either station, so the same years as in FalunVSFalsterbo.csv
+    int last = 0;
+    if (!ya.empty()) last = ya.rbegin()->first;
+    if (!yb.empty()) last = std::max(last, yb.rbegin()->first);
+    for (const auto& e : ya) {
+        auto other = yb.find(e.first);
+        if (other == yb.end() || e.first <= last - n_years)
+            continue;
+        p.time.push_back(e.first);
+        p.diff.push_back(e.second - other->second);
+    }
+}
+
+void daily_series(const smhi::StationSeries& a, const smhi::StationSeries& b, Pair& p) {
+    a.for_each(0, [&](int32_t day, double t) {
+        if (!b.has(0, day))
+            return;
+        p.time.push_back(1970 + day / 365.2425); // days since 1970 as years
+        p.diff.push_back(t - b.at(0, day));
+    });
+}
+
+// sum of x[i] * y[i], with four partial sums so the compiler can use packed multiply-adds
+double dot(const double* x, const double* y, size_t n) {
+    double s[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        for (int lane = 0; lane < 4; ++lane)
+            s[lane] += x[i + lane] * y[i + lane];
+    for (; i < n; ++i)
+        s[0] += x[i] * y[i];
+    return (s[0] + s[1]) + (s[2] + s[3]);
+}
+
+void prepare(Pair& p) {
+    const size_t n = p.time.size();
+    double mean_t = 0, mean_d = 0;
+    for (size_t i = 0; i < n; ++i) { mean_t += p.time[i]; mean_d += p.diff[i]; }
+    mean_t /= n;
+    mean_d /= n;
+    p.centered_time.resize(n);
+    p.centered_diff.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        p.centered_time[i] = p.time[i] - mean_t;
+        p.centered_diff[i] = p.diff[i] - mean_d;
+    }
+    p.time_ss = dot(p.centered_time.data(), p.centered_time.data(), n);
+    p.slope = dot(p.centered_time.data(), p.centered_diff.data(), n) / p.time_ss;
+    p.intercept = mean_d - p.slope * mean_t;
+    p.residual.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        p.residual[i] = p.diff[i] - (p.intercept + p.slope * p.time[i]);
+}
+
+// copies a circular block bootstrap sample of src (blocks of length block) to out
+template <class Rng>
+void block_resample(const std::vector<double>& src, size_t block, Rng& rng, std::vector<double>& out) {
+    const size_t n = src.size();
+    for (size_t filled = 0; filled < n;) {
+        size_t start = size_t((uint64_t(uint32_t(rng())) * n) >> 32);
+        for (size_t k = 0; k < block && filled < n; ++k) {
+            out[filled++] = src[start];
+            if (++start == n)
+                start = 0;
+        }
+    }
+}
+
+// compression of the sketches; 200 keeps the 2.5% and 97.5% quantiles well within the
+// resampling noise
+const double kSketchCompression = 200;
+
+// what the resamples of one chunk of a pair give
+struct Tally {
+    size_t perm_extreme = 0, block_extreme = 0;
+    smhi::TDigest slopes{kSketchCompression}; // refitted slopes of the residual bootstrap
+    std::vector<smhi::TDigest> lines;          // refitted line at every time of a yearly series
+
+    void fold_in(Tally& other) {
+        perm_extreme += other.perm_extreme;
+        block_extreme += other.block_extreme;
+        slopes.merge(other.slopes);
+        for (size_t i = 0; i < lines.size(); ++i)
+            lines[i].merge(other.lines[i]);
+    }
+};
+
+// All resamples of one pair. Its chunks finish in any order; a chunk waits until the chunks
+// before it are folded in, so the sketches always see them in the same order. Only the chunks
+// that are running at the same time wait, the others are folded in and freed at once.
+struct PairTally {
+    std::mutex mutex;
+    size_t next_chunk = 0;
+    std::map<size_t, Tally> waiting;
+    Tally total;
+};
+
+int main(int argc, char** argv) {
+    bool daily = false;
+    int n_years = 30;
+    size_t n_resamples = 100000;
+    size_t block = 0; // 0 = choose from the length of the series
+    unsigned threads = 0;
+    uint64_t seed = 1;
+    std::vector<std::string> pair_args;
+    smhi::RunMetrics metrics("difference_significance");
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--daily") daily = true;
+        else if (arg == "--years" && has_value) n_years = std::stoi(argv[++i]);
+        else if (arg == "--resamples" && has_value) n_resamples = std::stoul(argv[++i]);
+        else if (arg == "--block" && has_value) block = std::stoul(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else if (arg == "--seed" && has_value) seed = std::stoull(argv[++i]);
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (arg.find(':') != std::string::npos) pair_args.push_back(arg);
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--daily] [--years N] [--resamples N] [--block L] [--threads N] [--seed S]"
+                         " [--metrics report.json] [A.csv:B.csv ...]\n";
+            return 1;
+        }
+    }
+    if (pair_args.empty())
+        pair_args.push_back("Falun.csv:Falsterbo.csv");
+
+    // read every station once, even if it is in several pairs
+    auto phase = metrics.phase("read");
+    std::map<std::string, smhi::StationSeries> stations;
+    std::vector<Pair> pairs;
+    for (const auto& arg : pair_args) {
+        Pair p;
+        p.a = arg.substr(0, arg.find(':'));
+        p.b = arg.substr(arg.find(':') + 1);
+        for (const auto& s : {p.a, p.b})
+            if (!stations.count(s) && !read_evenings(s, stations.emplace(s, smhi::StationSeries({18})).first->second))
+                return 1;
+        if (daily)
+            daily_series(stations[p.a], stations[p.b], p);
+        else
+            yearly_series(stations[p.a], stations[p.b], n_years, p);
+        if (p.time.size() < 3) {
+            std::cerr << p.a << " and " << p.b << " have fewer than 3 common " << (daily ? "days" : "years") << "\n";
+            return 1;
+        }
+        prepare(p);
+        metrics.count("pairs");
+        metrics.count("series_points", p.time.size());
+        pairs.push_back(std::move(p));
+    }
+    metrics.count("stations", stations.size());
+
+    phase = metrics.phase("resample");
+    const auto start = std::chrono::steady_clock::now();
+
+    // chunks of resamples over all pairs: (pair, first resample) in one flat list
+    const size_t chunk = 1024;
+    const size_t chunks_per_pair = (n_resamples + chunk - 1) / chunk;
+    std::vector<PairTally> tallies(pairs.size());
+    for (size_t pi = 0; pi < pairs.size(); ++pi)
+        tallies[pi].total.lines.assign(daily ? 0 : pairs[pi].time.size(), smhi::TDigest(kSketchCompression));
+    smhi::parallel_for(pairs.size() * chunks_per_pair, threads, [&](size_t task, unsigned) {
+        const Pair& p = pairs[task / chunks_per_pair];
+        const size_t first = (task % chunks_per_pair) * chunk;
+        const size_t count = std::min(chunk, n_resamples - first);
+        const size_t n = p.time.size();
+        const size_t L = block ? block : std::max<size_t>(1, size_t(std::cbrt(double(n)) + 0.5));
+        const double observed = std::fabs(p.slope) * (1 - 1e-12); // ties count as extreme
+        const double* tc = p.centered_time.data();
+
+        std::mt19937_64 rng(seed * 0x9E3779B97F4A7C15ULL + task);
+        std::vector<double> sample(p.centered_diff), boot(n);
+        Tally t;
+        t.lines.assign(daily ? 0 : n, smhi::TDigest(kSketchCompression));
+        for (size_t r = 0; r < count; ++r) {
+            // permutation: shuffle the (centered) differences in place
+            for (size_t i = n - 1; i > 0; --i)
+                std::swap(sample[i], sample[size_t((uint64_t(uint32_t(rng())) * (i + 1)) >> 32)]);
+            if (std::fabs(dot(tc, sample.data(), n) / p.time_ss) >= observed)
+                t.perm_extreme++;
+
+            // block bootstrap under "no trend": blocks of the centered differences
+            block_resample(p.centered_diff, L, rng, boot);
+            if (std::fabs(dot(tc, boot.data(), n) / p.time_ss) >= observed)
+                t.block_extreme++;
+
+            // block bootstrap of the residuals around the fitted line, for the interval and band
+            block_resample(p.residual, L, rng, boot);
+            const double s = p.slope + dot(tc, boot.data(), n) / p.time_ss;
+            t.slopes.add(s);
+            if (!daily) {
+                double mean_boot = 0;
+                for (size_t i = 0; i < n; ++i) mean_boot += boot[i];
+                mean_boot /= n;
+                for (size_t i = 0; i < n; ++i)
+                    t.lines[i].add(p.intercept + p.slope * p.time[i] + mean_boot + (s - p.slope) * tc[i]);
+            }
+        }
+        t.slopes.flush();
+        for (smhi::TDigest& line : t.lines)
+            line.flush();
+
+        PairTally& pt = tallies[task / chunks_per_pair];
+        std::lock_guard<std::mutex> lock(pt.mutex);
+        pt.waiting.emplace(task % chunks_per_pair, std::move(t));
+        for (auto next = pt.waiting.find(pt.next_chunk); next != pt.waiting.end(); next = pt.waiting.find(pt.next_chunk)) {
+            pt.total.fold_in(next->second);
+            pt.waiting.erase(next);
+            pt.next_chunk++;
+        }
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    metrics.count("resamples", n_resamples * pairs.size());
+    metrics.count("chunks", pairs.size() * chunks_per_pair);
+
+    phase = metrics.phase("write");
+    std::ofstream summary("difference_significance.csv");
+    if (!summary.is_open()) {
+        std::cerr << "Can't create difference_significance.csv\n";
+        return 1;
+    }
+    summary << "pair,series,n,slope_per_year,slope_lo,slope_hi,p_permutation,p_block,block_length,resamples\n";
+    for (size_t pi = 0; pi < pairs.size(); ++pi) {
+        const Pair& p = pairs[pi];
+        const size_t n = p.time.size();
+        Tally& t = tallies[pi].total;
+        // (k + 1) / (N + 1), so a p-value is never exactly 0
+        const double p_perm = double(t.perm_extreme + 1) / double(n_resamples + 1);
+        const double p_block = double(t.block_extreme + 1) / double(n_resamples + 1);
+        const double lo = t.slopes.quantile(0.025), hi = t.slopes.quantile(0.975);
+        const size_t L = block ? block : std::max<size_t>(1, size_t(std::cbrt(double(n)) + 0.5));
+
+        // the station names without directory or extension: "data/Falun.csv" -> "Falun"
+        const std::string name = smhi::station_name(p.a) + "_" + smhi::station_name(p.b);
+        char line[320];
+        std::snprintf(line, sizeof line, "%s,%s,%zu,%.5f,%.5f,%.5f,%.6f,%.6f,%zu,%zu", name.c_str(),
+                      daily ? "daily" : "yearly", n, p.slope, lo, hi, p_perm, p_block, L, n_resamples);
+        summary << line << "\n";
+        std::printf("%s (%s, n=%zu): trend of A-B %.4f C/year [%.4f, %.4f], p_permutation %.5f, p_block %.5f\n",
+                    name.c_str(), daily ? "daily" : "yearly", n, p.slope, lo, hi, p_perm, p_block);
+
+        // the band is only written for yearly series; for days the line and data are enough
+        const std::string band_name = "difference_band_" + name + ".csv";
+        std::ofstream band(band_name);
+        if (!band.is_open()) {
+            std::cerr << "Can't create " << band_name << "\n";
+            return 1;
+        }
+        band << "time,difference,fit" << (daily ? "" : ",band_lo,band_hi") << "\n";
+        for (size_t i = 0; i < n; ++i) {
+            band << p.time[i] << "," << p.diff[i] << "," << p.intercept + p.slope * p.time[i];
+            if (!daily)
+                band << "," << t.lines[i].quantile(0.025) << "," << t.lines[i].quantile(0.975);
+            band << "\n";
+        }
+        band.close();
+        if (!band) {
+            std::cerr << "Can't write " << band_name << "\n";
+            return 1;
+        }
+    }
+    summary.close();
+    if (!summary) {
+        std::cerr << "Can't write difference_significance.csv\n";
+        return 1;
+    }
+    phase.stop();
+    std::printf("%zu resamples x %zu pair(s) in %.2f s, saved difference_significance.csv\n", n_resamples, pairs.size(),
+                seconds);
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Percentile bands (p5/p50/p95 by default) of every day of the year for every station,
+// from one pass over each station and without keeping the readings.
+//
+// Build: g++ -std=c++17 -O2 -pthread doy_percentiles.cxx -o doy_percentiles
+// Usage: ./doy_percentiles [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH,...|all]
+//                          [--quantiles Q,Q,...] [--compression C] [--threads N] [--out FILE]
+//                          [--metrics report.json] [station.csv ...]
+//        (default: Falsterbo.csv, every reading, quantiles 0.05,0.5,0.95)
+//
+// Every reading goes into a streaming quantile sketch (common/tdigest.h) of its station and day
+// of the year; days are numbered like in temperature_given_day.cube, so 02-29 is a day of its own.
+// The rows of a station are cut into at most 64 pieces that are read on all cores, each piece
+// fills its own 366 sketches and the sketches are merged at the end. The pieces do not depend
+// on the number of threads, so neither do the results.
+//
+// The bands are saved to doy_percentiles.csv as "Station;Day;Count;p5;p50;p95"; the ROOT macro
+// climatology_bands() in temperature_given_day.C draws them. A reference period such as
+// --from 1961-01-01 --to 1990-12-31 only reads the months of that period (see common/date_index.h).
+// --metrics (or $SMHI_METRICS) writes the counts and times of the run as JSON, see common/run_metrics.h.
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "common/doy_cube.h"
+#include "common/group_query.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_store.h"
+#include "common/tdigest.h"
+
+struct Options {
+    std::string column = "temperature";
+    int32_t from = INT32_MIN, to = INT32_MAX;
+    uint32_t hours = 0; // bit h = keep hour h, 0 = every row
+    std::vector<double> quantiles = {0.05, 0.5, 0.95};
+    double compression = 200;
+    unsigned threads = 0;
+};
+
+bool parse_quantiles(const std::string& list, std::vector<double>& quantiles) {
+    quantiles.clear();
+    std::stringstream ss(list);
+    std::string item;
+    double q;
+    while (std::getline(ss, item, ',')) {
+        if (!smhi::parse_decimal(item, q) || q < 0 || q > 1)
+            return false;
+        quantiles.push_back(q);
+    }
+    return !quantiles.empty();
+}
+
+// 0.05 -> "p5", 0.5 -> "p50", 0.999 -> "p99.9"
+std::string quantile_name(double q) {
+    char text[32];
+    std::snprintf(text, sizeof text, "p%g", q * 100);
+    return text;
+}
+
+using DaySketches = std::vector<smhi::TDigest>; // one per day of the year (cube slot)
+
+// Fills the sketches of one station. Returns false with a message if it can't be read.
+bool sketch_station(const std::string& path, const Options& opt, DaySketches& days, std::string& error) {
+    smhi::StationStore store;
+    smhi::GroupQuery q;
+    q.from = opt.from;
+    q.to = opt.to;
+    error = smhi::open_station_query(path, opt.column, store, q);
+    if (!error.empty())
+        return false;
+    const size_t c = q.column, begin = q.row_begin, end = q.row_end;
+
+    const size_t min_piece = 1 << 16;
+    const size_t n_pieces = std::max<size_t>(1, std::min<size_t>(64, (end - begin) / min_piece));
+    std::vector<DaySketches> pieces(n_pieces, DaySketches(smhi::kCubeDays, smhi::TDigest(opt.compression)));
+
+    const int32_t* date = store.date();
+    const uint8_t* hour = store.time_code();
+    smhi::parallel_for(n_pieces, opt.threads, [&](size_t p, unsigned) {
+        DaySketches& sketches = pieces[p];
+        const size_t lo = begin + (end - begin) * p / n_pieces, hi = begin + (end - begin) * (p + 1) / n_pieces;
+        for (size_t i = lo; i < hi; ++i) {
+            if (date[i] < opt.from || date[i] > opt.to)
+                continue;
+            if (opt.hours != 0 && (hour[i] >= 24 || !((opt.hours >> hour[i]) & 1)))
+                continue;
+            const double v = store.value(c, i);
+            if (std::isnan(v))
+                continue;
+            int y, m, d;
+            smhi::civil_from_days(date[i], y, m, d);
+            sketches[smhi::cube_slot(m, d)].add(v);
+        }
+        // a piece has only a few hundred values per day, too few to fill the buffers
+        for (smhi::TDigest& sketch : sketches)
+            sketch.flush();
+    });
+
+    // the pieces are merged in file order
+    days = std::move(pieces[0]);
+    for (size_t p = 1; p < n_pieces; ++p)
+        for (int slot = 0; slot < smhi::kCubeDays; ++slot)
+            days[slot].merge(pieces[p][slot]);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    std::string out_path = "doy_percentiles.csv";
+    std::vector<std::string> files;
+    smhi::RunMetrics metrics("doy_percentiles");
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--column" && has_value) opt.column = argv[++i];
+        else if (arg == "--from" && has_value) ok = smhi::parse_date_text(argv[++i], opt.from);
+        else if (arg == "--to" && has_value) ok = smhi::parse_date_text(argv[++i], opt.to);
+        else if (arg == "--times" && has_value) ok = smhi::parse_hours(argv[++i], opt.hours);
+        else if (arg == "--quantiles" && has_value) ok = parse_quantiles(argv[++i], opt.quantiles);
+        else if (arg == "--compression" && has_value)
+            ok = smhi::parse_decimal(std::string(argv[++i]), opt.compression) && opt.compression >= 10;
+        else if (arg == "--threads" && has_value) opt.threads = std::stoi(argv[++i]);
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (arg[0] != '-') files.push_back(arg);
+        else ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH,...|all]"
+                     " [--quantiles Q,Q,...] [--compression C] [--threads N] [--out FILE] [--metrics report.json]"
+                     " [station.csv ...]\n";
+        return 1;
+    }
+    if (files.empty())
+        files.push_back("Falsterbo.csv");
+
+    FILE* out = std::fopen(out_path.c_str(), "w");
+    if (!out) {
+        std::cerr << "Can't create " << out_path << "\n";
+        return 1;
+    }
+    std::fprintf(out, "Station;Day;Count");
+    for (double q : opt.quantiles)
+        std::fprintf(out, ";%s", quantile_name(q).c_str());
+    std::fprintf(out, "\n");
+
+    // one station at a time, its pieces on all cores, so only one station's sketches are in memory
+    int failed = 0;
+    for (const auto& path : files) {
+        DaySketches days;
+        std::string error;
+        metrics.count("stations");
+        auto phase = metrics.phase("sketch");
+        if (!sketch_station(path, opt, days, error)) {
+            std::cerr << path << ": " << error << "\n";
+            metrics.failure("station_failed");
+            failed++;
+            continue;
+        }
+        phase = metrics.phase("write");
+        const std::string name = smhi::station_name(path);
+        for (int slot = 0; slot < smhi::kCubeDays; ++slot) {
+            smhi::TDigest& sketch = days[slot];
+            if (sketch.empty())
+                continue;
+            std::fprintf(out, "%s;%s;%.0f", name.c_str(), smhi::cube_slot_name(slot).c_str(), sketch.count());
+            metrics.count("readings", uint64_t(sketch.count()));
+            metrics.count("days_written");
+            for (double q : opt.quantiles)
+                std::fprintf(out, ";%.4g", sketch.quantile(q));
+            std::fprintf(out, "\n");
+        }
+    }
+    const bool write_failed = std::ferror(out) != 0;
+    if (std::fclose(out) != 0 || write_failed) {
+        std::cerr << "Can't write " << out_path << "\n";
+        return 1;
+    }
+    metrics.count_file("bytes_out", out_path);
+    std::cout << "Saved percentile bands of every day of the year for " << files.size() - failed << " station(s) in "
+              << out_path << "\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,621 @@
+// Runs a pipeline of stages (compile, clean, analyse, plot, ...) and only the stages whose inputs
+// have changed since the last run, independent stages at the same time.
+//
+// Build: g++ -std=c++17 -O2 -pthread pipeline.cxx -o pipeline
+// Usage: ./pipeline [--jobs N] [--force] [--metrics report.json] pipeline.txt
+//        (see rain_analysis/pipeline.txt; the commands run in the folder of the pipeline file)
+//
+// The pipeline file has one stage per line, "name ; inputs ; outputs ; command", with the
+// inputs and outputs separated by spaces. A stage that reads a file another stage writes
+// runs after it. Besides stages there are
+//     var year = 1961,2024             values of {year}
+//     var station = A=Lund,B=Uppsala   {station} is A or B, {station.name} is Lund or Uppsala
+//     cache .cache                     where the state and the logs are kept, {cache} in stages
+// A stage line that uses variables stands for one stage per combination of their values, e.g.
+// analyze_{station.name}_{year} gives analyze_Lund_1961, analyze_Lund_2024, ... Inputs may be
+// patterns such as ../common/*.h, which are matched when the file is read.
+//
+// The key of a stage is a hash of its command, its output names and the contents of its inputs
+// (common/content_hash.h). A stage whose key is the one of its last successful run and whose
+// outputs are all there is skipped. The key is checked when the stages before it have finished,
+// so a stage that was run again but wrote the same files as before does not make the stages
+// after it run. Files are only hashed again when their size or time stamp has changed.
+// The keys and file hashes are kept in CACHE/pipeline.state, and what every command printed in
+// CACHE/logs/<stage>.log. --force runs every stage.
+//
+// Every command runs with SMHI_METRICS=CACHE/metrics/<stage>.json, where the tools write the
+// counters and times of their run (common/run_metrics.h). At the end CACHE/metrics.json (or the
+// file of --metrics) gets the report of the whole run: how many stages ran, how many files had
+// to be hashed, and for every stage its status, when it started and how long it took after the
+// start of the run, and the report of its tool.
+
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "common/content_hash.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+
+struct Stage {
+    std::string name, command;
+    std::vector<std::string> inputs, outputs;
+    std::vector<size_t> users; // stages that read an output of this one
+    size_t waiting = 0;        // stages this one reads from that have not finished yet
+};
+
+struct VarValue {
+    std::string key, name; // "A=Lund" -> A, Lund; "1961" -> 1961, 1961
+};
+
+std::string trim(const std::string& s) {
+    const size_t a = s.find_first_not_of(" \t\r");
+    if (a == std::string::npos)
+        return "";
+    return s.substr(a, s.find_last_not_of(" \t\r") - a + 1);
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep))
+        parts.push_back(trim(item));
+    return parts;
+}
+
+// "./a/b" -> "a/b", so that one stage's output and another's input compare equal
+std::string clean_path(std::string path) {
+    while (path.size() > 2 && path.compare(0, 2, "./") == 0)
+        path.erase(0, 2);
+    return path;
+}
+
+// The names of the variables used in text ({year}, {station.name} -> year, station), in order.
+// Returns false with a message for an unknown one; ${...} is left to the shell.
+bool used_vars(const std::string& text, const std::map<std::string, std::vector<VarValue>>& vars,
+               std::vector<std::string>& used, std::string& error) {
+    for (size_t open = text.find('{'); open != std::string::npos; open = text.find('{', open + 1)) {
+        if (open > 0 && text[open - 1] == '$')
+            continue;
+        const size_t close = text.find('}', open);
+        if (close == std::string::npos)
+            break;
+        std::string var = text.substr(open + 1, close - open - 1);
+        var = var.substr(0, var.find('.'));
+        if (!vars.count(var)) {
+            error = "unknown variable {" + var + "}";
+            return false;
+        }
+        bool seen = false;
+        for (const auto& u : used)
+            seen = seen || u == var;
+        if (!seen)
+            used.push_back(var);
+    }
+    return true;
+}
+
+// text with {var} and {var.name} replaced by the values of one combination
+std::string expand(const std::string& text, const std::map<std::string, VarValue>& values) {
+    std::string out;
+    size_t pos = 0;
+    for (size_t open = text.find('{'); open != std::string::npos; open = text.find('{', pos)) {
+        const size_t close = text.find('}', open);
+        if (close == std::string::npos || (open > 0 && text[open - 1] == '$')) {
+            out += text.substr(pos, open + 1 - pos);
+            pos = open + 1;
+            continue;
+        }
+        const std::string var = text.substr(open + 1, close - open - 1);
+        const size_t dot = var.find('.');
+        const VarValue& v = values.at(var.substr(0, dot));
+        out += text.substr(pos, open - pos);
+        out += dot != std::string::npos && var.substr(dot + 1) == "name" ? v.name : v.key;
+        pos = close + 1;
+    }
+    return out + text.substr(pos);
+}
+
+// The files of a list of inputs, with the patterns matched.
+std::vector<std::string> expand_files(const std::string& list) {
+    std::vector<std::string> files;
+    for (const auto& item : split(list, ' ')) {
+        if (item.empty())
+            continue;
+        if (item.find_first_of("*?[") == std::string::npos) {
+            files.push_back(clean_path(item));
+            continue;
+        }
+        glob_t matches;
+        if (glob(item.c_str(), GLOB_NOCHECK, nullptr, &matches) == 0)
+            for (size_t i = 0; i < matches.gl_pathc; ++i)
+                files.push_back(clean_path(matches.gl_pathv[i]));
+        globfree(&matches);
+    }
+    return files;
+}
+
+// Reads the pipeline file. Returns false with a message if it has a mistake.
+bool read_pipeline(std::istream& in, std::vector<Stage>& stages, std::string& cache, std::string& error) {
+    std::map<std::string, std::vector<VarValue>> vars;
+    vars["cache"] = {{cache, cache}};
+    std::string text;
+    int line = 0;
+    while (std::getline(in, text)) {
+        line++;
+        text = trim(text);
+        if (text.empty() || text[0] == '#')
+            continue;
+        const std::string where = "line " + std::to_string(line) + ": ";
+
+        if (text.compare(0, 6, "cache ") == 0) {
+            cache = trim(text.substr(6));
+            vars["cache"] = {{cache, cache}};
+            continue;
+        }
+        if (text.compare(0, 4, "var ") == 0) {
+            const size_t eq = text.find('=');
+            if (eq == std::string::npos) {
+                error = where + "expected var NAME = value,value,...";
+                return false;
+            }
+            std::vector<VarValue>& values = vars[trim(text.substr(4, eq - 4))];
+            values.clear();
+            for (const auto& item : split(text.substr(eq + 1), ',')) {
+                const size_t named = item.find('=');
+                values.push_back(named == std::string::npos ? VarValue{item, item}
+                                                            : VarValue{item.substr(0, named), item.substr(named + 1)});
+            }
+            if (values.empty()) {
+                error = where + "a var needs at least one value";
+                return false;
+            }
+            continue;
+        }
+
+        if (std::count(text.begin(), text.end(), ';') < 3) {
+            error = where + "expected name ; inputs ; outputs ; command";
+            return false;
+        }
+        std::vector<std::string> used;
+        if (!used_vars(text, vars, used, error)) {
+            error = where + error;
+            return false;
+        }
+
+        // one stage for every combination of the values of the variables it uses
+        std::vector<size_t> pick(used.size(), 0);
+        while (true) {
+            std::map<std::string, VarValue> values;
+            for (size_t v = 0; v < used.size(); ++v)
+                values[used[v]] = vars[used[v]][pick[v]];
+            const std::string stage_text = expand(text, values);
+            const size_t a = stage_text.find(';'), b = stage_text.find(';', a + 1), c = stage_text.find(';', b + 1);
+            Stage stage;
+            stage.name = trim(stage_text.substr(0, a));
+            stage.inputs = expand_files(stage_text.substr(a + 1, b - a - 1));
+            stage.outputs = expand_files(stage_text.substr(b + 1, c - b - 1));
+            stage.command = trim(stage_text.substr(c + 1));
+            stages.push_back(stage);
+
+            size_t v = 0;
+            while (v < used.size() && ++pick[v] == vars[used[v]].size())
+                pick[v++] = 0;
+            if (v == used.size())
+                break;
+        }
+    }
+    return true;
+}
+
+// Connects every stage to the stages that read its outputs. Returns false with a message
+// for two stages with the same name or output, or stages that wait for each other.
+bool link_stages(std::vector<Stage>& stages, std::string& error) {
+    std::map<std::string, size_t> names, writer;
+    for (size_t i = 0; i < stages.size(); ++i) {
+        if (!names.emplace(stages[i].name, i).second) {
+            error = "two stages are called " + stages[i].name;
+            return false;
+        }
+        for (const auto& out : stages[i].outputs)
+            if (!writer.emplace(out, i).second) {
+                error = out + " is written by " + stages[writer[out]].name + " and " + stages[i].name;
+                return false;
+            }
+    }
+    for (size_t i = 0; i < stages.size(); ++i)
+        for (const auto& in : stages[i].inputs) {
+            auto w = writer.find(in);
+            if (w == writer.end())
+                continue;
+            if (w->second == i) {
+                error = stages[i].name + " reads its own output " + in;
+                return false;
+            }
+            stages[w->second].users.push_back(i);
+            stages[i].waiting++;
+        }
+
+    // every stage must be reachable from the stages that wait for nothing
+    std::vector<size_t> waiting(stages.size());
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < stages.size(); ++i)
+        if ((waiting[i] = stages[i].waiting) == 0)
+            ready.push_back(i);
+    size_t reached = 0;
+    while (!ready.empty()) {
+        const size_t i = ready.back();
+        ready.pop_back();
+        reached++;
+        for (size_t u : stages[i].users)
+            if (--waiting[u] == 0)
+                ready.push_back(u);
+    }
+    if (reached != stages.size()) {
+        error = "some stages wait for each other in a circle";
+        return false;
+    }
+    return true;
+}
+
+// Hashes of files, remembered with their size and time stamp so that they are only
+// computed again for files that have changed.
+class FileHashes {
+public:
+    struct Entry {
+        uint64_t size = 0, mtime = 0, hash = 0;
+    };
+
+    // Returns false if the file can't be read.
+    bool get(const std::string& path, uint64_t& hash) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+        const uint64_t size = uint64_t(st.st_size);
+        const uint64_t mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000ULL + uint64_t(st.st_mtim.tv_nsec);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            if (it != entries_.end() && it->second.size == size && it->second.mtime == mtime) {
+                hash = it->second.hash;
+                return true;
+            }
+        }
+        if (!smhi::hash_file(path, hash))
+            return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_[path] = {size, mtime, hash};
+        hashed_++;
+        hashed_bytes_ += size;
+        return true;
+    }
+
+    // the files hashed since the start, and their bytes
+    uint64_t hashed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hashed_;
+    }
+    uint64_t hashed_bytes() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return hashed_bytes_;
+    }
+
+    void set(const std::string& path, const Entry& e) { entries_[path] = e; }
+    std::map<std::string, Entry> entries() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+    uint64_t hashed_ = 0, hashed_bytes_ = 0;
+};
+
+// CACHE/pipeline.state:
+//     stage <key> <name>
+//     file <size> <mtime> <hash> <path>
+void load_state(const std::string& path, std::map<std::string, std::string>& keys, FileHashes& files) {
+    std::ifstream in(path);
+    std::string kind;
+    while (in >> kind) {
+        if (kind == "stage") {
+            std::string key, name;
+            in >> key;
+            std::getline(in >> std::ws, name);
+            keys[name] = key;
+        }
+        else if (kind == "file") {
+            FileHashes::Entry e;
+            std::string hash, file;
+            in >> e.size >> e.mtime >> hash;
+            std::getline(in >> std::ws, file);
+            e.hash = std::strtoull(hash.c_str(), nullptr, 16);
+            files.set(file, e);
+        }
+        else
+            std::getline(in, kind);
+    }
+}
+
+// written to a new file that then replaces the old one, so a run that is stopped halfway
+// leaves a complete state behind
+bool save_state(const std::string& path, const std::map<std::string, std::string>& keys, FileHashes& files) {
+    const std::string tmp = path + ".new";
+    FILE* out = std::fopen(tmp.c_str(), "w");
+    if (!out)
+        return false;
+    std::fprintf(out, "# written by pipeline, the keys of the stages that ran and the hashes of their files\n");
+    for (const auto& k : keys)
+        std::fprintf(out, "stage %s %s\n", k.second.c_str(), k.first.c_str());
+    for (const auto& f : files.entries())
+        std::fprintf(out, "file %llu %llu %s %s\n", (unsigned long long)f.second.size, (unsigned long long)f.second.mtime,
+                     smhi::hash_text(f.second.hash).c_str(), f.first.c_str());
+    const bool write_failed = std::ferror(out) != 0;
+    if (std::fclose(out) != 0 || write_failed)
+        return false;
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+enum class Status { kWaiting, kRan, kSkipped, kFailed, kNotRun };
+const char* const kStatusNames[] = {"waiting", "ran", "skipped", "failed", "not_run"};
+
+// what the report says about one stage
+struct StageRun {
+    double start = 0, wall = 0; // seconds after the start of the pipeline, and of the command
+    std::string report;         // the metrics of the tool, if it wrote any
+};
+
+// the text of a file, empty if it can't be read
+std::string read_text(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// the "stages" member of the pipeline report
+std::string stages_json(const std::vector<Stage>& stages, const std::vector<Status>& status,
+                        const std::vector<StageRun>& runs) {
+    std::string out = "[";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        char times[96];
+        std::snprintf(times, sizeof times, ", \"start_s\": %.6f, \"wall_s\": %.6f", runs[i].start, runs[i].wall);
+        std::string report = runs[i].report;
+        while (!report.empty() && (report.back() == '\n' || report.back() == ' '))
+            report.pop_back();
+        out += i == 0 ? "\n" : ",\n";
+        out += "    {\"name\": " + smhi::json_string(stages[i].name) + ", \"status\": \"" + kStatusNames[int(status[i])] +
+               "\"" + times + ", \"metrics\": " + (report.empty() ? "null" : report) + "}";
+    }
+    return out + (stages.empty() ? "]" : "\n  ]");
+}
+
+int main(int argc, char** argv) {
+    unsigned jobs = 0;
+    bool force = false;
+    std::string pipeline_path, metrics_path;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) jobs = std::stoi(argv[++i]);
+        else if (arg == "--force") force = true;
+        else if (arg == "--metrics" && i + 1 < argc) metrics_path = std::filesystem::absolute(argv[++i]).string();
+        else if (arg[0] != '-' && pipeline_path.empty()) pipeline_path = arg;
+        else ok = false;
+    }
+    if (!ok || pipeline_path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--jobs N] [--force] [--metrics report.json] pipeline.txt\n";
+        return 1;
+    }
+
+    // the paths in the pipeline file are relative to its folder
+    const size_t slash = pipeline_path.find_last_of('/');
+    if (slash != std::string::npos) {
+        if (chdir(pipeline_path.substr(0, slash + 1).c_str()) != 0) {
+            std::cerr << "Can't change to the folder of " << pipeline_path << "\n";
+            return 1;
+        }
+        pipeline_path = pipeline_path.substr(slash + 1);
+    }
+    std::ifstream in(pipeline_path);
+    if (!in.is_open()) {
+        std::cerr << "Can't open " << pipeline_path << "\n";
+        return 1;
+    }
+    std::vector<Stage> stages;
+    std::string cache = ".cache", error;
+    if (!read_pipeline(in, stages, cache, error) || !link_stages(stages, error)) {
+        std::cerr << pipeline_path << ": " << error << "\n";
+        return 1;
+    }
+
+    smhi::RunMetrics metrics("pipeline");
+    metrics.set_path(metrics_path.empty() ? cache + "/metrics.json" : metrics_path);
+    const auto pipeline_start = std::chrono::steady_clock::now();
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache + "/logs", ec);
+    std::filesystem::create_directories(cache + "/metrics", ec);
+    // absolute, for the commands that change to another folder
+    const std::string metrics_dir = std::filesystem::absolute(cache + "/metrics").string();
+    const std::string state_path = cache + "/pipeline.state";
+    std::map<std::string, std::string> keys; // of the last successful run of every stage
+    FileHashes files;
+    load_state(state_path, keys, files);
+
+    // the key of a stage from its command, outputs and the contents of its inputs
+    auto stage_key = [&](const Stage& stage, std::string& key, std::string& missing) {
+        uint64_t h = smhi::content_hash(stage.command);
+        for (const auto& input : stage.inputs) {
+            uint64_t file_hash;
+            if (!files.get(input, file_hash)) {
+                missing = input;
+                return false;
+            }
+            h = smhi::content_hash(input, h);
+            h = smhi::content_hash(reinterpret_cast<const char*>(&file_hash), sizeof file_hash, h);
+        }
+        for (const auto& output : stage.outputs)
+            h = smhi::content_hash(output, h);
+        key = smhi::hash_text(h);
+        return true;
+    };
+    auto outputs_there = [](const Stage& stage) {
+        struct stat st;
+        for (const auto& output : stage.outputs)
+            if (stat(output.c_str(), &st) != 0)
+                return false;
+        return true;
+    };
+    // Runs the command, with what it prints in its log and the metrics of its tool in run.report.
+    // true if it worked and wrote every output.
+    auto run = [&](const Stage& stage, const std::string& log, StageRun& stage_run) {
+        for (const auto& output : stage.outputs) {
+            const std::filesystem::path parent = std::filesystem::path(output).parent_path();
+            if (!parent.empty())
+                std::filesystem::create_directories(parent, ec);
+        }
+        const std::string report = metrics_dir + "/" + stage.name + ".json";
+        std::remove(report.c_str());
+        const std::string command =
+            "( export SMHI_METRICS='" + report + "'; " + stage.command + " ) > '" + log + "' 2>&1";
+        const bool worked = std::system(command.c_str()) == 0 && outputs_there(stage);
+        stage_run.report = read_text(report);
+        return worked;
+    };
+
+    // Every worker takes the next stage whose inputs are ready. The state below belongs to mutex.
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Status> status(stages.size(), Status::kWaiting);
+    std::vector<StageRun> runs(stages.size()); // each written only by the worker that has the stage
+    std::deque<size_t> ready;
+    size_t finished = 0;
+    for (size_t i = 0; i < stages.size(); ++i)
+        if (stages[i].waiting == 0)
+            ready.push_back(i);
+
+    // the stages after a failed one can't run
+    auto not_run = [&](size_t failed) {
+        std::vector<size_t> todo = {failed};
+        while (!todo.empty()) {
+            const size_t i = todo.back();
+            todo.pop_back();
+            for (size_t u : stages[i].users)
+                if (status[u] == Status::kWaiting) {
+                    status[u] = Status::kNotRun;
+                    finished++;
+                    todo.push_back(u);
+                }
+        }
+    };
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&] { return !ready.empty() || finished == stages.size(); });
+            if (ready.empty())
+                return;
+            const size_t i = ready.front();
+            ready.pop_front();
+            const Stage& stage = stages[i];
+            const std::string old_key = force || !keys.count(stage.name) ? "" : keys[stage.name];
+            lock.unlock();
+
+            Status result;
+            std::string key, missing;
+            const std::chrono::duration<double> since_start = std::chrono::steady_clock::now() - pipeline_start;
+            runs[i].start = since_start.count();
+            auto phase = metrics.phase("keys");
+            const bool have_key = stage_key(stage, key, missing);
+            phase.stop();
+            if (!have_key) {
+                std::printf("FAILED  %s: %s is missing\n", stage.name.c_str(), missing.c_str());
+                result = Status::kFailed;
+            }
+            else if (key == old_key && outputs_there(stage)) {
+                std::printf("skip    %s\n", stage.name.c_str());
+                result = Status::kSkipped;
+            }
+            else {
+                std::printf("run     %s\n", stage.name.c_str());
+                std::fflush(stdout);
+                const std::string log = cache + "/logs/" + stage.name + ".log";
+                const auto start = std::chrono::steady_clock::now();
+                const bool worked = run(stage, log, runs[i]);
+                const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+                runs[i].wall = took.count();
+                if (worked) {
+                    std::printf("done    %s (%.1f s)\n", stage.name.c_str(), took.count());
+                    result = Status::kRan;
+                }
+                else {
+                    std::printf("FAILED  %s, see %s\n", stage.name.c_str(), log.c_str());
+                    result = Status::kFailed;
+                }
+            }
+            std::fflush(stdout);
+
+            lock.lock();
+            status[i] = result;
+            finished++;
+            if (result == Status::kFailed) {
+                keys.erase(stage.name);
+                not_run(i);
+            }
+            else {
+                if (result == Status::kRan)
+                    keys[stage.name] = key;
+                for (size_t u : stage.users)
+                    if (--stages[u].waiting == 0 && status[u] == Status::kWaiting)
+                        ready.push_back(u);
+            }
+            if (result != Status::kSkipped && !save_state(state_path, keys, files))
+                std::cerr << "Can't write " << state_path << "\n";
+            changed.notify_all();
+        }
+    };
+
+    const unsigned n_threads = std::min<size_t>(jobs == 0 ? smhi::default_threads() : jobs, stages.size());
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < n_threads; ++t)
+        threads.emplace_back(worker);
+    for (auto& t : threads)
+        t.join();
+    if (!save_state(state_path, keys, files))
+        std::cerr << "Can't write " << state_path << "\n";
+
+    size_t count[5] = {};
+    for (Status st : status)
+        count[int(st)]++;
+    metrics.count("stages", stages.size());
+    for (int st = int(Status::kRan); st <= int(Status::kNotRun); ++st)
+        metrics.count(kStatusNames[st], count[st]);
+    metrics.count("files_hashed", files.hashed());
+    metrics.count("bytes_hashed", files.hashed_bytes());
+    metrics.add_json("commands_cpu_s", std::to_string(smhi::children_cpu_seconds()));
+    metrics.add_json("commands_peak_rss_kb", std::to_string(smhi::peak_rss_kb(RUSAGE_CHILDREN)));
+    metrics.add_json("stages", stages_json(stages, status, runs));
+
+    std::printf("%zu stages: %zu ran, %zu skipped, %zu failed, %zu not run\n", stages.size(),
+                count[int(Status::kRan)], count[int(Status::kSkipped)], count[int(Status::kFailed)],
+                count[int(Status::kNotRun)]);
+    return count[int(Status::kFailed)] == 0 && count[int(Status::kNotRun)] == 0 ? 0 : 1;
+}
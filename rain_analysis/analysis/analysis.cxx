@@ -1,7 +1,33 @@
 // Build: g++  analysis.cxx -o analysis
 
+// One year and one station, written to one file:
 // ./analysis ../data_clean/Rain_temperature_cleaned.csv 1961 A ../results/monthly_Lund_1961.csv
 // ./analysis ../data_clean/Rain_temperature_cleaned.csv 2024 B ../results/monthly_Uppsala_2024.csv
+// ./analysis ../data_clean/Rain_temperature_cleaned.csv 2024 B ../results/monthly_Uppsala_2024.arrow   (Arrow IPC file)
+//
+// Many years and stations in a single pass over the file, one monthly_<city>_<year>.csv per pair in the output folder:
+// ./analysis ../data_clean/Rain_temperature_cleaned.csv 1961,2024 A=Lund,B=Uppsala ../results
+// ./analysis ../data_clean/Rain_temperature_cleaned.csv all A=Lund,B=Uppsala ../results
+//
+// A station is A or B (the first or second grid point of the file), or grid points chosen by their coordinates
+// from the grid points file the cleaner writes next to the csv (Rain_temperature_cleaned.points):
+//   near:LAT:LON                             the grid point closest to LAT, LON (degrees N, E)
+//   radius:LAT:LON:KM                        every grid point within KM km of LAT, LON
+//   box:LAT_MIN:LAT_MAX:LON_MIN:LON_MAX      every grid point in the box
+// With more than one grid point the daily rain and temperature of the station are their means (leaving out the
+// missing values), so a region gets the monthly rain of its mean daily rain:
+// ./analysis ../data_clean/Rain_temperature_cleaned.csv all near:59.33:18.07=Stockholm,box:55.3:56.5:12.4:14.6=Skane ../results
+// The grid points are found with a spatial index (common/spatial_index.h), and only their columns are read.
+//
+// With explicit years, the month index the cleaner writes next to the csv (Rain_temperature_cleaned.idx) is used
+// to read only the rows of those years, from the binary copy or the csv.
+//
+// With SMHI_METRICS=report.json in the environment the rows, bytes and times of the run are written there
+// as JSON (see common/run_metrics.h).
+//
+// Built with ROOT, the same results can go into one ROOT file instead (TTree "monthly", one entry per city, year and month):
+// g++ -DWITH_ROOT analysis.cxx -o analysis $(root-config --cflags --libs)
+// ./analysis ../data_clean/Rain_temperature_cleaned.csv all A=Lund,B=Uppsala ../results/monthly.root
 
 #include <iostream>
 #include <fstream>
@@ -10,6 +36,15 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include "../../common/date_index.h"
+#include "../../common/run_metrics.h"
+#include "../../common/spatial_index.h"
+#include "../../common/station_store.h"
+#include "../../common/table_writer.h"
+#ifdef WITH_ROOT
+#include <TFile.h>
+#include <TTree.h>
+#endif
 
 std::vector<std::string> split_csv(const std::string& s){
     /*
@@ -69,6 +104,215 @@ Lastly,
 
 */
 
+// monthly data points of one station in one year, index 1..12 is the month
+struct MonthlyStats {
+    double rain_sum[13]   = {0};
+    int    rainy_days[13] = {0};
+    double tmax[13];
+    double tmin[13];
+    bool   seen[13]       = {false};
+
+    MonthlyStats(){
+        for(int m=1;m<=12;++m){ tmax[m] = -1e300; tmin[m] = 1e300; }
+    }
+
+    // adds the rainfall and temperature of one day of month m
+    void add_day(int m, double rain, double temp){
+        // rainfall
+        if(rain > 0.0) rainy_days[m] += 1;
+        rain_sum[m] += std::max(0.0, rain);
+
+        // temperature extremes
+        if(!std::isnan(temp)){
+            tmax[m] = std::max(tmax[m], temp);
+            tmin[m] = std::min(tmin[m], temp);
+            seen[m] = true;
+        }
+    }
+};
+
+// the grid points of a station in the cleaned file together with the city name used for the output files
+struct StationSel {
+    std::string station;        // "A", "B", "near:55.70:13.19", "box:55.3:56.5:12.4:14.6", ...
+    std::string city;           // "Lund"
+    std::vector<double> where;  // the numbers after near:, radius: or box:
+    std::vector<size_t> points; // grid point p has the rainfall in csv column 2p+1 and the temperature in 2p+2
+    std::vector<MonthlyStats> years; // one entry per year, years[0] is first_year
+};
+
+// "A=Lund,B=Uppsala" -> stations A and B named Lund and Uppsala; a plain "A" is named "A"
+// "near:55.70:13.19=Lund" -> the grid point closest to 55.70 N, 13.19 E, named Lund
+bool parse_stations(const std::string& spec, std::vector<StationSel>& stations){
+    std::stringstream ss(spec);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        StationSel st;
+        const size_t eq = item.find('=');
+        st.station = item.substr(0, eq);
+        st.city    = eq != std::string::npos && eq + 1 < item.size() ? item.substr(eq + 1) : st.station;
+        if(st.station == "A") st.points = {0}; // columns 1 & 2
+        else if(st.station == "B") st.points = {1}; // columns 3 & 4
+        else{
+            // "box:55.3:56.5:12.4:14.6" -> box and 4 numbers
+            std::stringstream fields(st.station);
+            std::string kind, number;
+            std::getline(fields, kind, ':');
+            while(std::getline(fields, number, ':')){
+                double x;
+                if(!smhi::parse_decimal(number, x)) return false;
+                st.where.push_back(x);
+            }
+            const size_t wanted = kind == "near" ? 2 : kind == "radius" ? 3 : kind == "box" ? 4 : 0;
+            if(wanted == 0 || st.where.size() != wanted) return false;
+        }
+        stations.push_back(st);
+    }
+    return !stations.empty();
+}
+
+// the grid points of the stations given by coordinates, looked up in the spatial index
+bool find_points(std::vector<StationSel>& stations, const std::vector<smhi::GridPoint>& grid){
+    const smhi::SpatialIndex index(grid);
+    for(auto& st: stations){
+        const std::vector<double>& w = st.where;
+        if(st.station.compare(0, 5, "near:") == 0){
+            for(const auto& n: index.nearest(w[0], w[1])){
+                st.points.push_back(n.point);
+                std::cout << st.city << ": grid point " << grid[n.point].name << " (" << grid[n.point].lat << ", "
+                          << grid[n.point].lon << "), " << std::round(n.km * 10) / 10 << " km away\n";
+            }
+        }
+        else if(st.station.compare(0, 7, "radius:") == 0){
+            for(const auto& n: index.within(w[0], w[1], w[2])) st.points.push_back(n.point);
+            std::sort(st.points.begin(), st.points.end());
+            std::cout << st.city << ": " << st.points.size() << " grid point(s) within " << w[2] << " km\n";
+        }
+        else if(st.station.compare(0, 4, "box:") == 0){
+            st.points = index.in_box(w[0], w[1], w[2], w[3]);
+            std::cout << st.city << ": " << st.points.size() << " grid point(s) in the box\n";
+        }
+        if(st.points.empty()){
+            std::cerr << "ERROR: no grid point for " << st.station << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// The mean of the values of the grid points of a station that are not missing; NaN if all are missing.
+// With one grid point this is just its value.
+template <class ValueOf>
+double station_mean(const StationSel& st, ValueOf&& value_of){
+    if(st.points.size() == 1) return value_of(st.points[0]);
+    double sum = 0;
+    int n = 0;
+    for(size_t p: st.points){
+        const double v = value_of(p);
+        if(!std::isnan(v)){ sum += v; n++; }
+    }
+    return n ? sum / n : NAN;
+}
+
+// "1961,2024" -> {1961, 2024}; "all" leaves the list empty, meaning every year in the file
+bool parse_years(const std::string& spec, std::vector<int>& years){
+    if(spec == "all") return true;
+    std::stringstream ss(spec);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        try{ years.push_back(std::stoi(item)); }
+        catch(...){ return false; }
+    }
+    return !years.empty();
+}
+
+// the parts of the cleaned file that hold the wanted years, one range per run of consecutive years
+std::vector<smhi::DateRange> year_ranges(const smhi::DateIndex& index, std::vector<int> years){
+    std::sort(years.begin(), years.end());
+    years.erase(std::unique(years.begin(), years.end()), years.end());
+    std::vector<smhi::DateRange> ranges;
+    for(size_t i=0;i<years.size();){
+        size_t j = i;
+        while(j+1 < years.size() && years[j+1] == years[j]+1) ++j;
+        smhi::DateRange r = index.years(years[i], years[j]);
+        if(!r.empty()) ranges.push_back(r);
+        i = j+1;
+    }
+    return ranges;
+}
+
+bool write_monthly_csv(const std::string& out_csv, MonthlyStats stats){
+    // Replacing months with no data with zeros for better plotting
+    for(int m=1;m<=12;++m){
+        if(!stats.seen[m]){ stats.tmax[m]=0.0; stats.tmin[m]=0.0; }
+    }
+
+    // the numbers as ofstream << wrote them (6 significant digits); a .arrow name gives an Arrow file
+    auto out = smhi::open_table_writer(out_csv, {{"month", smhi::ColumnType::kInt},
+                                                 smhi::number_column("total_rain_mm", 6, true),
+                                                 smhi::number_column("monthly_tmax_C", 6, true),
+                                                 smhi::number_column("monthly_tmin_C", 6, true),
+                                                 {"rainy_days", smhi::ColumnType::kInt}});
+    if(!out){
+        std::cerr << "ERROR: cannot open " << out_csv << " for writing\n";
+        return false;
+    }
+    for(int m=1;m<=12;++m){
+        out->add_int(m);
+        out->add_number(stats.rain_sum[m]);
+        out->add_number(stats.tmax[m]);
+        out->add_number(stats.tmin[m]);
+        out->add_int(stats.rainy_days[m]);
+        out->end_row();
+    }
+    if(!out->close()){
+        std::cerr << "ERROR: cannot write " << out_csv << "\n";
+        return false;
+    }
+    return true;
+}
+
+#ifdef WITH_ROOT
+// writes every wanted (station, year) to the TTree "monthly" in out_root, with the same numbers as the csv files
+bool write_monthly_tree(const std::string& out_root, const std::vector<StationSel>& stations, int first_year,
+                        const std::vector<bool>& wanted){
+    TFile file(out_root.c_str(), "RECREATE");
+    if(file.IsZombie()){
+        std::cerr << "ERROR: cannot open " << out_root << " for writing\n";
+        return false;
+    }
+    TTree tree("monthly", "Monthly rainfall and temperature per city and year");
+    std::string city;
+    int year, month, rainy_days;
+    double total_rain, tmax, tmin;
+    tree.Branch("city", &city);
+    tree.Branch("year", &year, "year/I");
+    tree.Branch("month", &month, "month/I");
+    tree.Branch("total_rain_mm", &total_rain, "total_rain_mm/D");
+    tree.Branch("monthly_tmax_C", &tmax, "monthly_tmax_C/D");
+    tree.Branch("monthly_tmin_C", &tmin, "monthly_tmin_C/D");
+    tree.Branch("rainy_days", &rainy_days, "rainy_days/I");
+
+    for(const auto& st: stations){
+        city = st.city;
+        for(size_t i=0;i<wanted.size();++i){
+            if(!wanted[i]) continue;
+            const MonthlyStats& stats = st.years[i];
+            year = first_year + int(i);
+            for(month=1; month<=12; ++month){
+                total_rain = stats.rain_sum[month];
+                tmax       = stats.seen[month] ? stats.tmax[month] : 0.0; // zeros like in the csv files
+                tmin       = stats.seen[month] ? stats.tmin[month] : 0.0;
+                rainy_days = stats.rainy_days[month];
+                tree.Fill();
+            }
+        }
+    }
+    tree.Write();
+    file.Close();
+    return true;
+}
+#endif
+
 int main(int argc, char** argv){
     /*
     the main method takes two arguments : int argc and char** argv
@@ -84,102 +328,232 @@ int main(int argc, char** argv){
         argv[3] = "A"
         argv[4] = "results/monthly_A_1961.csv"
 
-    
+    (or "results/monthly_A_1961.arrow" for an Arrow file)
+
+    if argv[4] does not end in ".csv" or ".arrow" it is a folder (or a .root file), and argv[2], argv[3] may be lists:
+        argv[2] = "1961,2024" or "all"
+        argv[3] = "A=Lund,B=Uppsala"
+        argv[4] = "results"
+    then every (station, year) pair is filled during one pass over the file and
+    written to results/monthly_<city>_<year>.csv
     */
     if(argc < 5){
         std::cerr << "Usage: " << argv[0]
-                  << " <input_csv> <year> <station(A|B)> <output_csv>\n";
+                  << " <input_csv> <year> <station> <output_csv>\n"
+                  << "       " << argv[0]
+                  << " <input_csv> <year,year,...|all> <station=city,...> <output_dir>\n"
+                  << "  station: A | B | near:LAT:LON | radius:LAT:LON:KM | box:LAT_MIN:LAT_MAX:LON_MIN:LON_MAX\n";
         return 1;
         // checking if correct number of arguments are given or will raise error message
     }
     const std::string in_csv   = argv[1]; // example argv[1] = "data_clean/Rain_temp_cleaned.csv"
-    const int         year_sel = std::stoi(argv[2]); // std::stoi string to integer
-    const char        station  = argv[3][0];
-    const std::string out_csv  = argv[4];
-
-    // ternary conditional operator (condition) ? value_if_true : value_if_false
-    const int idxRain = (station=='A' ? 1 : 3); // If station=='A', use columns 1 & 2; otherwise 3 & 4.
-    const int idxTemp = (station=='A' ? 2 : 4); 
-
-
-    std::ifstream f(in_csv);
-    if(!f.is_open()){
-        std::cerr << "ERROR: cannot open " << in_csv << "\n";
-        return 2;
-        // check to see if we can use our clean dataset csv
-    }
-
-    // monthly data point
-    double month_rain_sum[13] = {0};  
-    int    month_rainy_days[13] = {0};
-    double month_tmax[13]; for(int m=1;m<=12;++m) month_tmax[m] = -1e300;
-    double month_tmin[13]; for(int m=1;m<=12;++m) month_tmin[m] =  1e300;
-    bool   month_seen[13] = {false};
-
-    std::string line;
-    if(!std::getline(f, line)){ std::cerr << "ERROR: empty file\n"; return 3; } // we check if the header is there or not in the cleaned dataset csv
-
-    while(std::getline(f, line)){
-        if(line.empty()) continue;
-        auto cols = split_csv(line); // take line from the csv, split it and save it to cols, auto determines type on it own
-        if((int)cols.size() < 5) continue;
-
-        /*
-        stoi() converts string to int  
-            example :  "123" → 123
-        substr() — extract part of a string only 
-            example :  if date = "2025-10-30" then  date.substr(0, 4) gives "2025"
-        */
-        
-        std::string date = cols[0]; // YYYY-MM-DD
-        if (date.size() < 10) continue;
-
-        int y = std::stoi(date.substr(0, 4));
-        if (y != year_sel) continue;
-
-        int m = std::stoi(date.substr(5, 2));
-        if (m < 1 || m > 12) continue;
-
-        // std::stod converts a string to double
-        double rain = cols[idxRain].empty() ? 0.0 : std::stod(cols[idxRain]);
-        double temp = cols[idxTemp].empty() ? NAN  : std::stod(cols[idxTemp]);
-
+    smhi::RunMetrics metrics("analysis");
+    const std::string out_path = argv[4];
+    const bool single_file = (out_path.size() > 4 && out_path.substr(out_path.size() - 4) == ".csv") ||
+                             (out_path.size() > 6 && out_path.substr(out_path.size() - 6) == ".arrow");
+    const bool root_output = out_path.size() > 5 && out_path.substr(out_path.size() - 5) == ".root";
+#ifndef WITH_ROOT
+    if(root_output){
+        std::cerr << "ERROR: this analysis was built without ROOT, compile it with -DWITH_ROOT $(root-config --cflags --libs)\n";
+        return 1;
+    }
+#endif
 
-        // rainfall
-        if(rain > 0.0) month_rainy_days[m] += 1;
-        month_rain_sum[m] += std::max(0.0, rain);
+    std::vector<int> years_sel; // empty = all years
+    std::vector<StationSel> stations;
+    if(!parse_years(argv[2], years_sel) || !parse_stations(argv[3], stations) ||
+       (single_file && (years_sel.size() != 1 || stations.size() != 1))){
+        std::cerr << "ERROR: bad year or station list, a single output csv needs exactly one year and one station\n";
+        return 1;
+    }
 
-        // temperature extremes
-        if(!std::isnan(temp)){
-            month_tmax[m] = std::max(month_tmax[m], temp);
-            month_tmin[m] = std::min(month_tmin[m], temp);
-            month_seen[m] = true;
+    // stations given by coordinates need the grid points of the file
+    if(std::any_of(stations.begin(), stations.end(), [](const StationSel& st){ return st.points.empty(); })){
+        std::vector<smhi::GridPoint> grid;
+        if(!smhi::load_grid_points(smhi::points_path_for(in_csv), grid)){
+            std::cerr << "ERROR: cannot read the grid points " << smhi::points_path_for(in_csv) << ", run the cleaner again\n";
+            return 1;
         }
+        if(!find_points(stations, grid)) return 1;
+    }
+    // the csv columns every line needs, and the columns read from the binary copy
+    size_t min_columns = 5, point_count = 0;
+    for(const auto& st: stations){
+        min_columns = std::max(min_columns, 2 * *std::max_element(st.points.begin(), st.points.end()) + 3);
+        point_count += st.points.size();
     }
-    f.close();
 
-    // Replacing months with no data with zeros for better plotting
-    for(int m=1;m<=12;++m){
-        if(!month_seen[m]){ month_tmax[m]=0.0; month_tmin[m]=0.0; }
+    // years are stored from first_year to last_year; with explicit years only those are kept
+    int first_year = 0, last_year = -1;
+    if(!years_sel.empty()){
+        first_year = *std::min_element(years_sel.begin(), years_sel.end());
+        last_year  = *std::max_element(years_sel.begin(), years_sel.end());
+    }
+    std::vector<bool> wanted(last_year - first_year + 1, years_sel.empty());
+    for(int y: years_sel) wanted[y - first_year] = true;
+
+    // returns the monthly stats of every station for year y, or false if the year is not wanted
+    auto year_slot = [&](int y, size_t& slot){
+        if(years_sel.empty() && (last_year < first_year || y < first_year || y > last_year)){
+            // "all": grow the range to include y
+            int new_first = last_year < first_year ? y : std::min(first_year, y);
+            int new_last  = last_year < first_year ? y : std::max(last_year, y);
+            for(auto& st: stations){
+                std::vector<MonthlyStats> grown(new_last - new_first + 1);
+                for(size_t i=0;i<st.years.size();++i) grown[first_year - new_first + i] = st.years[i];
+                st.years.swap(grown);
+            }
+            wanted.assign(new_last - new_first + 1, true);
+            first_year = new_first;
+            last_year  = new_last;
+        }
+        if(y < first_year || y > last_year || !wanted[y - first_year]) return false;
+        slot = size_t(y - first_year);
+        return true;
+    };
+    for(auto& st: stations) st.years.resize(wanted.size());
+
+    // with explicit years only the rows of those years have to be read; the index says where they are,
+    // and is only used if it was written for the same files (otherwise the whole file is read like before)
+    smhi::DateIndex index;
+    const bool indexed = !years_sel.empty() && index.load(smhi::index_path_for(in_csv));
+
+    // counted per row and station field, and passed to the metrics at the end of the reading
+    uint64_t rows_read = 0, rows_used = 0, bytes_read = 0;
+    uint64_t too_few_columns = 0, bad_date = 0, missing_rain = 0, missing_temperature = 0;
+    auto phase = metrics.phase("read");
+
+    smhi::StationStore store;
+    if(store.open(smhi::store_path_for(in_csv)) && store.columns() + 1 >= min_columns){
+        // the cleaner also writes a binary copy (Rain_temperature_cleaned.bin) with the same columns
+        // minus the date, so column idx of the csv is column idx-1 here; it is memory mapped and needs no parsing,
+        // and the pages of rows that are skipped are never read from disk, nor the columns of other grid points
+        std::vector<smhi::DateRange> ranges(1);
+        ranges[0].row_end = store.rows();
+        if(indexed && index.matches_store(store.rows())) ranges = year_ranges(index, years_sel);
+
+        const int32_t* date = store.date();
+        for(const auto& r: ranges){
+            rows_read += r.row_end - r.row_begin;
+            for(size_t i=r.row_begin;i<r.row_end;++i){
+                int y, m, d;
+                smhi::civil_from_days(date[i], y, m, d);
+                size_t slot;
+                if(!year_slot(y, slot)) continue;
+                rows_used++;
+
+                for(auto& st: stations){
+                    double rain = station_mean(st, [&](size_t p){ return store.value(2*p, i); });
+                    double temp = station_mean(st, [&](size_t p){ return store.value(2*p+1, i); }); // NaN when the temperature is missing
+                    missing_rain += std::isnan(rain);
+                    missing_temperature += std::isnan(temp);
+                    st.years[slot].add_day(m, std::isnan(rain) ? 0.0 : rain, temp);
+                }
+            }
+        }
+        // the dates and the two columns of every grid point of the stations, of the rows read
+        metrics.count("bytes_in", rows_read * (sizeof(int32_t) + 2 * point_count * sizeof(float)));
     }
+    else{
+        std::ifstream f(in_csv);
+        if(!f.is_open()){
+            std::cerr << "ERROR: cannot open " << in_csv << "\n";
+            return 2;
+            // check to see if we can use our clean dataset csv
+        }
 
-    std::ofstream out(out_csv);
-    if(!out.is_open()){
-        std::cerr << "ERROR: cannot open " << out_csv << " for writing\n";
-        return 4;
+        std::string line;
+        if(!std::getline(f, line)){ std::cerr << "ERROR: empty file\n"; return 3; } // we check if the header is there or not in the cleaned dataset csv
+
+        // the byte ranges to read: everything after the header, or only the wanted years if the index fits the file
+        std::vector<smhi::DateRange> ranges(1);
+        ranges[0].byte_begin = line.size() + 1;
+        f.seekg(0, std::ios::end);
+        ranges[0].byte_end = uint64_t(f.tellg());
+        if(indexed && index.matches_csv(ranges[0].byte_end)) ranges = year_ranges(index, years_sel);
+
+        for(const auto& r: ranges){
+            bytes_read += r.byte_end - r.byte_begin;
+            f.clear();
+            f.seekg(r.byte_begin);
+            for(uint64_t pos = r.byte_begin; pos < r.byte_end && std::getline(f, line); pos += line.size() + 1){
+                if(line.empty()) continue;
+                rows_read++;
+                auto cols = split_csv(line); // take line from the csv, split it and save it to cols, auto determines type on it own
+                if(cols.size() < min_columns){ too_few_columns++; continue; }
+
+                /*
+                smhi::parse_ymd() reads year, month and day of a YYYY-MM-DD date in one go
+                    example :  if date = "2025-10-30" then  y = 2025, m = 10, d = 30
+                it reads the digits from their fixed positions, so no substrings have to be made,
+                and returns false if the text is not a valid date
+                */
+        
+                std::string date = cols[0]; // YYYY-MM-DD
+                int y, m, d;
+                if (date.size() < 10 || !smhi::parse_ymd(date.data(), y, m, d)){ bad_date++; continue; }
+
+                size_t slot;
+                if(!year_slot(y, slot)) continue;
+                rows_used++;
+
+                for(auto& st: stations){
+                    // smhi::parse_decimal converts a string like "-7.2" to a double, exactly like std::stod,
+                    // but returns false instead of throwing when the field is empty or not a number
+                    auto field = [&](size_t c){ double x; return smhi::parse_decimal(cols[c], x) ? x : NAN; };
+                    double rain = station_mean(st, [&](size_t p){ return field(2*p+1); });
+                    double temp = station_mean(st, [&](size_t p){ return field(2*p+2); });
+                    missing_rain += std::isnan(rain);
+                    missing_temperature += std::isnan(temp);
+                    st.years[slot].add_day(m, std::isnan(rain) ? 0.0 : rain, temp);
+                }
+            }
+        }
+        f.close();
+        metrics.count("bytes_in", bytes_read);
     }
-    out << "month,total_rain_mm,monthly_tmax_C,monthly_tmin_C,rainy_days\n";
-    for(int m=1;m<=12;++m){
-        out << m << ","
-            << month_rain_sum[m] << ","
-            << month_tmax[m]     << ","
-            << month_tmin[m]     << ","
-            << month_rainy_days[m] << "\n";
+    phase.stop();
+    metrics.count("rows_read", rows_read);
+    metrics.count("rows_used", rows_used);
+    metrics.count("rows_filtered", rows_read - rows_used - too_few_columns - bad_date);
+    metrics.failure("too_few_columns", too_few_columns);
+    metrics.failure("bad_date", bad_date);
+    metrics.failure("missing_rain", missing_rain);
+    metrics.failure("missing_temperature", missing_temperature);
+    phase = metrics.phase("write");
+
+#ifdef WITH_ROOT
+    if(root_output){
+        if(!write_monthly_tree(out_path, stations, first_year, wanted)) return 4;
+        metrics.count_file("bytes_out", out_path);
+        std::cout << "Wrote TTree monthly to " << out_path << "\n";
+        return 0;
+    }
+#endif
+
+    if(single_file){
+        if(!write_monthly_csv(out_path, stations[0].years[0])) return 4;
+        metrics.count("files_written");
+        metrics.count_file("bytes_out", out_path);
+        std::cout << "Wrote " << out_path
+                  << " for station " << stations[0].station
+                  << " and year " << years_sel[0] << "\n";
+        return 0;
     }
-    out.close();
 
-    std::cout << "Wrote " << out_csv
-              << " for station " << station
-              << " and year " << year_sel << "\n";
+    int written = 0;
+    for(const auto& st: stations){
+        for(int y=first_year; y<=last_year; ++y){
+            if(!wanted[y - first_year]) continue;
+            std::string out_csv = out_path + "/monthly_" + st.city + "_" + std::to_string(y) + ".csv";
+            if(!write_monthly_csv(out_csv, st.years[y - first_year])) return 4;
+            metrics.count_file("bytes_out", out_csv);
+            written++;
+        }
+    }
+    metrics.count("files_written", written);
+    std::cout << "Wrote " << written << " monthly files to " << out_path
+              << " (" << stations.size() << " station(s), " << written / stations.size()
+              << " year(s) from one pass over " << in_csv << ")\n";
     return 0;
 }
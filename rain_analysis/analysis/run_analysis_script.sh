@@ -34,19 +34,22 @@ g++ "$SRC_ANALYSIS" -o "$EXE_ANALYSIS"
   We print a message so that  the user know the bash file is running and we complile the relavant file.
 '
 
-declare -A CITY=([A]="Lund" [B]="Uppsala") 
+YEARS="1961,2024"
+STATIONS="near:55.705:13.191=Lund,near:59.859:17.639=Uppsala"
 : '
-  puts A as Lund and B as Uppsala, this helps us but making it convinient to indentify files
+  YEARS: the years we want monthly summaries for, "all" gives every year in the dataset
+  STATIONS: the grid points closest to Lund (55.705 N, 13.191 E) and Uppsala (59.859 N, 17.639 E),
+  named Lund and Uppsala for the output files. The analysis looks them up in the grid points the
+  cleaner saves (Rain_temperature_cleaned.points), so no column numbers are needed. A region is
+  given as a box, e.g. box:55.3:56.5:12.4:14.6=Skane, or a circle, e.g. radius:59.33:18.07:30=Stockholm,
+  and gets the mean of its grid points. "A=Lund,B=Uppsala" (the first two grid points) still works.
 '
 
 echo "Running analyses..."
-for year in 1961 2024; do
-  for station in A B; do    
-    city="${CITY[$station]}"
-    out="$RESULTS_DIR/monthly_${city}_${year}.csv"
-    echo "  $city ($station), $year"
-    "$EXE_ANALYSIS" "$DATA_CLEAN" "$year" "$station" "$out"
-  done
-done
+"$EXE_ANALYSIS" "$DATA_CLEAN" "$YEARS" "$STATIONS" "$RESULTS_DIR"
+: '
+  A single run reads the cleaned dataset once and writes
+  monthly_<city>_<year>.csv for every city and year into $RESULTS_DIR
+'
 
 echo "Done. CSVs in: $RESULTS_DIR"
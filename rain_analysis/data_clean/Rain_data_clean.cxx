@@ -1,39 +1,65 @@
+// Build: g++ -O2 -pthread Rain_data_clean.cxx -o Rain_data_clean
+// Usage: ./Rain_data_clean [--threads N] [--names NAME,...] [--metrics report.json] [input.csv [output.csv]]
+//        (default: ../../datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv -> ../data_clean/Rain_temperature_cleaned.csv)
+//
+// The input file is memory mapped and cut into pieces that start and end at a line break
+// (see common/chunked_reader.h). Every piece is cleaned on its own thread and the pieces
+// are written out in file order, so the output is the same as reading it line by line.
+// Next to the cleaned CSV go the binary copy (.bin) and the month index (.idx, see common/date_index.h).
+//
+// Every grid point of the input is kept, with the columns rain_<name>_mm and temp_<name>_C.
+// The coordinates of the first line of the input go to the grid points file (.points, see
+// common/spatial_index.h), from which the analysis picks the grid points of a place or a region.
+// --names gives the names of the first grid points (default Lund,Uppsala, the two points of the
+// SMHI file); the others are called P3, P4, ...
+// --metrics (or $SMHI_METRICS) writes the rows, bytes and times of the run as JSON, see common/run_metrics.h.
+
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "../../common/chunked_reader.h"
+#include "../../common/date_index.h"
+#include "../../common/mapped_file.h"
+#include "../../common/parallel.h"
+#include "../../common/run_metrics.h"
+#include "../../common/spatial_index.h"
+#include "../../common/station_store.h"
 // path to read the file and path to output cleaned dataset
-const std::string IN_PATH = "../../datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv";
-const std::string OUT_PATH = "../data_clean/Rain_temperature_cleaned.csv";
+const std::string DEFAULT_IN_PATH = "../../datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv";
+const std::string DEFAULT_OUT_PATH = "../data_clean/Rain_temperature_cleaned.csv";
 
-std::string trim(const std::string& s){
+// std::string_view is a pointer and a length into text that already exists (here the mapped file),
+// so trimming and splitting a line never copies it
+std::string_view trim(std::string_view s){
     size_t a = s.find_first_not_of(" \t\n"); // find index of first character other than space and tabs
-    if(a == std::string::npos) return ""; // if s has no characters and a is empty we return empty string
+    if(a == std::string_view::npos) return ""; // if s has no characters and a is empty we return empty string
     size_t b = s.find_last_not_of(" \t\n"); // find index of last character other than space and tabs
     return s.substr(a, b - a + 1);
 }
 
-std::vector<std::string> split_semicolon(const std::string& s){
+void split_semicolon(std::string_view s, std::vector<std::string_view>& out){
     /*
     The purpose of this function is to get a string like "1961-01-26;0.0;-7.2;0.0;-10.3" and transform it  into the form ["1961-01-26","0.0","-7.2","0.0","-10.3"] 
     
     We loop through each character and when we see ';', it stores the current text as one whole element
     and then starts collecting the next characters untill ";" comes up again.
+    The vector is passed in and reused for every line, so no memory is allocated per line.
     */
-    std::vector<std::string> out;
-    out.reserve(8); // preallocates size to 8 for better performance
-    std::string current;
-    for(char c : s){
-        if(c == ';'){ 
-            out.push_back(current); current.clear(); 
+    out.clear();
+    size_t start = 0;
+    for(size_t i = 0; i < s.size(); ++i){
+        if(s[i] == ';'){ 
+            out.push_back(s.substr(start, i - start)); start = i + 1; 
         }
-        else current.push_back(c);
     }
-    out.push_back(current);
-    return out;
+    out.push_back(s.substr(start));
 }
 
-bool looks_like_date(const std::string& s){
+bool looks_like_date(std::string_view s){
     // checking if the argument is of the form YYYY-MM-DD
     if(s.size()!=10) return false;
     for(int i=0;i<10;i++){
@@ -45,52 +71,183 @@ bool looks_like_date(const std::string& s){
     return true;
 }
 
-int main(){
-    std::ifstream fin(IN_PATH); 
-    std::ofstream fout(OUT_PATH);
-    std::string line;
-    int line_no = 0;
+// what one thread produces for its piece of the file
+struct Piece {
+    explicit Piece(const std::vector<std::string>& columns) : bin(columns) {}
+
+    std::string csv;                 // the cleaned lines, ready to be written
+    smhi::StationStoreWriter bin;    // rain and temperature of every grid point
+    smhi::DateIndexWriter index;     // offsets counted from the start of this piece
+    int kept = 0;
+    int empty = 0, too_few_columns = 0, bad_date = 0; // the skipped lines, by reason
+};
+
+// cleans the lines in one byte range of the input; every line has a rain and a temperature column per grid point
+void clean_piece(const char* data, smhi::ByteRange range, size_t points, Piece& piece){
+    std::vector<std::string_view> cols;
+    std::vector<std::string> texts(2 * points);
+    piece.csv.reserve(range.end - range.begin);
+
+    smhi::for_each_line(data, range, [&](std::string_view line){
+        // retrive line and trim it 
+        std::string_view t = trim(line);
+        if(t.empty()){ piece.empty++; return; } // if line empty make sure user knows a line is skipped
+
+        //split_semicolon splits via semicolon
+        split_semicolon(t, cols);
+        if(cols.size() < 1 + 2 * points){ piece.too_few_columns++; return; }
+
+        std::string_view date = trim(cols[0]); // take out the date from cols and trim it
+        if(!looks_like_date(date)){ piece.bad_date++; return; } // if line empty make sure user knows a line is skipped
+
+        // cols[1] rain of the first grid point (Lund), cols[2] its temperature,
+        // cols[3] rain of the second grid point (Uppsala), cols[4] its temperature, ...
+        const size_t line_offset = piece.csv.size();
+        piece.csv.append(date);
+        for(size_t c=1;c<=2*points;++c) piece.csv.append(1, ',').append(cols[c]);
+        piece.csv.append(1, '\n');
+
+        int y, m, d;
+        if(smhi::parse_ymd(date.data(), y, m, d)){
+            piece.index.add(y, m, line_offset, piece.bin.rows());
+            for(size_t c=0;c<2*points;++c) texts[c].assign(cols[c+1]);
+            piece.bin.add_row(smhi::days_from_civil(y, m, d), smhi::kNoTime, texts.data());
+        }
+        piece.kept++;
+    });
+}
+
+int main(int argc, char** argv){
+    unsigned threads = 0; // 0 = one per core
+    std::string IN_PATH = DEFAULT_IN_PATH, OUT_PATH = DEFAULT_OUT_PATH;
+    std::vector<std::string> names = {"Lund", "Uppsala"}; // of the first grid points
+    int given = 0; // paths given on the command line
+    bool ok = true;
+    smhi::RunMetrics metrics("Rain_data_clean");
+    for(int i = 1; i < argc && ok; ++i){
+        const std::string arg = argv[i];
+        if(arg == "--threads" && i + 1 < argc) threads = std::stoi(argv[++i]);
+        else if(arg == "--metrics" && i + 1 < argc) metrics.set_path(argv[++i]);
+        else if(arg == "--names" && i + 1 < argc){
+            names.clear();
+            std::stringstream ss(argv[++i]);
+            for(std::string name; std::getline(ss, name, ',');) names.push_back(name);
+        }
+        else if(arg[0] != '-' && given == 0) { IN_PATH = arg; given++; }
+        else if(arg[0] != '-' && given == 1) { OUT_PATH = arg; given++; }
+        else ok = false;
+    }
+    if(!ok){
+        std::cerr << "Usage: " << argv[0] << " [--threads N] [--names NAME,...] [--metrics report.json] [input.csv [output.csv]]\n";
+        return 1;
+    }
+
+    smhi::MappedFile fin;
+    if(!fin.open(IN_PATH)){
+        std::cerr << "ERROR: cannot open " << IN_PATH << "\n";
+        return 1;
+    }
+    FILE* fout = std::fopen(OUT_PATH.c_str(), "wb");
+    if(!fout){
+        std::cerr << "ERROR: cannot create " << OUT_PATH << "\n";
+        return 1;
+    }
+
+    // the first line has the coordinates of every column, a rain and a temperature column per grid point
+    std::vector<smhi::GridPoint> columns, points;
+    const size_t second_line = smhi::skip_lines(fin.data(), fin.size(), 1);
+    if(!smhi::parse_coordinate_row(std::string_view(fin.data(), second_line), columns) || columns.size() % 2 != 0){
+        std::cerr << "ERROR: no grid point coordinates (N, E) in the first line of " << IN_PATH << "\n";
+        return 1;
+    }
+    std::vector<std::string> column_names; // of the binary copy
+    std::string header = "date";
+    for(size_t p=0;p<columns.size()/2;++p){
+        smhi::GridPoint point = columns[2*p];
+        point.name = p < names.size() ? names[p] : "P" + std::to_string(p + 1);
+        points.push_back(point);
+        column_names.push_back("rain_" + point.name + "_mm");
+        column_names.push_back("temp_" + point.name + "_C");
+        header += "," + column_names[2*p] + "," + column_names[2*p+1];
+    }
+    header += "\n";
+
+    // we skip the first two lines of the csv files as they are the coordinates and the column names
+    const size_t first_data = smhi::skip_lines(fin.data(), fin.size(), 2);
+
+    // a few pieces per thread, so a thread that finishes early can take another one
+    const size_t n_threads = threads == 0 ? smhi::default_threads() : threads;
+    std::vector<smhi::ByteRange> ranges = smhi::split_at_lines(fin.data(), first_data, fin.size(), 4 * n_threads);
+    std::vector<Piece> pieces(ranges.size(), Piece(column_names));
+    auto phase = metrics.phase("clean");
+    smhi::parallel_for(ranges.size(), threads, [&](size_t i, unsigned){
+        clean_piece(fin.data(), ranges[i], points.size(), pieces[i]);
+    });
+    phase.stop();
+
+    // the pieces are joined in file order, so the rows stay in date order
     int kept = 0, skipped = 0;
 
+    // columnar binary copy of the cleaned data, read with mmap by the analysis
+    smhi::StationStoreWriter fbin(column_names);
+
+    // where every month starts in the cleaned csv and in the binary copy
+    smhi::DateIndexWriter findex;
+
     // header to be added to the cleaned csv file
-    fout << "date,rain_Lund_mm,temp_Lund_C,rain_Uppsala_mm,temp_Uppsala_C\n";
+    phase = metrics.phase("write_csv");
+    std::fputs(header.c_str(), fout);
+    uint64_t written = header.size();
+    for(const Piece& piece: pieces){
+        std::fwrite(piece.csv.data(), 1, piece.csv.size(), fout);
+        findex.append(piece.index, written, fbin.rows());
+        written += piece.csv.size();
+        fbin.append(piece.bin);
+        kept += piece.kept;
+        skipped += piece.empty + piece.too_few_columns + piece.bad_date;
+        metrics.failure("empty_line", piece.empty);
+        metrics.failure("too_few_columns", piece.too_few_columns);
+        metrics.failure("bad_date", piece.bad_date);
+    }
+    const bool write_failed = std::ferror(fout) != 0;
+    if(std::fclose(fout) != 0 || write_failed){
+        std::cerr << "ERROR: cannot write " << OUT_PATH << "\n";
+        return 1;
+    }
 
-    // we skip the first two lines of the csv files as they are not relevant
-    for(int i=0;i<2 && std::getline(fin, line); ++i){
-        line_no++;
-        // just skip
+    phase = metrics.phase("write_bin_idx");
+    const std::string BIN_PATH = smhi::store_path_for(OUT_PATH);
+    if(!fbin.save(BIN_PATH)){
+        std::cerr << "ERROR: cannot write " << BIN_PATH << "\n";
+        return 1;
     }
 
-    // Read data lines
-    while(std::getline(fin, line)){
-        line_no++;
-        // retrive line and trim it 
-        std::string t = trim(line);
-        if(t.empty()){ skipped++; continue; } // if line empty make sure user knows a line is skipped
+    const std::string IDX_PATH = smhi::index_path_for(OUT_PATH);
+    if(!findex.save(IDX_PATH, OUT_PATH, fbin.rows(), written)){
+        std::cerr << "ERROR: cannot write " << IDX_PATH << "\n";
+        return 1;
+    }
 
-        //split_semicolon splits via semicolon
-        //auto  tells the compiler to figure out the necessary type that needs to be assinged
-        auto cols = split_semicolon(t);
-        if(cols.size() < 5){ skipped++; continue; }
-
-        std::string date = trim(cols[0]); // take out the date from cols and trim it
-        if(!looks_like_date(date)){ skipped++; continue; } // if line empty make sure user knows a line is skipped
-
-        
-        std::string rA = cols[1]; // rain of city A : Lund
-        std::string tA = cols[2]; // temperature of city A
-        std::string rB = cols[3]; // rain of city B : Uppsala
-        std::string tB = cols[4]; // temperature of city B
-
-        
-        fout << date << ",";
-        fout << rA   << ",";
-        fout << tA   << ",";
-        fout << rB   << ",";
-        fout << tB   << "\n";
-        kept++;
+    const std::string POINTS_PATH = smhi::points_path_for(OUT_PATH);
+    if(!smhi::save_grid_points(POINTS_PATH, OUT_PATH, points)){
+        std::cerr << "ERROR: cannot write " << POINTS_PATH << "\n";
+        return 1;
     }
+    phase.stop();
+
+    metrics.count("bytes_in", fin.size());
+    metrics.count("rows_read", uint64_t(kept + skipped));
+    metrics.count("rows_kept", uint64_t(kept));
+    metrics.count("rows_skipped", uint64_t(skipped));
+    metrics.count("pieces", ranges.size());
+    metrics.count("grid_points", points.size());
+    metrics.count("bytes_out", written);
+    metrics.count_file("bytes_out", BIN_PATH);
+    metrics.count_file("bytes_out", IDX_PATH);
+    metrics.count_file("bytes_out", POINTS_PATH);
+
     // we print this as a precaution to make sure no line is skipped
-    std::cout << "Cleaning done , cleaned CSV: " << OUT_PATH << " | rows kept: " << kept << ", rows skipped: " << skipped << "\n";
+    std::cout << "Cleaning done , cleaned CSV: " << OUT_PATH << " | rows kept: " << kept << ", rows skipped: " << skipped
+              << " (" << ranges.size() << " piece(s), " << points.size() << " grid point(s))\n";
     return 0;
 }
@@ -38,13 +38,32 @@ pushd "$ROOT_DIR" >/dev/null
 
 
 
+RENDERER="$PLOTS_DIR/render_figures"
+REPO_DIR="$(cd "$ROOT_DIR/.." && pwd)"
+if [ ! -x "$RENDERER" ] || [ "$REPO_DIR/render_figures.cxx" -nt "$RENDERER" ] || [ "$PLOTS_DIR/plot_monthly_using_csv_data.C" -nt "$RENDERER" ]; then
+  echo "Compiling render_figures..."
+  g++ -std=c++17 -O2 "$REPO_DIR/render_figures.cxx" -o "$RENDERER" $(root-config --cflags --libs)
+fi
+: '
+    render_figures (in the top folder of the repository) has the plotting macros compiled in and
+    draws every figure in one ROOT process, instead of starting ROOT once per figure with
+    root -l -b -q "plots/plot_monthly_using_csv_data.C+(...)".
+    It is compiled again only when its source or the macro is newer than the program.
+'
+
 for year in 1961 2024; do
   for station in A B; do
     city="${CITY[$station]}"
-    echo "Plotting $city ($station), $year..."
-    root -l -b -q "plots/plot_monthly_using_csv_data.C+(\"results/monthly_${city}_${year}.csv\",\"${city}\",${year})"
+    echo "Plotting $city ($station), $year..." >&2
+    echo "monthly results/monthly_${city}_${year}.csv ${city} ${year}"
   done
-done
+done | "$RENDERER" --workers 2 --outdir figures -
+: '
+    The loop writes one job line per figure, "monthly <input csv> <city> <year>", and the lines are
+    piped into render_figures (- reads the jobs from stdin). The figures are saved as
+    figures/monthly_bar_<city>_<year>.png, like before. --workers 2 draws them in two processes.
+    The "Plotting ..." messages go to >&2 (the terminal) so that they do not end up in the job list.
+'
 
 popd >/dev/null
 : '
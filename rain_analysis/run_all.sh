@@ -5,135 +5,52 @@ set -e
   This prevents half-completed runs and ensures errors are not ignored.
 '
 SCRIPT_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+REPO_DIR="$( cd "$SCRIPT_DIR/.." && pwd )"
 
 : '
   ${BASH_SOURCE[0]} → path of the current script file (run_all.sh)
   dirname "${BASH_SOURCE[0]}" → extracts the directory path where the script resides
   cd ... && pwd → converts this into an absolute path
-
-'
-
-#Data Cleaning
-
-echo "==> Cleaning data..."
-cd "$SCRIPT_DIR/data_clean/"
-
-: '
-  We move into the data_clean/ directory where Rain_data_clean.cxx is located.
-  - Compiles the .cxx cleaning script
-  - Runs it to produce a cleaned CSV file
-  The cleaned file will later be used for analysis.
-'
-
-g++ Rain_data_clean.cxx -o Rain_data_clean
-: '
-  Compiles the C++ file "Rain_data_clean.cxx" into an executable called "Rain_data_clean".
-  g++ : GNU C++ compiler
-  -o  : specifies the output executable name
-'
-
-./Rain_data_clean
-: '
-  Executes the compiled binary to perform the cleaning process.
-  This will read the raw dataset from datasets/ and produce a cleaned CSV file
-  (typically stored under data_clean/ or results/).
+  REPO_DIR is one folder up, the top folder of the repository where pipeline.cxx is.
 '
 
+#The pipeline runner
 
-#Data Analysis
-
-echo "==> Running analysis..."
-cd "$SCRIPT_DIR/analysis/"
-
-: '
-  Moves to the analysis/ directory where the analysis code and script are located.
-  This step compiles analysis.cxx and runs a helper bash script that executes analyses
-  for multiple years and stations (A → Lund, B → Uppsala).
-'
-
-g++ analysis.cxx -o analysis
-: '
-  Compiles the analysis.cxx file into a binary named "analysis".
-  This file performs statistical and monthly aggregations from the cleaned dataset.
-'
-
-chmod +x run_analysis_script.sh
-: '
-  Gives execution permission to the bash script "run_analysis_script.sh",
-  ensuring that it can be run as a program.
-'
-
-./run_analysis_script.sh
-: '
-  Executes the analysis bash script which:
-    - Calls the compiled analysis binary
-    - Generates monthly CSV results for each city and year
-    - Stores them inside results/
-'
-
-
-#Plot Generation
-
-echo "==> Generating plots..."
-cd "$SCRIPT_DIR/plots/"
-
-: '
-  We move into the plots/ directory where the ROOT plotting scripts are located.
-
-  ROOT is a scientific data visualization framework.
-  Here, we use ROOT macros (like plot_monthly_using_csv_data.C)
-  to generate monthly rainfall/temperature plots.
-'
-
-chmod +x run_root_plots.sh
-: '
-  Makes the plotting bash script executable.
-'
-
-./run_root_plots.sh
+PIPELINE="$SCRIPT_DIR/.cache/bin/pipeline"
+if [ ! -x "$PIPELINE" ] || [ "$REPO_DIR/pipeline.cxx" -nt "$PIPELINE" ]; then
+  echo "==> Compiling the pipeline runner..."
+  mkdir -p "$SCRIPT_DIR/.cache/bin"
+  g++ -std=c++17 -O2 -pthread "$REPO_DIR/pipeline.cxx" -o "$PIPELINE"
+fi
 : '
-  Runs the plotting script, which:
-    - Reads the monthly CSVs from results/
-    - Calls ROOT macros to create .png plots
-    - Saves them in the figures/ directory
+  The steps of the analysis are not written out in this script any more. They are the stages of
+  pipeline.txt (cleaning, analysis and plots, and compiling the programs they need), each with the
+  files it reads and the files it writes.
+  The runner itself is compiled only the first time, or when pipeline.cxx has changed.
 '
 
 
-#Cleanup
-echo "==> Cleaning up temporary CSV files and results folder..."
-cd "$SCRIPT_DIR"
-
-: '
-  Now that the plots have been generated, we clean up intermediate files.
-  This ensures that only the raw dataset and final figures remain.
-'
+#Cleaning, analysis and plots
 
-# Remove all CSV files except the original dataset in datasets/
-find . -type f -name "*.csv" ! -path "./datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv" -delete
+echo "==> Running the pipeline..."
+"$PIPELINE" "$SCRIPT_DIR/pipeline.txt"
 : '
-  find .                  → search from the current directory downward
-  -type f                 → match only files (not directories)
-  -name "*.csv"           → find all CSV files
-  ! -path "./datasets/SMHI_pthbv_p_t_1961_2025_daily_4326.csv" → exclude the original dataset
-  -delete                 → permanently remove all other CSV files
+  The runner works out from the inputs and outputs in which order the stages must run:
+    compile → clean → analyze → plot_<city>_<year>
+  analyze writes the monthly summaries of all cities and years in one pass over the cleaned data.
+  Stages that do not depend on each other (the plots of the cities and years) run at the same time.
 
-  Effectively removes:
-    - Cleaned CSVs
-    - Monthly analysis outputs
-    - Any other temporary CSVs created during execution
-'
+  A stage runs only if its command or the contents of one of its inputs have changed since its
+  last run, so running this script again without changes takes well under a second, and a change
+  in the data of one station only runs the stages that see a different file:
+    - a program is only compiled again when its source or one of the common/ headers changed
+    - a plot is only drawn again when its monthly summary is different
 
-# Remove the entire results folder
-if [ -d "$SCRIPT_DIR/results" ]; then
-  rm -rf "$SCRIPT_DIR/results"
-  echo "Deleted folder: $SCRIPT_DIR/results"
-fi
-: '
-  Checks if the directory results/ exists.
-  If it does, rm -rf recursively removes it and all its contents.
-  This ensures no intermediate analysis data remains.
+  The programs, the cleaned CSV and the monthly summaries are kept in .cache/ for the next run
+  (they used to be deleted at the end, which made every run start from nothing).
+  The log of every stage is in .cache/logs/. To start from nothing, delete .cache/ or run
+    .cache/bin/pipeline --force pipeline.txt
 '
 
 
-echo "Plots have been generated successfully!"
-echo "All intermediate CSVs and the results/ folder have been removed."
+echo "Plots are in $SCRIPT_DIR/figures/"
@@ -0,0 +1,209 @@
+// Draws many figures in one ROOT process, in batch mode (no windows), and saves them as PNG.
+//
+// Build: g++ -std=c++17 -O2 render_figures.cxx -o render_figures $(root-config --cflags --libs)
+// Usage: ./render_figures [--workers N] [--outdir DIR] [--metrics report.json] jobs.txt     (- reads the jobs from stdin)
+//
+// Every line of the job list is one figure, "macro input station year [output.png]", with - for
+// the fields that a macro does not use; empty lines and lines starting with # are skipped:
+//     monthly     results/monthly_Lund_1961.csv  Lund       1961   plot_monthly_using_csv_data.C
+//     warmest     Uppsala_warmest_results.csv    Uppsala    -      plot_results() in warmest_plot.cxx
+//     difference  FalunVSFalsterbo.csv           -          -      FalunVSFalsterboPlot.C
+//     bands       doy_percentiles.csv            Falsterbo  -      climatology_bands() in temperature_given_day.C
+//     day         temperature_given_day.cube     Falsterbo  07-04  tempgivenday_hist_cube(), the year is a MM-DD day
+// Without an output name the figures are saved in DIR (default .) as monthly_bar_Lund_1961.png,
+// Uppsala_warmest_coldest.png, FalunVSFalsterbo.png, Falsterbo_bands.png and Falsterbo_07-04.png.
+//
+// The macros are compiled into the program, so ROOT starts once for all figures instead of once
+// per figure. They draw on named canvases that are cleared and reused (common/figure_canvas.h),
+// and gStyle is put back after every figure, so one figure does not change the next.
+// With --workers N the jobs are split over N processes forked after ROOT has started.
+// --metrics (or $SMHI_METRICS) writes the counts and times of the run as JSON, see common/run_metrics.h;
+// its cpu_s and peak_rss_kb are those of this process, the workers have their own in workers_*.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <TError.h>
+#include <TH1.h>
+#include <TROOT.h>
+#include <TStyle.h>
+#include <TSystem.h>
+
+#include "common/run_metrics.h"
+
+#include "FalunVSFalsterboPlot.C"
+#include "rain_analysis/plots/plot_monthly_using_csv_data.C"
+#include "temperature_given_day.C"
+#include "warmest_plot.cxx" // last, it has a using namespace std
+
+struct FigureJob {
+    std::string macro, input, station, year, output;
+    int line = 0;
+};
+
+// Reads the job list. Returns false with a message for a line that is not a job.
+bool read_jobs(std::istream& in, const std::string& outdir, std::vector<FigureJob>& jobs) {
+    std::string text;
+    int line = 0;
+    while (std::getline(in, text)) {
+        line++;
+        std::stringstream ss(text);
+        FigureJob job;
+        job.line = line;
+        if (!(ss >> job.macro) || job.macro[0] == '#')
+            continue;
+        if (!(ss >> job.input >> job.station >> job.year)) {
+            std::cerr << "Line " << line << ": expected macro input station year [output.png]\n";
+            return false;
+        }
+        ss >> job.output;
+
+        std::string name; // the output name without a directory
+        if (job.macro == "monthly") {
+            if (job.year.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Line " << line << ": " << job.year << " is not a year\n";
+                return false;
+            }
+            name = "monthly_bar_" + job.station + "_" + job.year + ".png";
+        }
+        else if (job.macro == "warmest") name = job.station + "_warmest_coldest.png";
+        else if (job.macro == "difference") name = "FalunVSFalsterbo.png";
+        else if (job.macro == "bands") name = job.station + "_bands.png";
+        else if (job.macro == "day") name = job.station + "_" + job.year + ".png";
+        else {
+            std::cerr << "Line " << line << ": unknown macro " << job.macro
+                      << " (monthly, warmest, difference, bands or day)\n";
+            return false;
+        }
+        if (job.output.empty())
+            job.output = outdir + "/" + name;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// Draws and saves one figure. The macros only print their errors, so a figure counts as
+// drawn when its file is there afterwards.
+bool render(const FigureJob& job) {
+    std::remove(job.output.c_str());
+    const char* station = job.station == "-" ? "" : job.station.c_str();
+    if (job.macro == "monthly")
+        plot_monthly_using_csv_data(job.input.c_str(), station, std::stoi(job.year), job.output.c_str());
+    else if (job.macro == "warmest")
+        plot_results(job.input.c_str(), job.output.c_str());
+    else if (job.macro == "difference")
+        PlotTemperatureDifference(job.input.c_str(), job.output.c_str());
+    else if (job.macro == "bands")
+        climatology_bands(station, job.input.c_str(), job.output.c_str());
+    else if (job.macro == "day")
+        tempgivenday_hist_cube(job.year.c_str(), station, job.input.c_str(), job.output.c_str());
+    return !gSystem->AccessPathName(job.output.c_str()); // AccessPathName is true when the file is missing
+}
+
+// Renders the jobs worker, worker + workers, ... Returns the number that failed.
+int render_share(const std::vector<FigureJob>& jobs, unsigned worker, unsigned workers) {
+    const TStyle style(*gStyle); // as it was before the first figure
+    int failed = 0;
+    for (size_t i = worker; i < jobs.size(); i += workers) {
+        if (!render(jobs[i])) {
+            std::cerr << "Line " << jobs[i].line << ": " << jobs[i].output << " was not saved\n";
+            failed++;
+        }
+        style.Copy(*gStyle);
+    }
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    unsigned workers = 1;
+    std::string outdir = ".", job_file;
+    smhi::RunMetrics metrics("render_figures");
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--workers" && has_value) ok = (workers = std::stoi(argv[++i])) >= 1;
+        else if (arg == "--outdir" && has_value) outdir = argv[++i];
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if ((arg[0] != '-' || arg == "-") && job_file.empty()) job_file = arg;
+        else ok = false;
+    }
+    if (!ok || job_file.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--workers N] [--outdir DIR] [--metrics report.json] jobs.txt\n";
+        return 1;
+    }
+
+    std::vector<FigureJob> jobs;
+    if (job_file == "-") {
+        if (!read_jobs(std::cin, outdir, jobs))
+            return 1;
+    }
+    else {
+        std::ifstream in(job_file);
+        if (!in.is_open()) {
+            std::cerr << "Cannot open " << job_file << "\n";
+            return 1;
+        }
+        if (!read_jobs(in, outdir, jobs))
+            return 1;
+    }
+    gSystem->mkdir(outdir.c_str(), true);
+    auto phase = metrics.phase("render");
+
+    gROOT->SetBatch(true);
+    gErrorIgnoreLevel = kWarning; // not one "png file has been created" line per figure
+    TH1::AddDirectory(false);     // the histograms belong to the canvases, which delete them
+
+    workers = std::min<unsigned>(workers, std::max<size_t>(1, jobs.size()));
+    int failed = 0;
+    if (workers == 1)
+        failed = render_share(jobs, 0, 1);
+    else {
+        std::fflush(nullptr);
+        std::vector<pid_t> children;
+        for (unsigned w = 0; w < workers; ++w) {
+            const pid_t pid = fork();
+            if (pid == 0) {
+                const int worker_failed = render_share(jobs, w, workers);
+                std::fflush(nullptr);
+                _exit(std::min(worker_failed, 100));
+            }
+            if (pid < 0) {
+                std::cerr << "Cannot start worker " << w << ", its figures are drawn here\n";
+                failed += render_share(jobs, w, workers);
+                continue;
+            }
+            children.push_back(pid);
+        }
+        for (pid_t pid : children) {
+            int status = 0;
+            if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) {
+                std::cerr << "A worker stopped before it had drawn all its figures\n";
+                failed++;
+            }
+            else
+                failed += WEXITSTATUS(status);
+        }
+    }
+
+    phase.stop();
+    metrics.count("workers", workers);
+    metrics.count("figures", jobs.size());
+    metrics.failure("figure_failed", uint64_t(failed));
+    for (const auto& job : jobs)
+        metrics.count_file("bytes_out", job.output);
+    if (workers > 1) {
+        metrics.add_json("workers_cpu_s", std::to_string(smhi::children_cpu_seconds()));
+        metrics.add_json("workers_peak_rss_kb", std::to_string(smhi::peak_rss_kb(RUSAGE_CHILDREN)));
+    }
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " figures saved\n";
+    return failed == 0 ? 0 : 1;
+}
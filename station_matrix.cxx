@@ -0,0 +1,183 @@
+// Compares every pair of stations: the mean difference, the correlation and the trend of the
+// difference of their yearly (or monthly) means, like FalunVSFalsterbo does for one pair.
+//
+// Build: g++ -std=c++17 -O3 -pthread station_matrix.cxx -o station_matrix
+// Usage: ./station_matrix [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH,...|all]
+//                         [--by year|month] [--min-periods N] [--list FILE] [--threads N] [--out FILE]
+//                         [--metrics report.json] [station.csv ...]
+//        (default: Falun.csv Falsterbo.csv Uppsala.csv, every row, by year, at least 3 periods)
+//
+// The means of every station are computed from its binary copy (station.bin), with the same
+// engine as station_query, one station per core. The pairs are then compared all at once over
+// a table of means with one row per station (common/pair_matrix.h), in blocks of stations that
+// fit in the cache, on all cores; several hundred stations are some 100 000 pairs.
+// --list reads the station files from a file, one per line, for runs with many stations.
+//
+// station_matrix.csv has one line per pair a < b (in the order of the stations):
+//     station_a;station_b;periods;mean_diff;correlation;trend_per_decade
+// with mean_diff the mean of a - b over the periods where both have a mean and trend_per_decade
+// the least squares slope of a - b. Pairs with fewer than --min-periods common periods have only
+// the number of periods. .arrow writes an Arrow file instead.
+// FalunVSFalsterbo as a pair:   ./station_matrix --times 18 Falun.csv Falsterbo.csv
+// --metrics (or $SMHI_METRICS) writes the counts and times of the run as JSON, see common/run_metrics.h.
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "common/group_query.h"
+#include "common/pair_matrix.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_store.h"
+#include "common/table_writer.h"
+
+struct StationJob {
+    std::string path;
+    smhi::GroupResult means; // by year, or by year and month
+    size_t rows_scanned = 0;
+    std::string error;
+};
+
+void read_station(StationJob& job, const std::string& column, smhi::GroupQuery q) {
+    // only the rows of the months in --from..--to, if the index belongs to this file
+    smhi::StationStore store;
+    job.error = smhi::open_station_query(job.path, column, store, q);
+    if (!job.error.empty())
+        return;
+    job.rows_scanned = q.row_end - q.row_begin;
+    job.means = smhi::run_group_query(store, q);
+}
+
+int main(int argc, char** argv) {
+    smhi::GroupQuery q;
+    q.by_year = true;
+    q.aggs = smhi::kAggSum | smhi::kAggCount;
+    std::string column = "temperature", out_path = "station_matrix.csv", by = "year";
+    uint32_t min_periods = 3;
+    unsigned threads = 0;
+    std::vector<StationJob> jobs;
+    smhi::RunMetrics metrics("station_matrix");
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--column" && has_value) column = argv[++i];
+        else if (arg == "--from" && has_value) ok = smhi::parse_date_text(argv[++i], q.from);
+        else if (arg == "--to" && has_value) ok = smhi::parse_date_text(argv[++i], q.to);
+        else if (arg == "--times" && has_value) ok = smhi::parse_hours(argv[++i], q.hours);
+        else if (arg == "--by" && has_value) {
+            by = argv[++i];
+            ok = by == "year" || by == "month";
+        }
+        else if (arg == "--min-periods" && has_value) min_periods = uint32_t(std::stoul(argv[++i]));
+        else if (arg == "--list" && has_value) {
+            std::ifstream list(argv[++i]);
+            std::string line;
+            ok = list.is_open();
+            while (std::getline(list, line))
+                if (!line.empty() && line[0] != '#')
+                    jobs.push_back({line, {}, 0, {}});
+        }
+        else if (arg == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (arg[0] != '-') jobs.push_back({arg, {}, 0, {}});
+        else ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH,...|all] [--by year|month]"
+                     " [--min-periods N] [--list FILE] [--threads N] [--out FILE] [--metrics report.json]"
+                     " [station.csv ...]\n";
+        return 1;
+    }
+    if (jobs.empty())
+        for (const char* path : {"Falun.csv", "Falsterbo.csv", "Uppsala.csv"})
+            jobs.push_back({path, {}, 0, {}});
+    q.part = by == "month" ? smhi::YearPart::kMonth : smhi::YearPart::kNone;
+    const int parts = smhi::year_part_count(q.part);
+
+    auto phase = metrics.phase("means");
+    smhi::parallel_for(jobs.size(), threads, [&](size_t i, unsigned) { read_station(jobs[i], column, q); });
+
+    // the stations that could be read, and the years all of them together cover
+    std::vector<const StationJob*> stations;
+    int first_year = 0, last_year = -1;
+    int failed = 0;
+    for (const auto& job : jobs) {
+        metrics.count("stations");
+        if (!job.error.empty()) {
+            std::cerr << job.path << ": " << job.error << "\n";
+            metrics.failure("station_failed");
+            failed++;
+            continue;
+        }
+        metrics.count("rows_scanned", job.rows_scanned);
+        metrics.count("bytes_in", job.rows_scanned * (sizeof(int32_t) + sizeof(uint8_t) + sizeof(float)));
+        stations.push_back(&job);
+        const int years = int(job.means.groups.size()) / parts;
+        if (years == 0)
+            continue;
+        if (last_year < first_year) {
+            first_year = job.means.first_year;
+            last_year = first_year + years - 1;
+        }
+        first_year = std::min(first_year, job.means.first_year);
+        last_year = std::max(last_year, job.means.first_year + years - 1);
+    }
+
+    phase = metrics.phase("table");
+    const size_t periods = last_year < first_year ? 0 : size_t(last_year - first_year + 1) * size_t(parts);
+    smhi::PeriodTable table(stations.size(), periods);
+    if (!table.allocated()) {
+        std::cerr << "Can't allocate the table of " << stations.size() << " stations and " << periods << " periods\n";
+        metrics.failure("out_of_memory");
+        return 1;
+    }
+    smhi::parallel_for(stations.size(), threads, [&](size_t s, unsigned) {
+        const smhi::GroupResult& means = stations[s]->means;
+        const size_t offset = size_t(means.first_year - first_year) * size_t(parts);
+        for (size_t g = 0; g < means.groups.size(); ++g)
+            table.set(s, offset + g, means.groups[g].mean());
+    });
+
+    phase = metrics.phase("compare");
+    const std::vector<smhi::PairStats> pairs = table.compare(min_periods, threads);
+    metrics.count("pairs", pairs.size());
+
+    phase = metrics.phase("write");
+    auto out = smhi::open_table_writer(out_path, {{"station_a", smhi::ColumnType::kText},
+                                                  {"station_b", smhi::ColumnType::kText},
+                                                  {"periods", smhi::ColumnType::kInt},
+                                                  smhi::number_column("mean_diff", 4),
+                                                  smhi::number_column("correlation", 4),
+                                                  smhi::number_column("trend_per_decade", 4)}, ';');
+    if (!out) {
+        std::cerr << "Can't create " << out_path << "\n";
+        return 1;
+    }
+    std::vector<std::string> names;
+    for (const StationJob* job : stations)
+        names.push_back(smhi::station_name(job->path));
+    const double per_decade = 10.0 * parts; // the trend is per period: a year or a month
+    for (size_t a = 0; a < names.size(); ++a)
+        for (size_t b = a + 1; b < names.size(); ++b) {
+            const smhi::PairStats& p = pairs[smhi::pair_index(a, b, names.size())];
+            out->add_text(names[a]);
+            out->add_text(names[b]);
+            out->add_int(p.periods);
+            out->add_number(p.mean_diff);
+            out->add_number(p.correlation);
+            out->add_number(p.trend * per_decade);
+            out->end_row();
+        }
+    if (!out->close()) {
+        std::cerr << "Can't write " << out_path << "\n";
+        return 1;
+    }
+    phase.stop();
+    metrics.count_file("bytes_out", out_path);
+    std::cout << "Saved " << pairs.size() << " pairs of " << names.size() << " station(s) in " << out_path << "\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// One query tool for the binary station files: filter, group and aggregate one column.
+//
+// Build: g++ -std=c++17 -O2 -pthread station_query.cxx -o station_query
+// Usage: ./station_query [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH,...|all]
+//                        [--by KEY] [--agg AGG,...] [--threads N] [--out FILE] [--metrics report.json]
+//                        station.csv [station.csv ...]
+//
+//   --column  the column of the binary file, default "temperature" (the rain file has
+//             rain_Lund_mm, temp_Lund_C, rain_Uppsala_mm, temp_Uppsala_C)
+//   --times   the hours kept, e.g. 18 or 06,18; default all rows
+//   --by      none, year, month, doy, season, or year with one of the others: year,month
+//   --agg     mean, sum, min, max, argmin, argmax, count, above:T (number of values above T,
+//             up to 4 thresholds), default mean; argmin/argmax give the date of the first minimum/maximum
+//   --out     the result file, default station_query.csv
+//   --metrics the rows, bytes and times of the run as JSON (also $SMHI_METRICS), see common/run_metrics.h
+//
+// Every station.csv is read from its binary copy (station.bin) written by the cleaners, and the
+// month index (station.idx) is used to skip the months outside --from/--to. The stations run on
+// parallel threads. The result has one line per station and group that has values:
+//     station,<key columns>,<aggregates>
+//
+// The analyses of the other programs as queries:
+//   FalunVSFalsterbo:   ./station_query --times 18 --by year --agg mean Falun.csv Falsterbo.csv
+//   warmest_coldest:    ./station_query --times 18 --by year --agg max,argmax,min,argmin Uppsala.csv
+//   one day of the year over all years: ./station_query --times 06,18 --by year,doy --agg mean Falsterbo.csv
+//   monthly rain:       ./station_query --column rain_Lund_mm --by year,month --agg sum,above:0
+//                           rain_analysis/data_clean/Rain_temperature_cleaned.csv
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "common/group_query.h"
+#include "common/parallel.h"
+#include "common/run_metrics.h"
+#include "common/station_store.h"
+
+// one aggregate of the --agg list, in the order it is printed
+struct Aggregate {
+    std::string name; // header of the column
+    unsigned bits;    // what the scan has to compute for it
+    enum Kind { kMean, kSum, kMin, kMax, kArgMin, kArgMax, kCount, kAbove } kind;
+    int threshold = 0; // kAbove: which of the query's thresholds
+};
+
+bool parse_aggregates(const std::string& list, std::vector<Aggregate>& aggs, smhi::GroupQuery& q) {
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == "mean") aggs.push_back({item, smhi::kAggSum | smhi::kAggCount, Aggregate::kMean});
+        else if (item == "sum") aggs.push_back({item, smhi::kAggSum, Aggregate::kSum});
+        else if (item == "min") aggs.push_back({item, smhi::kAggMin, Aggregate::kMin});
+        else if (item == "max") aggs.push_back({item, smhi::kAggMax, Aggregate::kMax});
+        else if (item == "argmin") aggs.push_back({item, smhi::kAggArgMin, Aggregate::kArgMin});
+        else if (item == "argmax") aggs.push_back({item, smhi::kAggArgMax, Aggregate::kArgMax});
+        else if (item == "count") aggs.push_back({item, smhi::kAggCount, Aggregate::kCount});
+        else if (item.compare(0, 6, "above:") == 0 && q.n_thresholds < smhi::kMaxThresholds &&
+                 smhi::parse_decimal(item.substr(6), q.thresholds[q.n_thresholds])) {
+            aggs.push_back({"above_" + item.substr(6), smhi::kAggAbove, Aggregate::kAbove, q.n_thresholds});
+            q.n_thresholds++;
+        }
+        else
+            return false;
+    }
+    return !aggs.empty();
+}
+
+// "year", "month", "year,doy", ...
+bool parse_key(const std::string& key, bool& by_year, smhi::YearPart& part) {
+    std::string rest = key;
+    by_year = rest.compare(0, 4, "year") == 0;
+    if (by_year) {
+        if (rest.size() > 4 && (rest[4] != ',' || rest.size() == 5))
+            return false; // "yearmonth" or "year,"
+        rest = rest.substr(rest.size() > 4 ? 5 : 4);
+    }
+    if (rest.empty() || rest == "none") part = smhi::YearPart::kNone;
+    else if (rest == "month") part = smhi::YearPart::kMonth;
+    else if (rest == "doy") part = smhi::YearPart::kDayOfYear;
+    else if (rest == "season") part = smhi::YearPart::kSeason;
+    else return false;
+    return !(rest == "none" && by_year);
+}
+
+std::string date_text(int32_t day) {
+    int y, m, d;
+    smhi::civil_from_days(day, y, m, d);
+    char text[32];
+    std::snprintf(text, sizeof text, "%04d-%02d-%02d", y, m, d);
+    return text;
+}
+
+struct StationJob {
+    std::string path;
+    smhi::GroupResult result;
+    size_t rows_scanned = 0; // the rows in --from..--to (as far as the month index narrows them down)
+    std::string error;
+};
+
+void run_station(StationJob& job, const std::string& column, smhi::GroupQuery q) {
+    // only the rows of the months in --from..--to, if the index belongs to this file
+    smhi::StationStore store;
+    job.error = smhi::open_station_query(job.path, column, store, q);
+    if (!job.error.empty())
+        return;
+    job.rows_scanned = q.row_end - q.row_begin;
+    job.result = smhi::run_group_query(store, q);
+}
+
+int main(int argc, char** argv) {
+    smhi::GroupQuery q;
+    std::string column = "temperature", out_path = "station_query.csv", key = "none";
+    std::vector<Aggregate> aggs;
+    std::vector<StationJob> jobs;
+    unsigned threads = 0;
+    smhi::RunMetrics metrics("station_query");
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--column" && has_value) column = argv[++i];
+        else if (arg == "--from" && has_value) ok = smhi::parse_date_text(argv[++i], q.from);
+        else if (arg == "--to" && has_value) ok = smhi::parse_date_text(argv[++i], q.to);
+        else if (arg == "--times" && has_value) ok = smhi::parse_hours(argv[++i], q.hours);
+        else if (arg == "--by" && has_value) key = argv[++i];
+        else if (arg == "--agg" && has_value) ok = parse_aggregates(argv[++i], aggs, q);
+        else if (arg == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--metrics" && has_value) metrics.set_path(argv[++i]);
+        else if (arg[0] != '-') jobs.push_back({arg, {}, 0, {}});
+        else ok = false;
+    }
+    if (aggs.empty() && ok)
+        parse_aggregates("mean", aggs, q);
+    if (!ok || jobs.empty() || !parse_key(key, q.by_year, q.part)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--column NAME] [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--times HH,...|all]"
+                     " [--by none|year|month|doy|season|year,month|year,doy|year,season]"
+                     " [--agg mean,sum,min,max,argmin,argmax,count,above:T] [--threads N] [--out FILE] [--metrics report.json]"
+                     " station.csv [station.csv ...]\n";
+        return 1;
+    }
+    q.aggs = 0;
+    for (const auto& a : aggs)
+        q.aggs |= a.bits;
+
+    auto phase = metrics.phase("query");
+    smhi::parallel_for(jobs.size(), threads, [&](size_t i, unsigned) { run_station(jobs[i], column, q); });
+    phase = metrics.phase("write");
+
+    FILE* out = std::fopen(out_path.c_str(), "w");
+    if (!out) {
+        std::cerr << "Can't create " << out_path << "\n";
+        return 1;
+    }
+    std::fprintf(out, "station");
+    if (q.by_year) std::fprintf(out, ",year");
+    if (q.part == smhi::YearPart::kMonth) std::fprintf(out, ",month");
+    if (q.part == smhi::YearPart::kDayOfYear) std::fprintf(out, ",doy");
+    if (q.part == smhi::YearPart::kSeason) std::fprintf(out, ",season");
+    for (const auto& a : aggs)
+        std::fprintf(out, ",%s", a.name.c_str());
+    std::fprintf(out, "\n");
+
+    int failed = 0;
+    size_t lines = 0;
+    for (const auto& job : jobs) {
+        metrics.count("stations");
+        if (!job.error.empty()) {
+            std::cerr << job.path << ": " << job.error << "\n";
+            metrics.failure("station_failed");
+            failed++;
+            continue;
+        }
+        const std::string name = smhi::station_name(job.path);
+        const smhi::GroupResult& r = job.result;
+        uint64_t values = 0;
+        for (const auto& s : r.groups)
+            values += s.count;
+        metrics.count("rows_scanned", job.rows_scanned);
+        metrics.count("bytes_in", job.rows_scanned * (sizeof(int32_t) + sizeof(uint8_t) + sizeof(float))); // date, hour, value
+        metrics.count("values_aggregated", values);
+        metrics.count("rows_filtered", job.rows_scanned - values); // other dates or hours, or no value
+        for (size_t g = 0; g < r.groups.size(); ++g) {
+            const smhi::GroupStats& s = r.groups[g];
+            if (s.count == 0)
+                continue;
+            std::fprintf(out, "%s", name.c_str());
+            if (q.by_year) std::fprintf(out, ",%d", r.first_year + int(g / size_t(r.parts)));
+            const int part = int(g % size_t(r.parts));
+            if (q.part == smhi::YearPart::kSeason) std::fprintf(out, ",%s", smhi::season_name(part));
+            else if (q.part != smhi::YearPart::kNone) std::fprintf(out, ",%d", part + 1);
+            for (const auto& a : aggs) {
+                switch (a.kind) {
+                case Aggregate::kMean: std::fprintf(out, ",%.10g", s.mean()); break;
+                case Aggregate::kSum: std::fprintf(out, ",%.10g", s.sum); break;
+                case Aggregate::kMin: std::fprintf(out, ",%.10g", s.min); break;
+                case Aggregate::kMax: std::fprintf(out, ",%.10g", s.max); break;
+                case Aggregate::kArgMin: std::fprintf(out, ",%s", date_text(s.argmin).c_str()); break;
+                case Aggregate::kArgMax: std::fprintf(out, ",%s", date_text(s.argmax).c_str()); break;
+                case Aggregate::kCount: std::fprintf(out, ",%llu", (unsigned long long)s.count); break;
+                case Aggregate::kAbove: std::fprintf(out, ",%llu", (unsigned long long)s.above[a.threshold]); break;
+                }
+            }
+            std::fprintf(out, "\n");
+            lines++;
+        }
+    }
+    const bool write_failed = std::ferror(out) != 0;
+    if (std::fclose(out) != 0 || write_failed) {
+        std::cerr << "Can't write " << out_path << "\n";
+        return 1;
+    }
+    phase.stop();
+    metrics.count("groups_written", lines);
+    metrics.count_file("bytes_out", out_path);
+    std::cout << "Saved " << lines << " groups of " << jobs.size() - failed << " station(s) to " << out_path << "\n";
+    return failed == 0 ? 0 : 1;
+}
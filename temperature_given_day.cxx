@@ -2,22 +2,40 @@
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <optional>
 #include<map>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "common/daily_aggregate.h"
+#include "common/doy_cube.h"
+#include "common/run_metrics.h"
+#include "common/station_series.h"
+#include "common/station_store.h"
+#include "common/table_writer.h"
 
-std::map<std::string, double> temperature_given_day(const char* filename, const std::string& givenday) {
+// the 6 AM and 6 PM readings of every day, as compact fixed point arrays (see common/station_series.h)
+const int kMorning = 0, kEvening = 1;
+// or with --daily the mean of all readings of the day, from Falsterbo_daily.csv (cleaning_data --daily)
+const int kDailyMean = 0;
+
+// reads one column of the memory mapped binary copy of the cleaned file (Falsterbo.csv -> Falsterbo.bin)
+// returns false if there is no binary copy, so the CSV can be read instead
+bool readings_from_binary(const char* filename, const char* column, smhi::StationSeries& readings) {
+    smhi::StationStore store;
+    return store.open(smhi::store_path_for(filename)) && readings.load(store, column);
+}
+
+// reads the cleaned CSV file line by line
+bool readings_from_csv(const char* filename, smhi::StationSeries& readings) {
 
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Cannot open file: " << filename << std::endl;
-        return {};
+        return false;
     }
 
+    // the cleaned files have no header; a line without a date is skipped like any unreadable row
     std::string line;
-    std::getline(file, line); // skip header
-
-    std::map<std::string, std::pair<std::optional<double>, std::optional<double>>> tempyear;
-
     while (std::getline(file, line)) {
         std::stringstream ss(line);
         std::string date, time, temp_str;
@@ -26,67 +44,303 @@ std::map<std::string, double> temperature_given_day(const char* filename, const
         std::getline(ss, time, ';');
         std::getline(ss, temp_str, ';');
 
-        if (date.size() < 10)
+        int32_t day;
+        double temperature;
+        if (!smhi::parse_date_text(date, day) || !smhi::parse_decimal(temp_str, temperature)) // rows without a readable temperature are skipped
             continue;
 
-        std::string monthandday = date.substr(5, 5); //subtracts characters from date so as to keep only the month and day
-        
-        if (monthandday != givenday)
+        readings.set(day, smhi::time_code_from_text(time), temperature); // other hours than 06 and 18 are not kept
+                                                                         // (the daily files have no time)
+    }
+
+    file.close();
+    return true;
+}
+
+// incomplete counts the years where only one of the two readings of the day exists
+// daily: filename is a daily file (Falsterbo_daily.csv) and its mean column is used as it is
+std::map<std::string, double> temperature_given_day(const char* filename, const std::string& givenday, bool daily,
+                                                    int& incomplete) {
+
+    // the daily means are rounded to two decimals, the readings have one
+    smhi::StationSeries readings = daily ? smhi::StationSeries({smhi::kNoTime}, 2) : smhi::StationSeries({6, 18});
+    if (!readings_from_binary(filename, daily ? "mean" : "temperature", readings) &&
+        !readings_from_csv(filename, readings))
+        return {};
+
+    int month = 0, day = 0;
+    if (std::sscanf(givenday.c_str(), "%2d-%2d", &month, &day) != 2 || readings.empty())
+        return {}; // not a valid MM-DD, so no day can match
+
+    int first_year, last_year, m, d;
+    smhi::civil_from_days(readings.first_day(), first_year, m, d);
+    smhi::civil_from_days(readings.last_day(), last_year, m, d);
+
+    std::map<std::string, double> results; //computes mean temperatures for each year for a given day and stores in results map
+    for (int year = first_year; year <= last_year; ++year) {
+        if (month < 1 || month > 12 || day < 1 || day > smhi::kMonthDays[smhi::is_leap(year)][month])
+            continue; // e.g. 02-29 in a year that is not a leap year
+        const int32_t ordinal = smhi::days_from_civil(year, month, day);
+        if (daily) {
+            if (readings.has(kDailyMean, ordinal))
+                results[std::to_string(year)] = readings.at(kDailyMean, ordinal);
             continue;
+        }
+        const bool morning = readings.has(kMorning, ordinal), evening = readings.has(kEvening, ordinal);
+        if (morning && evening){
+            double meantemp = (readings.at(kMorning, ordinal) + readings.at(kEvening, ordinal)) / 2;
+            results[std::to_string(year)] = meantemp;
+        }
+        else if (morning || evening){
+            incomplete++;
+        }
+    }
+
+    return results;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Batch mode: answers many days (or all 366) at once. Every station file is read a single time
+// into a climatology cube (station x year x day of the year x 06:00/18:00, see common/doy_cube.h);
+// the requested days are then looked up in the cube. The cube is also saved, so the ROOT macro
+// can draw a histogram for any day straight from it. With --daily both readings of a day in the
+// cube are the daily mean of the station's daily file, so the mean of the two is that mean.
+
+// one 06:00 or 18:00 reading, already placed in the calendar
+struct CubeReading {
+    int year;
+    int slot;    // day of the year as used by the cube
+    int reading; // 0 = 06:00, 1 = 18:00
+    double temperature;
+};
+
+// places one reading of the hour in the cube's calendar: 06:00 and 18:00, or a daily mean as both
+void add_reading(int y, int m, int d, uint8_t hour, double temperature, bool daily, std::vector<CubeReading>& readings) {
+    if (daily) {
+        if (hour == smhi::kNoTime) {
+            readings.push_back({y, smhi::cube_slot(m, d), 0, temperature});
+            readings.push_back({y, smhi::cube_slot(m, d), 1, temperature});
+        }
+    }
+    else if (hour == 6 || hour == 18)
+        readings.push_back({y, smhi::cube_slot(m, d), hour == 6 ? 0 : 1, temperature});
+}
+
+// reads every 06:00 and 18:00 reading of a cleaned station file, or every daily mean of a daily
+// file, from the binary copy if there is one
+bool read_station(const std::string& filename, bool daily, std::vector<CubeReading>& readings) {
+    smhi::StationStore store;
+    if (store.open(smhi::store_path_for(filename))) {
+        const int c = store.column_index(daily ? "mean" : "temperature");
+        if (c < 0) {
+            std::cerr << "No " << (daily ? "mean" : "temperature") << " column in " << smhi::store_path_for(filename) << "\n";
+            return false;
+        }
+        const int32_t* date = store.date();
+        const uint8_t* hour = store.time_code();
+        for (size_t i = 0; i < store.rows(); ++i) {
+            double temperature = store.value(size_t(c), i);
+            if (std::isnan(temperature))
+                continue;
+            int y, m, d;
+            smhi::civil_from_days(date[i], y, m, d);
+            add_reading(y, m, d, hour[i], temperature, daily, readings);
+        }
+        return true;
+    }
+
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file: " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string date, time, temp_str;
+        std::getline(ss, date, ';');
+        std::getline(ss, time, ';');
+        std::getline(ss, temp_str, ';');
 
-        std::string year = date.substr(0, 4); //subtractcs characters to save the year
-        
-        try {
-            double temperature = std::stod(temp_str);
-            auto& entry = tempyear[year];
-
-            if (time == "06:00:00")
-                entry.first = temperature;
-            else if (time == "18:00:00")
-                entry.second = temperature;
-        } catch (...) {
+        int y, m, d;
+        if (date.size() < 10 || !smhi::parse_ymd(date.data(), y, m, d))
             continue;
+        double temperature;
+        if (smhi::parse_decimal(temp_str, temperature))
+            add_reading(y, m, d, smhi::time_code_from_text(time), temperature, daily, readings);
+    }
+    return true;
+}
+
+// "all" -> every day of the year, otherwise a comma separated list such as "01-15,07-04"
+bool parse_days(const std::string& list, std::vector<int>& slots) {
+    if (list == "all") {
+        for (int slot = 0; slot < smhi::kCubeDays; ++slot)
+            slots.push_back(slot);
+        return true;
+    }
+    std::stringstream ss(list);
+    std::string day;
+    while (std::getline(ss, day, ',')) {
+        int slot = smhi::cube_slot(day);
+        if (slot < 0) {
+            std::cerr << "Not a MM-DD day: " << day << "\n";
+            return false;
         }
+        slots.push_back(slot);
     }
+    return !slots.empty();
+}
 
-    file.close();
+int batch_mode(const std::string& days, const std::vector<std::string>& files, bool daily, smhi::RunMetrics& metrics) {
+    std::vector<int> slots;
+    if (!parse_days(days, slots))
+        return 1;
 
-    std::map<std::string, double> results; //computes mean temperatures for each year for a given day and stores in results map
-    for(const auto& [year, temp]: tempyear){
-        if (temp.first && temp.second){
-            double meantemp = (*temp.first + *temp.second) / 2;
-            results[year] = meantemp;
+    // one pass over every station file
+    auto phase = metrics.phase("read");
+    std::vector<std::string> names;
+    std::vector<std::vector<CubeReading>> readings(files.size());
+    int first_year = 9999, last_year = 0;
+    for (size_t s = 0; s < files.size(); ++s) {
+        const std::string path = daily ? smhi::daily_path_for(files[s]) : files[s];
+        if (!read_station(path, daily, readings[s]))
+            return 1;
+        metrics.count("stations");
+        metrics.count("readings", readings[s].size());
+        const std::string bin_path = smhi::store_path_for(path); // read instead of the CSV when it exists
+        metrics.count_file("bytes_in", std::ifstream(bin_path).good() ? bin_path : path);
+        for (const auto& r : readings[s]) {
+            first_year = std::min(first_year, r.year);
+            last_year = std::max(last_year, r.year);
         }
-        else{
-            std::cerr << "Incomplete data for given day.\n";
+        std::string name = files[s].substr(files[s].find_last_of('/') + 1); // "data/Falsterbo.csv" -> "Falsterbo"
+        names.push_back(name.substr(0, name.rfind('.')));
+    }
+    if (first_year > last_year) {
+        std::cerr << (daily ? "No daily means found.\n" : "No 06:00 or 18:00 readings found.\n");
+        return 1;
+    }
+
+    phase = metrics.phase("cube");
+    smhi::ClimatologyCube cube(names, first_year, last_year);
+    for (size_t s = 0; s < files.size(); ++s)
+        for (const auto& r : readings[s])
+            cube.at(int(s), r.year, r.slot, r.reading) = r.temperature;
+
+    if (!cube.save("temperature_given_day.cube")) {
+        std::cerr << "Cannot create temperature_given_day.cube file. \n";
+        return 1;
+    }
+
+    // the means with 6 significant digits, as ofstream << wrote them
+    phase = metrics.phase("write");
+    auto resultfile = smhi::open_table_writer("temperature_given_day_days.csv",
+                                              {{"Station", smhi::ColumnType::kText}, {"Day", smhi::ColumnType::kText},
+                                               {"Year", smhi::ColumnType::kInt},
+                                               smhi::number_column("Mean_Daily_Temperature", 6, true)}, ';');
+    if (!resultfile) {
+        std::cerr << "Cannot create temperature_given_day_days.csv file. \n";
+        return 1;
+    }
+
+    int incomplete = 0; // days where only one of the two readings exists
+    uint64_t written = 0;
+    for (size_t s = 0; s < names.size(); ++s) {
+        for (int slot : slots) {
+            std::string day = smhi::cube_slot_name(slot);
+            for (int year = first_year; year <= last_year; ++year) {
+                double mean = cube.daily_mean(int(s), year, slot);
+                if (!std::isnan(mean)) {
+                    resultfile->add_text(names[s]);
+                    resultfile->add_text(day);
+                    resultfile->add_int(year);
+                    resultfile->add_number(mean);
+                    resultfile->end_row();
+                    written++;
+                }
+                else if (!std::isnan(cube.at(int(s), year, slot, 0)) || !std::isnan(cube.at(int(s), year, slot, 1)))
+                    incomplete++;
+            }
         }
     }
+    if (!resultfile->close()) {
+        std::cerr << "Cannot write temperature_given_day_days.csv file. \n";
+        return 1;
+    }
+    phase.stop();
+    metrics.count("rows_written", written);
+    metrics.failure("incomplete_day", uint64_t(incomplete));
+    metrics.count_file("bytes_out", "temperature_given_day.cube");
+    metrics.count_file("bytes_out", "temperature_given_day_days.csv");
 
-    return results;
+    if (incomplete > 0)
+        std::cerr << "Incomplete data for " << incomplete << " station days, they were left out.\n";
+    std::cout << "Saved mean temperatures for " << slots.size() << " days of " << names.size()
+              << " station(s) in temperature_given_day_days.csv, all readings in temperature_given_day.cube\n";
+    return 0;
 }
 
-int main() {
-    const char* filename = "Falsterbo.csv";
+int main(int argc, char** argv) {
+    // the rows, bytes and times of the run go to $SMHI_METRICS as JSON if it is set, see common/run_metrics.h
+    smhi::RunMetrics metrics("temperature_given_day");
+
+    // ./temperature_given_day [--daily] [--days all|MM-DD,MM-DD,... [station.csv ...]]
+    // --daily uses the daily means of all hours in Falsterbo_daily.csv (cleaning_data --daily)
+    // instead of the mean of the 06:00 and 18:00 readings
+    bool daily = false, ok = true;
+    std::string days;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc && ok; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--daily") daily = true;
+        else if (arg == "--days" && i + 1 < argc) days = argv[++i];
+        else if (arg[0] != '-' && !days.empty()) files.push_back(arg);
+        else ok = false;
+    }
+    if (!ok) {
+        std::cerr << "Usage: " << argv[0] << " [--daily] [--days all|MM-DD,MM-DD,... [station.csv ...]]\n";
+        return 1;
+    }
+    if (!days.empty()) {
+        if (files.empty())
+            files.push_back("Falsterbo.csv");
+        return batch_mode(days, files, daily, metrics);
+    }
+
+    const std::string filename = daily ? smhi::daily_path_for("Falsterbo.csv") : "Falsterbo.csv";
     std::string givenday;
     std::cout << "Enter date (MM-DD): ";
     std::cin >> givenday;
 
-    auto yearlymeans = temperature_given_day(filename, givenday);
+    int incomplete = 0;
+    auto phase = metrics.phase("read");
+    auto yearlymeans = temperature_given_day(filename.c_str(), givenday, daily, incomplete);
+    phase.stop();
+    if (incomplete > 0)
+        std::cerr << "Incomplete data for the given day in " << incomplete << " year(s), they were left out.\n";
+    metrics.count("years", yearlymeans.size());
+    metrics.failure("incomplete_day", uint64_t(incomplete));
 
-    std::ofstream resultfile("temperature_given_day.csv");
-    if (!resultfile.is_open()){
+    auto resultfile = smhi::open_table_writer("temperature_given_day.csv", {{"Year", smhi::ColumnType::kText},
+                                              smhi::number_column("Mean_Daily_Temperature", 6, true)}, ';');
+    if (!resultfile){
         std::cerr << "Cannot create temperature_given_day.csv file. \n";
         return 1;
     }
 
-    resultfile << "Year;Mean_Daily_Temperature\n";
-
     for(const auto& [year, mean]: yearlymeans){
-        resultfile << year << ";" << mean << std::endl;
+        resultfile->add_text(year);
+        resultfile->add_number(mean);
+        resultfile->end_row();
     }
 
-    resultfile.close();
+    if (!resultfile->close()){
+        std::cerr << "Cannot write temperature_given_day.csv file. \n";
+        return 1;
+    }
 
+    metrics.count_file("bytes_out", "temperature_given_day.csv");
     std::cout << "Saved mean temperatures for the given day&month over a number of years in temperature_given_day.csv\n";
     
     return 0;
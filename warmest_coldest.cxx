@@ -3,22 +3,34 @@
 #include <sstream>
 #include <string>
 #include <map>
-#include <ctime>
+#include <cmath>
+#include "common/coverage.h"
+#include "common/daily_aggregate.h"
+#include "common/run_metrics.h"
+#include "common/station_series.h"
+#include "common/station_store.h"
 
 using namespace std;
 
-int main() {
-    std::ifstream inputFile("Uppsala.csv");
+// the 18:00 temperatures (or with --daily the daily max or min) of every day, as a compact fixed
+// point array (see common/station_series.h)
+const int kEvening = 0;
+
+// reads a column of the binary copy written by the cleaner; it is memory mapped, so no text has to be parsed
+bool read_binary(const char* filename, const char* column, smhi::StationSeries& evenings) {
+    smhi::StationStore store;
+    return store.open(filename) && evenings.load(store, column);
+}
+
+// field: the field of the value, 2 for the temperature of Uppsala.csv, smhi::kDailyFieldMin or
+// kDailyFieldMax for Uppsala_daily.csv (see common/daily_aggregate.h)
+bool read_csv(const char* filename, const char* time_wanted, int field, smhi::StationSeries& evenings) {
+    std::ifstream inputFile(filename);
     if (!inputFile.is_open()) {
         std::cerr << "Can't open input file!\n";
-        return 1;
+        return false;
     }
 
-    map<int, int> warmest_day;
-    map<int, double> warmest_temp;
-    map<int, int> coldest_day;
-    map<int, double> coldest_temp;
-
     string line;
 
     while (getline(inputFile, line)) {
@@ -26,41 +38,112 @@ int main() {
         stringstream ss(line);
         getline(ss, date, ';');
         getline(ss, time, ';');
-        getline(ss, temperature, ';');
+        for (int f = 2; f <= field; ++f)
+            getline(ss, temperature, ';');
 
-        if (time != "18:00:00")
+        if (time != time_wanted)
             continue;
-        
-        int year = stoi(date.substr(0, 4));
 
-        int y, m, d;
-        char dash;
-        stringstream date_ss(date);
-        date_ss >> y >> dash >> m >> dash >> d;
+        // the date is read once, straight from its fixed positions
+        int32_t day;
+        if (!smhi::parse_date_text(date, day))
+            continue;
 
-        tm timeinfo = {};
-        timeinfo.tm_year = y - 1900;
-        timeinfo.tm_mon = m - 1;
-        timeinfo.tm_mday = d;
-        mktime(&timeinfo);
-        int day_of_year = timeinfo.tm_yday + 1;
+        double temp;
+        if (!smhi::parse_decimal(temperature, temp))
+            continue;
 
-        double temp = stod(temperature);
+        evenings.set(day, smhi::time_code_from_text(time), temp);
 
+    }
+
+    inputFile.close();
+    return true;
+}
+
+int main(int argc, char** argv) {
+    // ./warmest_coldest --daily takes the warmest day by the daily max and the coldest by the daily min
+    // of all hours in Uppsala_daily.csv (cleaning_data --daily) instead of the 18:00 temperatures
+    // ./warmest_coldest --min-coverage 0.9 leaves out the years with a temperature on less than
+    // 90 % of the days, whose extremes may be missing (default 0: every year)
+    bool daily = false;
+    double min_coverage = 0;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--daily")
+            daily = true;
+        else if (arg == "--min-coverage" && i + 1 < argc && smhi::parse_decimal(string(argv[i + 1]), min_coverage))
+            ++i;
+        else {
+            cerr << "Usage: " << argv[0] << " [--daily] [--min-coverage F]\n";
+            return 1;
+        }
+    }
+    // with SMHI_METRICS=report.json the counts and times of the run are written there, see common/run_metrics.h
+    smhi::RunMetrics metrics("warmest_coldest");
+    map<int, int> warmest_day;
+    map<int, double> warmest_temp;
+    map<int, int> coldest_day;
+    map<int, double> coldest_temp;
+
+    // use the binary copy when the cleaner wrote one, otherwise parse the CSV
+    auto phase = metrics.phase("read");
+    const uint8_t hour = daily ? smhi::kNoTime : 18;
+    smhi::StationSeries highs({hour}), lows({hour});
+    if (daily) {
+        if (read_binary("Uppsala_daily.bin", "max", highs) && read_binary("Uppsala_daily.bin", "min", lows))
+            metrics.count_file("bytes_in", "Uppsala_daily.bin");
+        else if (read_csv("Uppsala_daily.csv", "", smhi::kDailyFieldMax, highs) &&
+                 read_csv("Uppsala_daily.csv", "", smhi::kDailyFieldMin, lows))
+            metrics.count_file("bytes_in", "Uppsala_daily.csv");
+        else
+            return 1;
+    }
+    else {
+        if (read_binary("Uppsala.bin", "temperature", highs))
+            metrics.count_file("bytes_in", "Uppsala.bin");
+        else if (read_csv("Uppsala.csv", "18:00:00", 2, highs))
+            metrics.count_file("bytes_in", "Uppsala.csv");
+        else
+            return 1;
+        lows = highs;
+    }
+    phase = metrics.phase("extremes");
+
+    // the days come in date order, so the first warmest/coldest day of a year wins like before
+    uint64_t readings = 0;
+    highs.for_each(kEvening, [&](int32_t day, double temp) {
+        readings++;
+        int year, m, d;
+        smhi::civil_from_days(day, year, m, d);
         if (warmest_temp.find(year) == warmest_temp.end() || temp > warmest_temp[year]) {
             warmest_temp[year] = temp;
-            warmest_day[year] = day_of_year;
+            warmest_day[year] = smhi::day_of_year(year, m, d);
         }
+    });
+    lows.for_each(kEvening, [&](int32_t day, double temp) {
+        int year, m, d;
+        smhi::civil_from_days(day, year, m, d);
         if (coldest_temp.find(year) == coldest_temp.end() || temp < coldest_temp[year]) {
             coldest_temp[year] = temp;
-            coldest_day[year] = day_of_year;
+            coldest_day[year] = smhi::day_of_year(year, m, d);
+        }
+    });
+    metrics.count("readings", readings);
+
+    if (min_coverage > 0) {
+        smhi::CoverageMap coverage({hour});
+        coverage.load(highs);
+        for (auto it = warmest_day.begin(); it != warmest_day.end();) {
+            if (coverage.year_completeness(0, it->first) < min_coverage) {
+                metrics.failure("year_incomplete");
+                it = warmest_day.erase(it);
+            } else
+                ++it;
         }
-
     }
 
-    inputFile.close();
-
-
+    phase = metrics.phase("write");
     ofstream outfile("Uppsala_warmest_results.csv");
     if (!outfile.is_open()) {
         cout << "Can't create file Uppsala_results.csv" << endl;
@@ -76,6 +159,9 @@ int main() {
     }
 
     outfile.close();
+    phase.stop();
+    metrics.count("years_written", warmest_day.size());
+    metrics.count_file("bytes_out", "Uppsala_warmest_results.csv");
     cout << "Uppsala_warmest_results.csv saved!" << endl;
 
     return 0;
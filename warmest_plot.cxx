@@ -1,4 +1,5 @@
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include "TH1F.h"
@@ -8,6 +9,7 @@
 #include "TStyle.h"
 #include "TROOT.h"
 #include <iostream>
+#include "common/figure_canvas.h"
 
 using namespace std;
 
@@ -16,21 +18,23 @@ double Gaussian(double* x, double* par) {
     return par[0] * exp(-0.5 * pow((x[0] - par[1]) / par[2], 2));
 }
 
-void plot_results() {
+// png: where the figure is saved, not saved when empty
+void plot_results(const char* csv = "Uppsala_warmest_results.csv", const char* png = "") {
 
     
     // --- Canvas and style ---
-    TCanvas *c = new TCanvas("c", "Warmest & Coldest Days", 800, 600);
+    TCanvas *c = smhi::figure_canvas("c_warmest", "Warmest & Coldest Days", 800, 600);
     gStyle->SetOptStat(0);
     gStyle->SetTitleFontSize(0.045);
 
     // --- Histograms ---
     TH1F *warm_hist = new TH1F("warm_hist", "Warmest and Coldest Days;Day of Year;Entries", 366, 0.5, 366.5);
     TH1F *cold_hist = new TH1F("cold_hist", "Warmest and Coldest Days;Day of Year;Entries", 366, 0.5, 366.5);
-    TH1F *cold_hist_right = new TH1F("cold_hist_right", "Right", 366, -60.5, 425.5);
+    // only used for the fit, never drawn: freed on every way out of the function
+    std::unique_ptr<TH1F> cold_hist_right(new TH1F("cold_hist_right", "Right", 366, -60.5, 425.5));
 
     // --- Read CSV file ---
-    ifstream infile("Uppsala_warmest_results.csv");
+    ifstream infile(csv);
     if (!infile.is_open()) {
         cout << "Error: cannot open CSV file!" << endl;
         return;
@@ -129,4 +133,5 @@ void plot_results() {
 
     // --- Final update ---
     c->Update();
+    if (png[0]) c->SaveAs(png);
 }